@@ -0,0 +1,426 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bitablecache.h"
+#include "bitableshared.h"
+#include "thread.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+
+/* The initial number of hash buckets for a cache (must be a power of 2) */
+#define BITABLE_CACHE_INITIAL_BUCKETS 64
+
+/** An open table in the cache. Handles given out by the cache are entries.
+  */
+struct BitableCacheHandle
+{
+
+    char* path;
+    uint64_t hash;
+    BitableReadable* table;
+    uint64_t mappedSize; // the bytes mapped by the table, counted against the cache budget
+    uint32_t references; // the number of acquired handles, the table is idle (and in the LRU list) when this is 0
+    int opening; // the table is being opened by the thread that added the entry, which broadcasts the cache's opened condition when it's done
+    struct BitableCacheHandle* nextInBucket;
+    struct BitableCacheHandle* lruPrevious; // towards the least recently used end
+    struct BitableCacheHandle* lruNext; // towards the most recently used end
+
+};
+
+typedef struct BitableCacheHandle CacheEntry;
+
+struct BitableTableCache
+{
+
+    BitableTableCacheOptions options;
+    BitableMutex* mutex; // protects everything below
+    BitableCondition* opened; // broadcast when a table has finished opening (or failed to)
+    CacheEntry** buckets;
+    uint64_t bucketCount; // always a power of 2
+    uint64_t openTables;
+    uint64_t mappedBytes;
+    CacheEntry* lruOldest; // the idle table to close first
+    CacheEntry* lruNewest;
+
+};
+
+/** Hash a path for the cache hash table.
+  * @param path The path to hash.
+  * @param [out] length The length of the path.
+  * @return The hash of the path.
+  */
+static uint64_t hash_path( const char* path, size_t* length )
+{
+    BitableValue value;
+
+    *length    = strlen( path );
+    value.data = path;
+    value.size = (int32_t)*length;
+
+    return bitable_key_hash( &value );
+}
+
+/** Find the entry for a path.
+  * @param cache The cache to look in.
+  * @param path The path to look for.
+  * @param hash The hash of the path.
+  * @return The entry, or NULL if the path isn't open in the cache.
+  */
+static CacheEntry* find_entry( const BitableTableCache* cache, const char* path, uint64_t hash )
+{
+    CacheEntry* entry;
+
+    for ( entry = cache->buckets[ hash & ( cache->bucketCount - 1 ) ]; entry != NULL; entry = entry->nextInBucket )
+    {
+        if ( entry->hash == hash && strcmp( entry->path, path ) == 0 )
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/** Double the number of hash buckets, redistributing the entries.
+  * @param cache The cache to grow.
+  */
+static void grow_buckets( BitableTableCache* cache )
+{
+    uint64_t     newCount   = cache->bucketCount * 2;
+    CacheEntry** newBuckets = calloc( (size_t)newCount, sizeof( CacheEntry* ) );
+    uint64_t     where;
+
+    if ( newBuckets == NULL )
+    {
+        // we can keep going with longer chains.
+        return;
+    }
+
+    for ( where = 0; where < cache->bucketCount; ++where )
+    {
+        CacheEntry* entry = cache->buckets[ where ];
+
+        while ( entry != NULL )
+        {
+            CacheEntry* next   = entry->nextInBucket;
+            uint64_t    bucket = entry->hash & ( newCount - 1 );
+
+            entry->nextInBucket  = newBuckets[ bucket ];
+            newBuckets[ bucket ] = entry;
+            entry                = next;
+        }
+    }
+
+    free( cache->buckets );
+
+    cache->buckets     = newBuckets;
+    cache->bucketCount = newCount;
+}
+
+/** Remove an entry from the idle list.
+  * @param cache The cache the entry is in.
+  * @param entry The idle entry.
+  */
+static void lru_remove( BitableTableCache* cache, CacheEntry* entry )
+{
+    if ( entry->lruPrevious != NULL )
+    {
+        entry->lruPrevious->lruNext = entry->lruNext;
+    }
+    else
+    {
+        cache->lruOldest = entry->lruNext;
+    }
+
+    if ( entry->lruNext != NULL )
+    {
+        entry->lruNext->lruPrevious = entry->lruPrevious;
+    }
+    else
+    {
+        cache->lruNewest = entry->lruPrevious;
+    }
+
+    entry->lruPrevious = NULL;
+    entry->lruNext     = NULL;
+}
+
+/** Add an entry to the most recently used end of the idle list.
+  * @param cache The cache the entry is in.
+  * @param entry The entry that has just become idle.
+  */
+static void lru_push( BitableTableCache* cache, CacheEntry* entry )
+{
+    entry->lruPrevious = cache->lruNewest;
+    entry->lruNext     = NULL;
+
+    if ( cache->lruNewest != NULL )
+    {
+        cache->lruNewest->lruNext = entry;
+    }
+    else
+    {
+        cache->lruOldest = entry;
+    }
+
+    cache->lruNewest = entry;
+}
+
+/** Close the table for an entry, and remove and free the entry.
+  * @param cache The cache the entry is in.
+  * @param entry The entry to close (which must be idle, or the cache is being freed).
+  */
+static void close_entry( BitableTableCache* cache, CacheEntry* entry )
+{
+    CacheEntry** link = &cache->buckets[ entry->hash & ( cache->bucketCount - 1 ) ];
+
+    while ( *link != entry )
+    {
+        link = &( *link )->nextInBucket;
+    }
+
+    *link = entry->nextInBucket;
+
+    cache->openTables  -= 1;
+    cache->mappedBytes -= entry->mappedSize;
+
+    bitable_read_free( entry->table );
+    free( entry->path );
+    free( entry );
+}
+
+/** Close idle tables, least recently used first, until the cache is within its budget (or there are no idle tables left).
+  * @param cache The cache to evict from.
+  */
+static void evict_idle( BitableTableCache* cache )
+{
+    while ( cache->lruOldest != NULL && 
+            ( cache->openTables > cache->options.maxOpenTables || cache->mappedBytes > cache->options.maxMappedBytes ) )
+    {
+        CacheEntry* entry = cache->lruOldest;
+
+        lru_remove( cache, entry );
+        close_entry( cache, entry );
+    }
+}
+
+void bitable_cache_default_options( BitableTableCacheOptions* options )
+{
+    memset( options, 0, sizeof( BitableTableCacheOptions ) );
+
+    bitable_read_default_options( &options->readOptions );
+
+    options->maxOpenTables  = 256;
+    options->maxMappedBytes = UINT64_MAX;
+}
+
+BitableTableCache* bitable_cache_create( const BitableTableCacheOptions* options )
+{
+    BitableTableCache* cache = calloc( 1, sizeof( BitableTableCache ) );
+
+    if ( cache == NULL )
+    {
+        return NULL;
+    }
+
+    cache->options     = *options;
+    cache->bucketCount = BITABLE_CACHE_INITIAL_BUCKETS;
+    cache->buckets     = calloc( BITABLE_CACHE_INITIAL_BUCKETS, sizeof( CacheEntry* ) );
+
+    if ( cache->buckets == NULL || bitable_mutex_create( &cache->mutex ) != BR_SUCCESS )
+    {
+        free( cache->buckets );
+        free( cache );
+        return NULL;
+    }
+
+    if ( bitable_condition_create( &cache->opened ) != BR_SUCCESS )
+    {
+        bitable_mutex_destroy( cache->mutex );
+        free( cache->buckets );
+        free( cache );
+        return NULL;
+    }
+
+    return cache;
+}
+
+BitableResult bitable_cache_acquire( BitableTableCache* cache, const char* path, BitableComparisonFunction* comparison, BitableCacheHandle** handle )
+{
+    size_t        length;
+    uint64_t      hash   = hash_path( path, &length );
+    BitableResult result = BR_SUCCESS;
+    CacheEntry*   entry;
+
+    bitable_mutex_lock( cache->mutex );
+
+    entry = find_entry( cache, path, hash );
+
+    // another thread is opening the table, wait for it rather than opening it twice (if the open fails, the entry is gone and we try ourselves).
+    while ( entry != NULL && entry->opening )
+    {
+        bitable_condition_wait( cache->opened, cache->mutex );
+
+        entry = find_entry( cache, path, hash );
+    }
+
+    if ( entry != NULL )
+    {
+        if ( entry->references == 0 )
+        {
+            lru_remove( cache, entry );
+        }
+    }
+    else
+    {
+        // the entry goes in the cache while the table is opened without the lock held, so other tables can be acquired in the meantime.
+        BitableStats stats;
+        CacheEntry** bucket;
+
+        entry = calloc( 1, sizeof( CacheEntry ) );
+
+        if ( entry != NULL )
+        {
+            entry->path  = malloc( length + 1 );
+            entry->table = bitable_read_allocate();
+        }
+
+        if ( entry == NULL || entry->path == NULL || entry->table == NULL )
+        {
+            bitable_mutex_unlock( cache->mutex );
+
+            if ( entry != NULL && entry->table != NULL )
+            {
+                bitable_read_free( entry->table );
+            }
+
+            if ( entry != NULL )
+            {
+                free( entry->path );
+                free( entry );
+            }
+
+            return BR_ALLOCATION_FAILED;
+        }
+
+        entry->hash    = hash;
+        entry->opening = 1;
+
+        memcpy( entry->path, path, length + 1 );
+
+        if ( cache->openTables >= cache->bucketCount )
+        {
+            grow_buckets( cache );
+        }
+
+        bucket = &cache->buckets[ hash & ( cache->bucketCount - 1 ) ];
+
+        entry->nextInBucket = *bucket;
+        *bucket             = entry;
+        cache->openTables  += 1;
+
+        bitable_mutex_unlock( cache->mutex );
+
+        result = bitable_read_open_with_options( entry->table, path, &cache->options.readOptions, comparison );
+
+        if ( result == BR_SUCCESS )
+        {
+            bitable_readable_stats( entry->table, &stats );
+
+            entry->mappedSize = stats.mappedSize;
+        }
+
+        bitable_mutex_lock( cache->mutex );
+
+        entry->opening = 0;
+
+        bitable_condition_broadcast( cache->opened );
+
+        if ( result != BR_SUCCESS )
+        {
+            close_entry( cache, entry );
+
+            bitable_mutex_unlock( cache->mutex );
+
+            return result;
+        }
+
+        cache->mappedBytes += entry->mappedSize;
+    }
+
+    entry->references += 1;
+
+    // opening a table may have taken the cache over budget.
+    evict_idle( cache );
+
+    bitable_mutex_unlock( cache->mutex );
+
+    *handle = entry;
+
+    return result;
+}
+
+const BitableReadable* bitable_cache_table( const BitableCacheHandle* handle )
+{
+    return handle->table;
+}
+
+void bitable_cache_release( BitableTableCache* cache, BitableCacheHandle* handle )
+{
+    bitable_mutex_lock( cache->mutex );
+
+    handle->references -= 1;
+
+    if ( handle->references == 0 )
+    {
+        lru_push( cache, handle );
+        evict_idle( cache );
+    }
+
+    bitable_mutex_unlock( cache->mutex );
+}
+
+void bitable_cache_free( BitableTableCache* cache )
+{
+    uint64_t where;
+
+    for ( where = 0; where < cache->bucketCount; ++where )
+    {
+        while ( cache->buckets[ where ] != NULL )
+        {
+            // a table still acquired (or being opened) would be closed under its user.
+            assert( cache->buckets[ where ]->references == 0 && !cache->buckets[ where ]->opening );
+
+            close_entry( cache, cache->buckets[ where ] );
+        }
+    }
+
+    bitable_condition_destroy( cache->opened );
+    bitable_mutex_destroy( cache->mutex );
+    free( cache->buckets );
+    free( cache );
+}
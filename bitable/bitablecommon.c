@@ -44,6 +44,11 @@ void bitable_build_paths( BitablePaths* paths, const char* basePath )
     strcpy( paths->largeValuePath, basePath );
     strcat( paths->largeValuePath, ".lvs" );
 
+    paths->bloomPath = malloc( basePathLength + 5 );
+
+    strcpy( paths->bloomPath, basePath );
+    strcat( paths->bloomPath, ".blm" );
+
     for ( where = 0; where < BITABLE_MAX_BRANCH_LEVELS; ++where )
     {
         paths->branchPaths[ where ] = malloc( basePathLength + 5 );
@@ -59,6 +64,7 @@ void bitable_free_paths( BitablePaths* paths )
 
     free( paths->leafPath );
     free( paths->largeValuePath );
+    free( paths->bloomPath );
 
     for ( where = 0; where < BITABLE_MAX_BRANCH_LEVELS; ++where )
     {
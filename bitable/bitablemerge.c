@@ -0,0 +1,947 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "bitablemerge.h"
+#include "bitableshared.h"
+#include "writablefile.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+
+/* The number of key ranges per thread a merge is split into by default */
+#define BITABLE_MERGE_RANGES_PER_THREAD 4
+
+/** The position of the merge cursor in one of the source tables.
+  */
+typedef struct MergeSource
+{
+
+    const BitableReadable* table;
+    BitableCursor cursor;
+    BitableValue key; // the key at the cursor (when valid)
+    uint64_t itemCount;
+    int valid; // the cursor is on an item (rather than off one end of the table)
+
+} MergeSource;
+
+/** State shared between the workers merging the ranges of bitable_merge.
+  */
+typedef struct MergeJob
+{
+
+    const BitableReadable* const* tables;
+    uint32_t tableCount;
+    const BitableValue* separators; // range i is from separators[ i - 1 ] (inclusive) up to separators[ i ] (exclusive), unbounded at either end
+    uint32_t rangeCount;
+    char** partPaths; // the path of the table written for each range
+    uint64_t* partItemCounts; // the number of items written for each range
+    BitableWriteOptions partOptions;
+    BitableCompletionOptions partCompletion;
+    BitableMutex* mutex; // protects nextRange and result
+    uint32_t nextRange;
+    BitableResult result; // the first failure from a worker
+
+} MergeJob;
+
+struct BitableMergeCursor
+{
+
+    MergeSource* sources;
+    uint32_t* tree; // tree[ 0 ] is the winning source, tree[ 1 .. count - 1 ] are the losers at each internal node (leaves are count .. 2 * count - 1)
+    uint32_t count;
+    int forward; // the direction the tree is ordered for, the winner is the smallest key going forward or the largest going backward
+    int positioned;
+
+};
+
+/** Update the cached key for a source after its cursor has moved.
+  * @param source The source that moved.
+  * @param result The result of moving the source cursor.
+  */
+static void load_key( MergeSource* source, BitableResult result )
+{
+    source->valid = result == BR_SUCCESS && bitable_key( &source->cursor, source->table, &source->key ) == BR_SUCCESS;
+}
+
+/** Check if one source comes before another in the current direction of the cursor. Exhausted sources lose to everything,
+  * and on equal keys the newer source wins (so older duplicates are visited, and skipped, after it).
+  * @param cursor The merge cursor.
+  * @param left The index of the left source.
+  * @param right The index of the right source.
+  * @return Non-zero if the left source beats the right one.
+  */
+static int beats( const BitableMergeCursor* cursor, uint32_t left, uint32_t right )
+{
+    const MergeSource* leftSource  = cursor->sources + left;
+    const MergeSource* rightSource = cursor->sources + right;
+    int                comparison;
+
+    if ( !leftSource->valid )
+    {
+        return 0;
+    }
+
+    if ( !rightSource->valid )
+    {
+        return 1;
+    }
+
+    comparison = bitable_compare( cursor->sources[ 0 ].table, &leftSource->key, &rightSource->key );
+
+    if ( comparison == 0 )
+    {
+        return left > right;
+    }
+
+    return cursor->forward ? comparison < 0 : comparison > 0;
+}
+
+/** Build a subtree of the loser tree, recording the loser at each internal node.
+  * @param cursor The merge cursor.
+  * @param node The root node of the subtree.
+  * @return The winning source of the subtree.
+  */
+static uint32_t build_tree( BitableMergeCursor* cursor, uint32_t node )
+{
+    uint32_t left;
+    uint32_t right;
+
+    if ( node >= cursor->count )
+    {
+        return node - cursor->count;
+    }
+
+    left  = build_tree( cursor, node * 2 );
+    right = build_tree( cursor, node * 2 + 1 );
+
+    if ( beats( cursor, left, right ) )
+    {
+        cursor->tree[ node ] = right;
+        return left;
+    }
+
+    cursor->tree[ node ] = left;
+    return right;
+}
+
+/** Replay the matches from a source to the root after it has moved, updating the winner.
+  * @param cursor The merge cursor.
+  * @param source The source that moved.
+  */
+static void replay( BitableMergeCursor* cursor, uint32_t source )
+{
+    uint32_t winner = source;
+    uint32_t node;
+
+    for ( node = ( source + cursor->count ) >> 1; node > 0; node >>= 1 )
+    {
+        if ( beats( cursor, cursor->tree[ node ], winner ) )
+        {
+            uint32_t loser = winner;
+
+            winner               = cursor->tree[ node ];
+            cursor->tree[ node ] = loser;
+        }
+    }
+
+    cursor->tree[ 0 ] = winner;
+}
+
+/** Rebuild the whole tree after all the sources have been positioned.
+  * @param cursor The merge cursor.
+  * @param forward The direction the cursor will move in.
+  * @return BR_SUCCESS if the cursor is on an item, BR_END_OF_SEQUENCE otherwise.
+  */
+static BitableResult rebuild( BitableMergeCursor* cursor, int forward )
+{
+    cursor->forward    = forward;
+    cursor->tree[ 0 ]  = build_tree( cursor, 1 );
+    cursor->positioned = cursor->sources[ cursor->tree[ 0 ] ].valid;
+
+    return cursor->positioned ? BR_SUCCESS : BR_END_OF_SEQUENCE;
+}
+
+/** Position a source at the first key greater than (or equal to, if inclusive) a key.
+  * @param source The source to position.
+  * @param key The key to position relative to.
+  * @param inclusive Whether an equal key is included.
+  * @return The result of the find in the source table (only errors other than running off the end are returned).
+  */
+static BitableResult seek_forward( MergeSource* source, const BitableValue* key, int inclusive )
+{
+    BitableResult result;
+
+    if ( source->itemCount == 0 )
+    {
+        source->valid = 0;
+        return BR_SUCCESS;
+    }
+
+    if ( inclusive )
+    {
+        result = bitable_find( &source->cursor, source->table, key, BFO_LOWER );
+    }
+    else
+    {
+        // the item after the last key less than or equal to the key, or the first item if every key is greater.
+        result = bitable_find( &source->cursor, source->table, key, BFO_UPPER );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_next( &source->cursor, source->table );
+        }
+        else if ( result == BR_END_OF_SEQUENCE )
+        {
+            result = bitable_first( &source->cursor, source->table );
+        }
+    }
+
+    load_key( source, result );
+
+    return result == BR_END_OF_SEQUENCE ? BR_SUCCESS : result;
+}
+
+/** Position a source at the last key less than (or equal to, if inclusive) a key.
+  * @param source The source to position.
+  * @param key The key to position relative to.
+  * @param inclusive Whether an equal key is included.
+  * @return The result of the find in the source table (only errors other than running off the end are returned).
+  */
+static BitableResult seek_backward( MergeSource* source, const BitableValue* key, int inclusive )
+{
+    BitableResult result;
+
+    if ( source->itemCount == 0 )
+    {
+        source->valid = 0;
+        return BR_SUCCESS;
+    }
+
+    if ( inclusive )
+    {
+        result = bitable_find( &source->cursor, source->table, key, BFO_UPPER );
+    }
+    else
+    {
+        // the item before the first key greater than or equal to the key, or the last item if every key is less.
+        result = bitable_find( &source->cursor, source->table, key, BFO_LOWER );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_previous( &source->cursor, source->table );
+        }
+        else if ( result == BR_END_OF_SEQUENCE )
+        {
+            result = bitable_last( &source->cursor, source->table );
+        }
+    }
+
+    load_key( source, result );
+
+    return result == BR_END_OF_SEQUENCE ? BR_SUCCESS : result;
+}
+
+/** Position every source relative to a key and rebuild the tree.
+  * @param cursor The merge cursor.
+  * @param key The key to position relative to.
+  * @param forward Whether to position at the keys after (rather than before) the key.
+  * @param inclusive Whether an equal key is included.
+  * @return BR_SUCCESS if the cursor is on an item, BR_END_OF_SEQUENCE if there is no item in that direction, or an error from a find.
+  */
+static BitableResult position( BitableMergeCursor* cursor, const BitableValue* key, int forward, int inclusive )
+{
+    uint32_t where;
+
+    for ( where = 0; where < cursor->count; ++where )
+    {
+        BitableResult result = forward ? seek_forward( cursor->sources + where, key, inclusive ) : seek_backward( cursor->sources + where, key, inclusive );
+
+        if ( result != BR_SUCCESS )
+        {
+            cursor->positioned = 0;
+            return result;
+        }
+    }
+
+    return rebuild( cursor, forward );
+}
+
+BitableResult bitable_merge_create( BitableMergeCursor** cursor, const BitableReadable* const* tables, uint32_t tableCount )
+{
+    BitableMergeCursor* result;
+    BitableStats        stats;
+    uint32_t            keyKind = 0;
+    uint32_t            where;
+
+    for ( where = 0; where < tableCount; ++where )
+    {
+        bitable_readable_stats( tables[ where ], &stats );
+
+        if ( where > 0 && stats.keyKind != keyKind )
+        {
+            return BR_KEY_KIND_INVALID;
+        }
+
+        keyKind = stats.keyKind;
+    }
+
+    if ( tableCount == 0 )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
+
+    result = calloc( 1, sizeof( BitableMergeCursor ) );
+
+    if ( result == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    result->sources = calloc( tableCount, sizeof( MergeSource ) );
+    result->tree    = calloc( tableCount, sizeof( uint32_t ) );
+
+    if ( result->sources == NULL || result->tree == NULL )
+    {
+        bitable_merge_free( result );
+
+        return BR_ALLOCATION_FAILED;
+    }
+
+    result->count   = tableCount;
+    result->forward = 1;
+
+    for ( where = 0; where < tableCount; ++where )
+    {
+        bitable_readable_stats( tables[ where ], &stats );
+
+        result->sources[ where ].table     = tables[ where ];
+        result->sources[ where ].itemCount = stats.itemCount;
+    }
+
+    *cursor = result;
+
+    return BR_SUCCESS;
+}
+
+void bitable_merge_free( BitableMergeCursor* cursor )
+{
+    free( cursor->sources );
+    free( cursor->tree );
+    free( cursor );
+}
+
+BitableResult bitable_merge_first( BitableMergeCursor* cursor )
+{
+    uint32_t where;
+
+    for ( where = 0; where < cursor->count; ++where )
+    {
+        MergeSource* source = cursor->sources + where;
+
+        load_key( source, source->itemCount > 0 ? bitable_first( &source->cursor, source->table ) : BR_END_OF_SEQUENCE );
+    }
+
+    return rebuild( cursor, 1 );
+}
+
+BitableResult bitable_merge_last( BitableMergeCursor* cursor )
+{
+    uint32_t where;
+
+    for ( where = 0; where < cursor->count; ++where )
+    {
+        MergeSource* source = cursor->sources + where;
+
+        load_key( source, source->itemCount > 0 ? bitable_last( &source->cursor, source->table ) : BR_END_OF_SEQUENCE );
+    }
+
+    return rebuild( cursor, 0 );
+}
+
+BitableResult bitable_merge_find( BitableMergeCursor* cursor, const BitableValue* searchKey, BitableFindOperation operation )
+{
+    switch ( operation )
+    {
+    case BFO_LOWER:
+
+        return position( cursor, searchKey, 1, 1 );
+
+    case BFO_UPPER:
+
+        return position( cursor, searchKey, 0, 1 );
+
+    case BFO_EXACT:
+        {
+            uint32_t where;
+
+            // the newest table with the key wins, so check from the newest down, stopping at the first hit. 
+            for ( where = cursor->count; where > 0; --where )
+            {
+                MergeSource*  source = cursor->sources + ( where - 1 );
+                BitableCursor found;
+                BitableResult result = source->itemCount > 0 ? bitable_find( &found, source->table, searchKey, BFO_EXACT ) : BR_KEY_NOT_FOUND;
+
+                if ( result == BR_SUCCESS )
+                {
+                    return position( cursor, searchKey, 1, 1 );
+                }
+                
+                if ( result != BR_KEY_NOT_FOUND )
+                {
+                    return result;
+                }
+            }
+
+            return BR_KEY_NOT_FOUND;
+        }
+    }
+
+    return BR_KEY_NOT_FOUND;
+}
+
+BitableResult bitable_merge_next( BitableMergeCursor* cursor )
+{
+    MergeSource* winner;
+    BitableValue current;
+
+    if ( !cursor->positioned )
+    {
+        return BR_END_OF_SEQUENCE;
+    }
+
+    winner  = cursor->sources + cursor->tree[ 0 ];
+    current = winner->key;
+
+    // changing direction - the other sources are positioned behind the current key, so move them all past it.
+    if ( !cursor->forward )
+    {
+        return position( cursor, &current, 1, 0 );
+    }
+
+    // move past the current key, along with any older duplicates of it (which come straight after it in the tree order).
+    do
+    {
+        load_key( winner, bitable_next( &winner->cursor, winner->table ) );
+        replay( cursor, cursor->tree[ 0 ] );
+
+        winner = cursor->sources + cursor->tree[ 0 ];
+    } 
+    while ( winner->valid && bitable_compare( cursor->sources[ 0 ].table, &winner->key, &current ) == 0 );
+
+    cursor->positioned = winner->valid;
+
+    return cursor->positioned ? BR_SUCCESS : BR_END_OF_SEQUENCE;
+}
+
+BitableResult bitable_merge_previous( BitableMergeCursor* cursor )
+{
+    MergeSource* winner;
+    BitableValue current;
+
+    if ( !cursor->positioned )
+    {
+        return BR_END_OF_SEQUENCE;
+    }
+
+    winner  = cursor->sources + cursor->tree[ 0 ];
+    current = winner->key;
+
+    // changing direction - the other sources are positioned ahead of the current key, so move them all before it.
+    if ( cursor->forward )
+    {
+        return position( cursor, &current, 0, 0 );
+    }
+
+    do
+    {
+        load_key( winner, bitable_previous( &winner->cursor, winner->table ) );
+        replay( cursor, cursor->tree[ 0 ] );
+
+        winner = cursor->sources + cursor->tree[ 0 ];
+    } 
+    while ( winner->valid && bitable_compare( cursor->sources[ 0 ].table, &winner->key, &current ) == 0 );
+
+    cursor->positioned = winner->valid;
+
+    return cursor->positioned ? BR_SUCCESS : BR_END_OF_SEQUENCE;
+}
+
+BitableResult bitable_merge_key_value_pair( const BitableMergeCursor* cursor, BitableValue* key, BitableValue* value, uint32_t* source )
+{
+    const MergeSource* winner;
+
+    if ( !cursor->positioned )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
+
+    winner = cursor->sources + cursor->tree[ 0 ];
+
+    if ( key != NULL )
+    {
+        *key = winner->key;
+    }
+
+    if ( source != NULL )
+    {
+        *source = cursor->tree[ 0 ];
+    }
+
+    return value != NULL ? bitable_value( &winner->cursor, winner->table, value ) : BR_SUCCESS;
+}
+
+BitableResult bitable_merge_position( const BitableMergeCursor* cursor, uint32_t* source, BitableCursor* sourceCursor )
+{
+    if ( !cursor->positioned )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
+
+    *source       = cursor->tree[ 0 ];
+    *sourceCursor = cursor->sources[ cursor->tree[ 0 ] ].cursor;
+
+    return BR_SUCCESS;
+}
+
+/** Delete all the files of a table, ignoring any that don't exist.
+  * @param path The path of the table.
+  */
+static void delete_table( const char* path )
+{
+    BitablePaths paths;
+    uint32_t     where;
+
+    bitable_build_paths( &paths, path );
+
+    bitable_wf_delete( paths.leafPath );
+    bitable_wf_delete( paths.largeValuePath );
+    bitable_wf_delete( paths.bloomPath );
+
+    for ( where = 0; where < BITABLE_MAX_BRANCH_LEVELS; ++where )
+    {
+        bitable_wf_delete( paths.branchPaths[ where ] );
+    }
+
+    bitable_free_paths( &paths );
+}
+
+/** Pick the keys to split a merge into ranges at, spread evenly through the largest table. The keys point into the table.
+  * @param tables The tables being merged.
+  * @param tableCount The number of tables.
+  * @param rangeCount The number of ranges wanted.
+  * @param [out] separators Array of rangeCount - 1 keys to populate, in strictly increasing order.
+  * @return The number of separators found (the number of ranges less 1).
+  */
+static uint32_t find_separators( const BitableReadable* const* tables, uint32_t tableCount, uint32_t rangeCount, BitableValue* separators )
+{
+    const BitableReadable* largest      = tables[ 0 ];
+    uint64_t               largestCount = 0;
+    uint32_t               count        = 0;
+    BitableCursor*         boundaries;
+    BitableCursor          first;
+    BitableCursor          last;
+    BitableValue           previous;
+    BitableStats           stats;
+    uint32_t               where;
+
+    for ( where = 0; where < tableCount; ++where )
+    {
+        bitable_readable_stats( tables[ where ], &stats );
+
+        if ( stats.itemCount > largestCount )
+        {
+            largest      = tables[ where ];
+            largestCount = stats.itemCount;
+        }
+    }
+
+    if ( largestCount == 0 || rangeCount < 2 )
+    {
+        return 0;
+    }
+
+    bitable_first( &first, largest );
+    bitable_last( &last, largest );
+    bitable_key( &first, largest, &previous );
+
+    boundaries = malloc( sizeof( BitableCursor ) * ( rangeCount + 1 ) );
+
+    // without the boundaries the merge still works, as a single range.
+    if ( boundaries == NULL )
+    {
+        return 0;
+    }
+
+    if ( bitable_split_ranges( largest, &first, &last, rangeCount, boundaries ) == BR_SUCCESS )
+    {
+        // the range boundaries are in item order, so separators only need checking against the one before (small tables and duplicates give repeats).
+        for ( where = 1; where < rangeCount; ++where )
+        {
+            BitableValue key;
+
+            if ( bitable_key( boundaries + where, largest, &key ) == BR_SUCCESS && bitable_compare( largest, &key, &previous ) > 0 )
+            {
+                separators[ count++ ] = key;
+                previous              = key;
+            }
+        }
+    }
+
+    free( boundaries );
+
+    return count;
+}
+
+/** Merge the items in a range of the key space into a table for the range.
+  * @param job The merge job.
+  * @param range The range to merge.
+  * @return BR_SUCCESS if the range was merged, otherwise the error from writing the table.
+  */
+static BitableResult merge_range( MergeJob* job, uint32_t range )
+{
+    BitableMergeCursor* cursor;
+    BitableWritable*    part;
+    BitableStats        stats;
+    BitableValue        key;
+    BitableValue        value;
+    BitableResult       moved;
+    BitableResult       result;
+    BitableResult       closeResult;
+
+    result = bitable_merge_create( &cursor, job->tables, job->tableCount );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    part   = bitable_write_allocate();
+    result = bitable_write_create_with_options( part, job->partPaths[ range ], &job->partOptions );
+
+    if ( result == BR_SUCCESS )
+    {
+        moved = range > 0 ? bitable_merge_find( cursor, job->separators + range - 1, BFO_LOWER ) : bitable_merge_first( cursor );
+
+        while ( moved == BR_SUCCESS && result == BR_SUCCESS )
+        {
+            bitable_merge_key_value_pair( cursor, &key, &value, NULL );
+
+            if ( range + 1 < job->rangeCount && bitable_compare( job->tables[ 0 ], &key, job->separators + range ) >= 0 )
+            {
+                break;
+            }
+
+            result = bitable_append( part, &key, &value );
+            moved  = bitable_merge_next( cursor );
+        }
+
+        bitable_writable_stats( part, &stats );
+
+        job->partItemCounts[ range ] = stats.itemCount;
+
+        closeResult = bitable_write_close( part, result == BR_SUCCESS ? job->partCompletion : BCO_DISCARD );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = closeResult;
+        }
+    }
+
+    bitable_write_free( part );
+    bitable_merge_free( cursor );
+
+    return result;
+}
+
+/** Worker for bitable_merge, takes ranges to merge until there are none left (or a range fails).
+  * @param context The merge job.
+  */
+static void run_merge_worker( void* context )
+{
+    MergeJob* job = context;
+
+    for ( ;; )
+    {
+        BitableResult result;
+        uint32_t      range;
+
+        bitable_mutex_lock( job->mutex );
+
+        range = job->result == BR_SUCCESS && job->nextRange < job->rangeCount ? job->nextRange++ : job->rangeCount;
+
+        bitable_mutex_unlock( job->mutex );
+
+        if ( range >= job->rangeCount )
+        {
+            return;
+        }
+
+        result = merge_range( job, range );
+
+        if ( result != BR_SUCCESS )
+        {
+            bitable_mutex_lock( job->mutex );
+
+            if ( job->result == BR_SUCCESS )
+            {
+                job->result = result;
+            }
+
+            bitable_mutex_unlock( job->mutex );
+        }
+    }
+}
+
+/** Stitch the tables written for each range together into the output table, copying their leaf pages whole.
+  * @param job The merge job, with all the ranges merged.
+  * @param path The path of the output table.
+  * @param options The options for the merge.
+  * @return BR_SUCCESS if the output table was written, otherwise the error from reading the range tables or writing the output.
+  */
+static BitableResult stitch_parts( const MergeJob* job, const char* path, const BitableMergeOptions* options )
+{
+    BitableWritable*    table        = bitable_write_allocate();
+    BitableReadable*    part         = bitable_read_allocate();
+    BitableWriteOptions writeOptions = options->writeOptions;
+    BitableStats        stats;
+    BitableResult       result;
+    BitableResult       closeResult;
+    uint32_t            where;
+
+    writeOptions.keyKind = job->partOptions.keyKind;
+
+    // with the item count known up front, the bloom filter is built as the pages are copied.
+    if ( writeOptions.bloomBitsPerKey > 0 )
+    {
+        writeOptions.expectedItemCount = 0;
+
+        for ( where = 0; where < job->rangeCount; ++where )
+        {
+            writeOptions.expectedItemCount += job->partItemCounts[ where ];
+        }
+    }
+
+    result = bitable_write_create_with_options( table, path, &writeOptions );
+
+    if ( result == BR_SUCCESS )
+    {
+        for ( where = 0; where < job->rangeCount && result == BR_SUCCESS; ++where )
+        {
+            result = bitable_read_open( part, job->partPaths[ where ], BRO_SEQUENTIAL, bitable_readable_comparison( job->tables[ 0 ] ) );
+
+            if ( result == BR_SUCCESS )
+            {
+                bitable_readable_stats( part, &stats );
+
+                result = bitable_append_pages( table, part, 0, stats.leafPages );
+
+                bitable_read_close( part );
+            }
+        }
+
+        closeResult = bitable_write_close( table, result == BR_SUCCESS ? options->completionOptions : BCO_DISCARD );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = closeResult;
+        }
+    }
+
+    bitable_read_free( part );
+    bitable_write_free( table );
+
+    return result;
+}
+
+void bitable_merge_default_options( BitableMergeOptions* options )
+{
+    memset( options, 0, sizeof( BitableMergeOptions ) );
+
+    bitable_write_default_options( &options->writeOptions );
+
+    options->completionOptions = BCO_NONE;
+    options->threadCount       = 0;
+    options->rangeCount        = 0;
+    options->partitioned       = 0;
+}
+
+BitableResult bitable_merge( const BitableReadable* const* tables, uint32_t tableCount, const char* path, const BitableMergeOptions* options, uint32_t* partCount )
+{
+    MergeJob        job;
+    BitableThread** threads;
+    BitableValue*   separators;
+    BitableStats    stats;
+    uint32_t        threadCount = options->threadCount > 0 ? options->threadCount : bitable_hardware_threads();
+    uint32_t        rangeCount  = options->rangeCount > 0 ? options->rangeCount : threadCount * BITABLE_MERGE_RANGES_PER_THREAD;
+    size_t          pathLength  = strlen( path );
+    uint32_t        keyKind     = 0;
+    BitableResult   result;
+    uint32_t        where;
+
+    if ( partCount != NULL )
+    {
+        *partCount = 0;
+    }
+
+    for ( where = 0; where < tableCount; ++where )
+    {
+        bitable_readable_stats( tables[ where ], &stats );
+
+        if ( where > 0 && stats.keyKind != keyKind )
+        {
+            return BR_KEY_KIND_INVALID;
+        }
+
+        keyKind = stats.keyKind;
+    }
+
+    if ( tableCount == 0 )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
+
+    separators = malloc( sizeof( BitableValue ) * rangeCount );
+
+    if ( separators == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    memset( &job, 0, sizeof( MergeJob ) );
+
+    job.tables                 = tables;
+    job.tableCount             = tableCount;
+    job.separators             = separators;
+    job.rangeCount             = find_separators( tables, tableCount, rangeCount, separators ) + 1;
+    job.partPaths              = calloc( job.rangeCount, sizeof( char* ) );
+    job.partItemCounts         = calloc( job.rangeCount, sizeof( uint64_t ) );
+    job.partOptions            = options->writeOptions;
+    job.partOptions.keyKind    = (BitableKeyKind)keyKind;
+    job.partCompletion         = options->completionOptions;
+    job.result                 = BR_SUCCESS;
+    result                     = BR_SUCCESS;
+
+    // tables for ranges that get stitched together are temporary, so they skip the bloom filter and durable writes and use one file each.
+    if ( !options->partitioned )
+    {
+        job.partOptions.flags             = ( options->writeOptions.flags & BWF_KEY_PREFIXES ) | BWF_SINGLE_FILE;
+        job.partOptions.bloomBitsPerKey   = 0;
+        job.partOptions.expectedItemCount = 0;
+        job.partCompletion                = BCO_NONE;
+    }
+
+    if ( job.partPaths == NULL || job.partItemCounts == NULL )
+    {
+        result = BR_ALLOCATION_FAILED;
+    }
+
+    for ( where = 0; where < job.rangeCount && result == BR_SUCCESS; ++where )
+    {
+        job.partPaths[ where ] = malloc( pathLength + 16 );
+
+        if ( job.partPaths[ where ] == NULL )
+        {
+            result = BR_ALLOCATION_FAILED;
+        }
+        else
+        {
+            sprintf( job.partPaths[ where ], "%s.r%04u", path, where );
+        }
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        result = bitable_mutex_create( &job.mutex );
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        threads = calloc( threadCount, sizeof( BitableThread* ) );
+
+        // without the thread handles, the calling thread does all the ranges itself.
+        if ( threads == NULL )
+        {
+            threadCount = 1;
+        }
+
+        // the calling thread works too, if a thread fails to start the other workers pick up its ranges.
+        for ( where = 1; where < threadCount && where < job.rangeCount; ++where )
+        {
+            if ( bitable_thread_create( threads + where, run_merge_worker, &job ) != BR_SUCCESS )
+            {
+                threads[ where ] = NULL;
+            }
+        }
+
+        run_merge_worker( &job );
+
+        for ( where = 1; where < threadCount; ++where )
+        {
+            if ( threads[ where ] != NULL )
+            {
+                bitable_thread_join( threads[ where ] );
+            }
+        }
+
+        free( threads );
+        bitable_mutex_destroy( job.mutex );
+
+        result = job.result;
+    }
+
+    if ( result == BR_SUCCESS && !options->partitioned )
+    {
+        result = stitch_parts( &job, path, options );
+
+        if ( result != BR_SUCCESS )
+        {
+            delete_table( path );
+        }
+    }
+
+    for ( where = 0; job.partPaths != NULL && where < job.rangeCount && job.partPaths[ where ] != NULL; ++where )
+    {
+        if ( result != BR_SUCCESS || !options->partitioned )
+        {
+            delete_table( job.partPaths[ where ] );
+        }
+
+        free( job.partPaths[ where ] );
+    }
+
+    if ( result == BR_SUCCESS && partCount != NULL )
+    {
+        *partCount = options->partitioned ? job.rangeCount : 1;
+    }
+
+    free( job.partPaths );
+    free( job.partItemCounts );
+    free( separators );
+
+    return result;
+}
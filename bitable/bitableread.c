@@ -29,18 +29,169 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memory.h>
 #include <assert.h>
 
+/** A search key, with the values used for comparing it against stored keys calculated up front.
+  */
+typedef struct SearchKey
+{
+
+    const BitableValue* key;
+    uint64_t value; // the key prefix for tables with key prefixes, or the ordered value for fixed width key kinds.
+
+} SearchKey;
+
+/** Searches a branch node for the last key less than or equal to the search key, starting at the key index low. 
+  * Returns the key index found, or -1 for the first child.
+  */
+typedef int (BranchSearchFunction)( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey );
+
+/** Lower bound search of a leaf page from the item low. Returns the first item greater or equal to the search key (or -1),
+  * populating bestComparison with the comparison result for that item.
+  */
+typedef int (LeafSearchFunction)( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, int* bestComparison );
+
+/** Compares the key at an index in a branch node with the search key.
+  */
+typedef int (BranchCompareFunction)( const BitableReadable* table, const uint8_t* node, int index, const SearchKey* searchKey );
+
+/** The set of search functions specialised for a particular key kind. 
+  */
+typedef struct SearchKernels
+{
+
+    BranchSearchFunction*  branchSearch;
+    LeafSearchFunction*    leafSearch;
+    BranchCompareFunction* branchCompare;
+
+} SearchKernels;
+
+/** A reference to a key in a cached branch level, used to break ties between equal key heads.
+  */
+typedef struct CachedKeyRef
+{
+
+    const uint8_t* data;
+    uint32_t size;
+
+} CachedKeyRef;
+
+/** In memory copy of the top levels of the branch tree, as a single sorted set of key heads in Eytzinger (breadth first) order.
+  * The keys in the cached levels are exactly the first keys of the pages in the level below them (apart from the first page),
+  * so counting the keys less than or equal to a search key gives the page in the level below the cache.
+  */
+typedef struct BranchCache
+{
+
+    uint64_t* heads; // key heads in Eytzinger order, 1 based and cache line aligned so the descendants 3 levels down share a cache line.
+    void* headsAllocation; // the unaligned allocation for heads
+    uint32_t* ranks; // the sorted position of each key head in Eytzinger order
+    CachedKeyRef* keys; // the full keys in sorted order, when heads are inexact (NULL otherwise)
+    uint64_t count; // the number of key heads
+    int levels; // the number of branch levels cached
+    int exact; // heads are the full ordered key (fixed width key kinds), rather than a prefix
+
+} BranchCache;
+
+/** A view of one part of a table in memory. This is either a whole file, or an extent of a single file table.
+  */
+typedef struct TableView
+{
+
+    const uint8_t* address;
+    uint64_t size;
+
+} TableView;
+
 typedef struct BitableReadable
 {
 
     BitableHeader* header;
     BitableMemoryMappedFile leafFile;
-    BitableMemoryMappedFile branchFiles[ BITABLE_MAX_BRANCH_LEVELS ];
+    BitableMemoryMappedFile branchFiles[ BITABLE_MAX_BRANCH_LEVELS ]; // separate branch files, or anonymous copies of branch extents
     BitableMemoryMappedFile largeValueFile;
+    BitableMemoryMappedFile bloomFile;
+    TableView branchViews[ BITABLE_MAX_BRANCH_LEVELS ];
+    TableView largeValueView;
+    TableView bloomView;
     BitableComparisonFunction* comparison;
     BitablePaths paths;
+    uint32_t leafHeaderSize; // size of the leaf page header before the indices
+    uint32_t leafIndiceSize; // size of each indice in a leaf page
+    uint32_t branchHeaderSize; // size of the branch page header before the indices
+    uint32_t branchIndiceSize; // size of each indice in a branch page
+    BitableKeyKind keyKind;
+    const SearchKernels* kernels; // search functions for the key kind
+    const uint64_t* bloomBlocks; // the bloom filter blocks (NULL if the table doesn't have a bloom filter)
+    BranchCache branchCache; // in memory copy of the top branch levels (levels is 0 if there isn't one)
+    int leafIndicesValid; // whether the leaf pages have their initial indices (tables from older writers don't)
 
 } BitableReadable;
 
+static const SearchKernels* select_kernels( BitableKeyKind keyKind, uint32_t formatFlags );
+static void build_branch_cache( BitableReadable* table, const BitableReadOptions* options );
+
+/** Get the address of a leaf page.
+  * @param table The table to get the leaf page from.
+  * @param page The leaf page number (not including the header page).
+  * @return The address of the leaf page.
+  */
+static const uint8_t* leaf_page( const BitableReadable* table, uint64_t page )
+{
+    return (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( page + 1 ) );
+}
+
+/** Get the number of items in a leaf page.
+  * @param page The leaf page address.
+  * @return The number of items in the page.
+  */
+static int32_t leaf_item_count( const uint8_t* page )
+{
+    return *(const int32_t*)( page + sizeof( uint64_t ) );
+}
+
+/** Get the indice of the first item in a leaf page.
+  * @param page The leaf page address.
+  * @return The initial indice of the page.
+  */
+static uint64_t leaf_initial_indice( const uint8_t* page )
+{
+    return *(const uint64_t*)page;
+}
+
+/** Get the indice of the first item in a leaf page, for tables with or without valid leaf page indices.
+  * Tables without them are handled by adding up the item counts of the pages before, which touches every page before it.
+  * @param table The table the leaf page belongs to.
+  * @param page The leaf page number.
+  * @return The initial indice of the page.
+  */
+static uint64_t page_initial_indice( const BitableReadable* table, uint64_t page )
+{
+    uint64_t indice = 0;
+    uint64_t where;
+
+    if ( table->leafIndicesValid )
+    {
+        return leaf_initial_indice( leaf_page( table, page ) );
+    }
+
+    for ( where = 0; where < page; ++where )
+    {
+        indice += leaf_item_count( leaf_page( table, where ) );
+    }
+
+    return indice;
+}
+
+/** Get the indice for an item in a leaf page. 
+  * @param table The table the leaf page belongs to.
+  * @param page The leaf page address.
+  * @param item The item in the leaf page.
+  * @return The indice for the item.
+  */
+static const BitableLeafIndice* leaf_indice( const BitableReadable* table, const uint8_t* page, int32_t item )
+{
+    return (const BitableLeafIndice*)( page + table->leafHeaderSize + item * table->leafIndiceSize );
+}
+
 /** Cleans up a readable bitable and closes the files associated with it.
   * @param table The table to cleanup.
   */
@@ -50,6 +201,7 @@ static void cleanup_table( BitableReadable* table )
 
     bitable_mmf_close( &table->leafFile );
     bitable_mmf_close( &table->largeValueFile );
+    bitable_mmf_close( &table->bloomFile );
 
     for ( where = 0; where < BITABLE_MAX_BRANCH_LEVELS; ++where )
     {
@@ -58,9 +210,71 @@ static void cleanup_table( BitableReadable* table )
 
     bitable_free_paths( &table->paths );
 
+    free( table->branchCache.headsAllocation );
+    free( table->branchCache.ranks );
+    free( table->branchCache.keys );
+
     memset( table, 0, sizeof( BitableReadable ) );
 }
 
+/** Open a part of a table (a branch level, the large value store or the bloom filter), applying its residency options (apart from locking).
+  * For a single file table, the view is an extent of the leaf file, otherwise the part is opened from its own file.
+  * @param table The table being opened, with its header validated.
+  * @param [out] view The view of the part of the table.
+  * @param [out] file The file opened for the part, or the anonymous copy of its extent.
+  * @param path The path of the file for the part, when it isn't a single file table.
+  * @param extent The extent of the part in a single file table.
+  * @param openFlags The flags to open the file with.
+  * @param residency The residency flags for the part.
+  * @return BR_SUCCESS if the part is opened, BR_FILE_TOO_SMALL if the extent is outside the file, or the error from opening the file.
+  */
+static BitableResult open_view( BitableReadable*         table, 
+                                TableView*               view, 
+                                BitableMemoryMappedFile* file, 
+                                const char*              path, 
+                                const BitableExtent*     extent, 
+                                BitableReadOpenFlags     openFlags, 
+                                uint32_t                 residency )
+{
+    BitableResult result;
+
+    if ( ( table->header->formatFlags & BITABLE_FORMAT_SINGLE_FILE ) != 0 )
+    {
+        uint64_t leafEnd = ( table->header->leafPages + 1 ) * table->header->pageSize;
+
+        if ( extent->offset < leafEnd || extent->offset > table->leafFile.size || extent->size > table->leafFile.size - extent->offset )
+        {
+            return BR_FILE_TOO_SMALL;
+        }
+
+        view->address = (const uint8_t*)table->leafFile.address + extent->offset;
+        view->size    = extent->size;
+
+        if ( ( residency & BRR_ANONYMOUS_COPY ) != 0 && bitable_mmf_copy( file, view->address, (size_t)view->size ) == BR_SUCCESS )
+        {
+            view->address = file->address;
+        }
+        else
+        {
+            bitable_mmf_advise_range( view->address, (size_t)view->size, residency );
+        }
+
+        return BR_SUCCESS;
+    }
+
+    result = bitable_mmf_open_resident( file, path, openFlags, residency & ~BRR_LOCK, NULL );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    view->address = file->address;
+    view->size    = file->size;
+
+    return BR_SUCCESS;
+}
+
 BitableReadable* bitable_read_allocate()
 {
     BitableReadable* result = calloc( 1, sizeof( BitableReadable ) );
@@ -68,10 +282,33 @@ BitableReadable* bitable_read_allocate()
     return result;
 }
 
+void bitable_read_default_options( BitableReadOptions* options )
+{
+    memset( options, 0, sizeof( BitableReadOptions ) );
+
+    options->openFlags          = BRO_NONE;
+    options->cachedBranchLevels = 0;
+    options->branchCacheBudget  = 4 * 1024 * 1024;
+    options->lockBudget         = 16 * 1024 * 1024;
+}
+
 BitableResult bitable_read_open( BitableReadable* table, const char* path, BitableReadOpenFlags openFlags, BitableComparisonFunction* comparison )
 {
-    BitableResult result = BR_SUCCESS;
-    uint32_t where;
+    BitableReadOptions options;
+
+    bitable_read_default_options( &options );
+
+    options.openFlags = openFlags;
+
+    return bitable_read_open_with_options( table, path, &options, comparison );
+}
+
+BitableResult bitable_read_open_with_options( BitableReadable* table, const char* path, const BitableReadOptions* options, BitableComparisonFunction* comparison )
+{
+    BitableResult        result    = BR_SUCCESS;
+    BitableReadOpenFlags openFlags = options->openFlags;
+    uint64_t             lockBudget;
+    uint32_t             where;
 
     table->comparison = comparison;
 
@@ -82,7 +319,8 @@ BitableResult bitable_read_open( BitableReadable* table, const char* path, Bitab
 
     bitable_build_paths( &table->paths, path );
 
-    result = bitable_mmf_open( &table->leafFile, table->paths.leafPath, openFlags );
+    // the header lives in the leaf file, so it's opened first, but it's locked last (after the smaller, hotter files).
+    result = bitable_mmf_open_resident( &table->leafFile, table->paths.leafPath, openFlags, options->leafResidency & ~BRR_LOCK, NULL );
 
     if ( result != BR_SUCCESS )
     {
@@ -98,26 +336,113 @@ BitableResult bitable_read_open( BitableReadable* table, const char* path, Bitab
 
     table->header = table->leafFile.address;
 
-    if ( bitable_header_checksum( table->header ) != table->header->checksum )
+    if ( bitable_header_checksum( table->header ) != table->header->checksum || ( table->header->formatFlags & ~BITABLE_FORMAT_ALL ) != 0 )
+    {
+        cleanup_table( table );
+        return BR_HEADER_CORRUPT;
+    }
+
+    if ( table->header->keyKind >= BKK_COUNT )
+    {
+        cleanup_table( table );
+        return BR_HEADER_CORRUPT;
+    }
+
+    if ( table->header->pageSize < BITABLE_MIN_PAGE_SIZE || table->header->leafPages == 0 )
+    {
+        cleanup_table( table );
+        return BR_HEADER_CORRUPT;
+    }
+
+    if ( table->leafFile.size / table->header->pageSize < table->header->leafPages + 1 )
+    {
+        cleanup_table( table );
+        return BR_FILE_TOO_SMALL;
+    }
+
+    // older writers didn't fill in the initial indice of leaf pages, in which case the indices only add up for single page tables.
+    {
+        const uint8_t* lastPage = leaf_page( table, table->header->leafPages - 1 );
+
+        table->leafIndicesValid = leaf_initial_indice( lastPage ) + leaf_item_count( lastPage ) == table->header->itemCount;
+    }
+
+    table->keyKind = (BitableKeyKind)table->header->keyKind;
+    if ( ( table->header->formatFlags & BITABLE_FORMAT_INTERPOLATION ) != 0 && !bitable_key_kind_is_integer( table->keyKind ) )
     {
         cleanup_table( table );
         return BR_HEADER_CORRUPT;
     }
 
+    table->kernels = select_kernels( table->keyKind, table->header->formatFlags );
+
+    if ( table->keyKind == BKK_CUSTOM && comparison == NULL )
+    {
+        cleanup_table( table );
+        return BR_KEY_KIND_INVALID;
+    }
+
+    if ( ( table->header->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+    {
+        table->leafHeaderSize   = BITABLE_PREFIXED_HEADER_SIZE;
+        table->leafIndiceSize   = sizeof( BitablePrefixedLeafIndice );
+        table->branchHeaderSize = BITABLE_PREFIXED_HEADER_SIZE;
+        table->branchIndiceSize = sizeof( BitablePrefixedBranchIndice );
+    }
+    else
+    {
+        table->leafHeaderSize   = BITABLE_LEAF_HEADER_SIZE;
+        table->leafIndiceSize   = sizeof( BitableLeafIndice );
+        table->branchHeaderSize = BITABLE_BRANCH_HEADER_SIZE;
+        table->branchIndiceSize = sizeof( BitableBranchIndice );
+    }
+
     if ( table->header->largeValueStoreSize > 0 )
     {
-        result = bitable_mmf_open( &table->largeValueFile, table->paths.largeValuePath, openFlags );
+        result = open_view( table, &table->largeValueView, &table->largeValueFile, table->paths.largeValuePath, &table->header->largeValueExtent, openFlags, options->largeValueResidency );
+
+        if ( result == BR_SUCCESS && table->largeValueView.size < table->header->largeValueStoreSize )
+        {
+            result = BR_FILE_TOO_SMALL;
+        }
+
+        if ( result != BR_SUCCESS )
+        {
+            cleanup_table( table );
+            return result;
+        }
+    }
+
+    if ( ( table->header->formatFlags & BITABLE_FORMAT_BLOOM_FILTER ) != 0 )
+    {
+        if ( table->header->bloomBlockCount == 0 || table->header->bloomHashCount < 1 || table->header->bloomHashCount > BITABLE_BLOOM_MAX_HASHES )
+        {
+            cleanup_table( table );
+            return BR_HEADER_CORRUPT;
+        }
+
+        // bloom filter probes are effectively random, so we don't want read-ahead.
+        result = open_view( table, &table->bloomView, &table->bloomFile, table->paths.bloomPath, &table->header->bloomExtent, BRO_RANDOM, options->bloomResidency );
+
+        if ( result == BR_SUCCESS && table->bloomView.size / BITABLE_BLOOM_BLOCK_SIZE < table->header->bloomBlockCount )
+        {
+            result = BR_FILE_TOO_SMALL;
+        }
 
         if ( result != BR_SUCCESS )
         {
             cleanup_table( table );
             return result;
         }
+
+        table->bloomBlocks = (const uint64_t*)table->bloomView.address;
     }
 
     for ( where = 0; where < table->header->depth; ++where )
     {
-        result = bitable_mmf_open( &table->branchFiles[ where ], table->paths.branchPaths[ where ], BRO_RANDOM );
+        uint32_t residency = options->branchResidency[ table->header->depth - 1 - where ];
+
+        result = open_view( table, &table->branchViews[ where ], &table->branchFiles[ where ], table->paths.branchPaths[ where ], &table->header->branchExtents[ where ], BRO_RANDOM, residency );
 
         if ( result != BR_SUCCESS )
         {
@@ -126,6 +451,37 @@ BitableResult bitable_read_open( BitableReadable* table, const char* path, Bitab
         }
     }
 
+    // lock from the top of the tree down, so the budget goes to the smallest and hottest parts of the table first.
+    lockBudget = options->lockBudget;
+
+    for ( where = table->header->depth; where > 0; --where )
+    {
+        if ( ( options->branchResidency[ table->header->depth - where ] & BRR_LOCK ) != 0 )
+        {
+            bitable_mmf_lock_range( table->branchViews[ where - 1 ].address, (size_t)table->branchViews[ where - 1 ].size, &lockBudget );
+        }
+    }
+
+    if ( table->bloomBlocks != NULL && ( options->bloomResidency & BRR_LOCK ) != 0 )
+    {
+        bitable_mmf_lock_range( table->bloomView.address, (size_t)table->bloomView.size, &lockBudget );
+    }
+
+    if ( ( options->leafResidency & BRR_LOCK ) != 0 )
+    {
+        bitable_mmf_lock_range( table->leafFile.address, (size_t)( ( table->header->leafPages + 1 ) * table->header->pageSize ), &lockBudget );
+    }
+
+    if ( table->header->largeValueStoreSize > 0 && ( options->largeValueResidency & BRR_LOCK ) != 0 )
+    {
+        bitable_mmf_lock_range( table->largeValueView.address, (size_t)table->largeValueView.size, &lockBudget );
+    }
+
+    if ( options->cachedBranchLevels > 0 )
+    {
+        build_branch_cache( table, options );
+    }
+
     return BR_SUCCESS;
 }
 
@@ -141,11 +497,23 @@ BitableResult bitable_read_close( BitableReadable* table )
     return BR_SUCCESS;
 }
 
+/** Get the size of the mapping for a part of a table, if it is a mapping of its own. The parts of a single file table are views of the table file's
+  * mapping (which is counted with the leaf file), unless they have been copied for their residency options.
+  * @param table The table.
+  * @param file The file for the part.
+  * @return The size of the part's own mapping, or 0 if it doesn't have one.
+  */
+static uint64_t distinct_mapped_size( const BitableReadable* table, const BitableMemoryMappedFile* file )
+{
+    return file->address != NULL && file->address != table->leafFile.address ? file->size : 0;
+}
+
 BitableResult bitable_readable_stats( const BitableReadable* table, BitableStats* stats )
 {
     /* TODO - error handling here */
 
     const BitableHeader* header = table->header;
+    uint32_t             where;
 
     stats->depth               = header->depth;
     stats->itemCount           = header->itemCount;
@@ -154,10 +522,60 @@ BitableResult bitable_readable_stats( const BitableReadable* table, BitableStats
     stats->pageSize            = header->pageSize;
     stats->largeValueStoreSize = header->largeValueStoreSize;
     stats->leafPages           = header->leafPages;
+    stats->keyKind             = header->keyKind;
+    stats->bloomFilterSize     = table->bloomBlocks != NULL ? header->bloomBlockCount * BITABLE_BLOOM_BLOCK_SIZE : 0;
+    stats->mappedSize          = table->leafFile.size + distinct_mapped_size( table, &table->largeValueFile ) + distinct_mapped_size( table, &table->bloomFile );
+
+    for ( where = 0; where < header->depth; ++where )
+    {
+        stats->mappedSize += distinct_mapped_size( table, &table->branchFiles[ where ] );
+    }
 
     return BR_SUCCESS;
 }
 
+const BitableHeader* bitable_readable_header( const BitableReadable* table )
+{
+    return table->header;
+}
+
+const uint8_t* bitable_readable_leaf_page( const BitableReadable* table, uint64_t page )
+{
+    return leaf_page( table, page );
+}
+
+const uint8_t* bitable_readable_large_values( const BitableReadable* table )
+{
+    return table->largeValueView.address;
+}
+
+BitableComparisonFunction* bitable_readable_comparison( const BitableReadable* table )
+{
+    return table->comparison;
+}
+
+int bitable_compare( const BitableReadable* table, const BitableValue* left, const BitableValue* right )
+{
+    switch ( table->keyKind )
+    {
+    case BKK_CUSTOM:
+
+        return table->comparison( left, right );
+
+    case BKK_MEMCMP:
+
+        return bitable_memcmp_compare( left->data, left->size, right->data, right->size );
+
+    default:
+        {
+            uint64_t leftOrdered  = bitable_key_ordered( table->keyKind, left->data );
+            uint64_t rightOrdered = bitable_key_ordered( table->keyKind, right->data );
+
+            return leftOrdered < rightOrdered ? -1 : ( leftOrdered > rightOrdered ? 1 : 0 );
+        }
+    }
+}
+
 BitableResult bitable_first( BitableCursor* cursor, const BitableReadable* table )
 {
     if ( table->header->itemCount == 0 )
@@ -179,149 +597,1020 @@ BitableResult bitable_last( BitableCursor* cursor, const BitableReadable* table
     }
 
     cursor->page = table->header->leafPages - 1;
+    cursor->item = leaf_item_count( leaf_page( table, cursor->page ) ) - 1;
+
+    return BR_SUCCESS;
+}
+
+/** Get the address of a branch page.
+  * @param table The table to get the branch page from.
+  * @param level The branch level of the page.
+  * @param page The page number within the branch level.
+  * @return The address of the branch page.
+  */
+static const uint8_t* branch_page( const BitableReadable* table, int level, uint64_t page )
+{
+    return table->branchViews[ level ].address + ( table->header->pageSize * page );
+}
 
+/** Compare a stored key against a search key. Always inlined, so when the key kind and prefix usage are constants
+  * the comparison for the key kind is inlined directly into the search loop.
+  * @param table The table the key belongs to.
+  * @param keyKind The kind of key.
+  * @param usePrefixes Whether to compare key prefixes before the full key.
+  * @param keyData The stored key data.
+  * @param keySize The stored key size.
+  * @param keyPrefix The stored key prefix (if prefixes are used).
+  * @param searchKey The search key.
+  * @return Less than 0 if the stored key is less than the search key, 0 if equal and greater than 0 otherwise.
+  */
+BITABLE_FORCE_INLINE int compare_key( const BitableReadable* table, BitableKeyKind keyKind, int usePrefixes, const uint8_t* keyData, uint16_t keySize, uint64_t keyPrefix, const SearchKey* searchKey )
+{
+    // when the prefixes differ they decide the comparison without needing to look at the key.
+    if ( usePrefixes && keyPrefix != searchKey->value )
     {
-        const uint64_t* page = (const uint64_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
+        return keyPrefix < searchKey->value ? -1 : 1;
+    }
 
-        int32_t itemCount = *(const int32_t*)( page + 1 );
+    switch ( keyKind )
+    {
+    case BKK_CUSTOM:
+        {
+            BitableValue readKey;
 
-        cursor->item = itemCount - 1;
+            readKey.data = keyData;
+            readKey.size = keySize;
+
+            return table->comparison( &readKey, searchKey->key );
+        }
+
+    case BKK_MEMCMP:
+
+        return bitable_memcmp_compare( keyData, keySize, searchKey->key->data, searchKey->key->size );
+
+    default:
+        {
+            uint64_t ordered = bitable_key_ordered( keyKind, keyData );
+
+            return ordered < searchKey->value ? -1 : ( ordered > searchKey->value ? 1 : 0 );
+        }
     }
+}
+
+/** Generic version of the branch compare function, instantiated for each key kind.
+  */
+BITABLE_FORCE_INLINE int branch_compare_generic( const BitableReadable* table, const uint8_t* node, int index, const SearchKey* searchKey, BitableKeyKind keyKind, int usePrefixes )
+{
+    const BitableBranchIndice* indice = (const BitableBranchIndice*)( node + table->branchHeaderSize + index * table->branchIndiceSize );
+
+    return compare_key( table, 
+                        keyKind, 
+                        usePrefixes, 
+                        node + indice->itemOffset, 
+                        indice->keySize, 
+                        usePrefixes ? ( (const BitablePrefixedBranchIndice*)indice )->keyPrefix : 0, 
+                        searchKey );
+}
+
+/** Generic version of the branch search function, instantiated for each key kind.
+  */
+BITABLE_FORCE_INLINE int branch_search_generic( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, BitableKeyKind keyKind, int usePrefixes )
+{
+    int childCount       = *(const uint16_t*)( node + sizeof( uint64_t ) );
+    int high             = childCount - 2;
+    int best             = low - 1;
+    int comparisonResult = -1;
+
+    // Upper bound search with termination on equals -
+    // will find the item equal to first below the key.
+    // If no best item is found, then the child for the first node (which doesn't have a key in the array) is taken.
+    while ( low <= high && comparisonResult != 0 )
+    {
+        int mid = low + ( ( high - low ) / 2 );
+
+        comparisonResult = branch_compare_generic( table, node, mid, searchKey, keyKind, usePrefixes );
+
+        if ( comparisonResult <= 0 )
+        {
+            best = mid;
+            low  = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return best;
+}
+
+/** Generic version of the leaf search function, instantiated for each key kind.
+  */
+BITABLE_FORCE_INLINE int leaf_search_generic( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, int* bestComparison, BitableKeyKind keyKind, int usePrefixes )
+{
+    int high = leaf_item_count( node ) - 1;
+    int best = -1;
+
+    *bestComparison = 1;
+
+    while ( high >= low && *bestComparison != 0 )
+    {
+        int                      mid    = low + ( ( high - low ) / 2 );
+        const BitableLeafIndice* indice = leaf_indice( table, node, mid );
+        int                      comparisonResult;
+
+        comparisonResult = compare_key( table, 
+                                        keyKind, 
+                                        usePrefixes, 
+                                        node + indice->itemOffset, 
+                                        indice->keySize, 
+                                        usePrefixes ? ( (const BitablePrefixedLeafIndice*)indice )->keyPrefix : 0, 
+                                        searchKey );
+
+        if ( comparisonResult >= 0 )
+        {
+            *bestComparison = comparisonResult;
+            best            = mid;
+            high            = mid - 1;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    return best;
+}
+
+/* Instantiate the search functions for a key kind, with the comparison inlined. */
+#define BITABLE_SEARCH_KERNELS( name, keyKind, usePrefixes ) \
+    static int branch_search_##name( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey ) \
+    { \
+        return branch_search_generic( table, node, low, searchKey, keyKind, usePrefixes ); \
+    } \
+    static int leaf_search_##name( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, int* bestComparison ) \
+    { \
+        return leaf_search_generic( table, node, low, searchKey, bestComparison, keyKind, usePrefixes ); \
+    } \
+    static int branch_compare_##name( const BitableReadable* table, const uint8_t* node, int index, const SearchKey* searchKey ) \
+    { \
+        return branch_compare_generic( table, node, index, searchKey, keyKind, usePrefixes ); \
+    } \
+    static const SearchKernels name##_kernels = { branch_search_##name, leaf_search_##name, branch_compare_##name };
+
+BITABLE_SEARCH_KERNELS( custom, BKK_CUSTOM, 0 )
+BITABLE_SEARCH_KERNELS( custom_prefixed, BKK_CUSTOM, 1 )
+BITABLE_SEARCH_KERNELS( memcmp, BKK_MEMCMP, 0 )
+BITABLE_SEARCH_KERNELS( memcmp_prefixed, BKK_MEMCMP, 1 )
+BITABLE_SEARCH_KERNELS( int32_le, BKK_INT32_LE, 0 )
+BITABLE_SEARCH_KERNELS( uint32_le, BKK_UINT32_LE, 0 )
+BITABLE_SEARCH_KERNELS( int64_le, BKK_INT64_LE, 0 )
+BITABLE_SEARCH_KERNELS( uint64_le, BKK_UINT64_LE, 0 )
+BITABLE_SEARCH_KERNELS( uint32_be, BKK_UINT32_BE, 0 )
+BITABLE_SEARCH_KERNELS( uint64_be, BKK_UINT64_BE, 0 )
+BITABLE_SEARCH_KERNELS( float64, BKK_FLOAT64, 0 )
+
+/** Get the ordered value of a key in a branch node.
+  */
+BITABLE_FORCE_INLINE uint64_t branch_ordered( const BitableReadable* table, const uint8_t* node, int index, BitableKeyKind keyKind )
+{
+    const BitableBranchIndice* indice = (const BitableBranchIndice*)( node + table->branchHeaderSize + index * table->branchIndiceSize );
+
+    return bitable_key_ordered( keyKind, node + indice->itemOffset );
+}
+
+/** Get the ordered value of a key in a leaf page.
+  */
+BITABLE_FORCE_INLINE uint64_t leaf_ordered( const BitableReadable* table, const uint8_t* node, int index, BitableKeyKind keyKind )
+{
+    return bitable_key_ordered( keyKind, node + leaf_indice( table, node, index )->itemOffset );
+}
+
+/** Estimate the position of a value between two keys, assuming the keys between are evenly spread.
+  * @param low The index of the low key.
+  * @param high The index of the high key.
+  * @param lowValue The ordered value of the low key, less than the value.
+  * @param highValue The ordered value of the high key, greater than the value.
+  * @param value The value to find the position of.
+  * @return The estimated position, strictly between low and high.
+  */
+BITABLE_FORCE_INLINE int interpolate( int low, int high, uint64_t lowValue, uint64_t highValue, uint64_t value )
+{
+    double fraction = (double)( value - lowValue ) / (double)( highValue - lowValue );
+    int    position = low + (int)( fraction * ( high - low ) );
+
+    return position <= low ? low + 1 : ( position >= high ? high - 1 : position );
+}
+
+/** Interpolation version of the branch search function, instantiated for each integer key kind.
+  * Finds the same key as branch_search_generic.
+  */
+BITABLE_FORCE_INLINE int branch_interpolate_generic( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, BitableKeyKind keyKind )
+{
+    int      childCount = *(const uint16_t*)( node + sizeof( uint64_t ) );
+    int      high       = childCount - 2;
+    uint64_t lowValue;
+    uint64_t highValue;
+    int      probe;
+
+    if ( high < low || ( lowValue = branch_ordered( table, node, low, keyKind ) ) > searchKey->value )
+    {
+        return low - 1;
+    }
+
+    if ( ( highValue = branch_ordered( table, node, high, keyKind ) ) <= searchKey->value )
+    {
+        return high;
+    }
+
+    // the key at low is always less or equal to the search key and the key at high is always greater.
+    for ( probe = 0; probe < BITABLE_INTERPOLATION_PROBES && high - low > BITABLE_INTERPOLATION_MIN_RANGE; ++probe )
+    {
+        int      mid      = interpolate( low, high, lowValue, highValue, searchKey->value );
+        uint64_t midValue = branch_ordered( table, node, mid, keyKind );
+
+        if ( midValue <= searchKey->value )
+        {
+            low      = mid;
+            lowValue = midValue;
+        }
+        else
+        {
+            high      = mid;
+            highValue = midValue;
+        }
+    }
+
+    while ( high - low > 1 )
+    {
+        int mid = low + ( ( high - low ) / 2 );
+
+        if ( branch_ordered( table, node, mid, keyKind ) <= searchKey->value )
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/** Interpolation version of the leaf search function, instantiated for each integer key kind.
+  * Finds the same item as leaf_search_generic.
+  */
+BITABLE_FORCE_INLINE int leaf_interpolate_generic( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, int* bestComparison, BitableKeyKind keyKind )
+{
+    int      high = leaf_item_count( node ) - 1;
+    uint64_t lowValue;
+    uint64_t highValue;
+    int      probe;
+
+    if ( high < low || ( highValue = leaf_ordered( table, node, high, keyKind ) ) < searchKey->value )
+    {
+        *bestComparison = 1;
+        return -1;
+    }
+
+    if ( ( lowValue = leaf_ordered( table, node, low, keyKind ) ) >= searchKey->value )
+    {
+        *bestComparison = lowValue == searchKey->value ? 0 : 1;
+        return low;
+    }
+
+    // the key at low is always less than the search key and the key at high is always greater or equal.
+    for ( probe = 0; probe < BITABLE_INTERPOLATION_PROBES && high - low > BITABLE_INTERPOLATION_MIN_RANGE; ++probe )
+    {
+        int      mid      = interpolate( low, high, lowValue, highValue, searchKey->value );
+        uint64_t midValue = leaf_ordered( table, node, mid, keyKind );
+
+        if ( midValue < searchKey->value )
+        {
+            low      = mid;
+            lowValue = midValue;
+        }
+        else
+        {
+            high      = mid;
+            highValue = midValue;
+        }
+    }
+
+    while ( high - low > 1 )
+    {
+        int      mid      = low + ( ( high - low ) / 2 );
+        uint64_t midValue = leaf_ordered( table, node, mid, keyKind );
+
+        if ( midValue < searchKey->value )
+        {
+            low = mid;
+        }
+        else
+        {
+            high      = mid;
+            highValue = midValue;
+        }
+    }
+
+    *bestComparison = highValue == searchKey->value ? 0 : 1;
+
+    return high;
+}
+
+/* Instantiate the interpolation search functions for an integer key kind. */
+#define BITABLE_INTERPOLATION_KERNELS( name, keyKind ) \
+    static int branch_interpolate_##name( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey ) \
+    { \
+        return branch_interpolate_generic( table, node, low, searchKey, keyKind ); \
+    } \
+    static int leaf_interpolate_##name( const BitableReadable* table, const uint8_t* node, int low, const SearchKey* searchKey, int* bestComparison ) \
+    { \
+        return leaf_interpolate_generic( table, node, low, searchKey, bestComparison, keyKind ); \
+    } \
+    static const SearchKernels name##_interpolation_kernels = { branch_interpolate_##name, leaf_interpolate_##name, branch_compare_##name };
+
+BITABLE_INTERPOLATION_KERNELS( int32_le, BKK_INT32_LE )
+BITABLE_INTERPOLATION_KERNELS( uint32_le, BKK_UINT32_LE )
+BITABLE_INTERPOLATION_KERNELS( int64_le, BKK_INT64_LE )
+BITABLE_INTERPOLATION_KERNELS( uint64_le, BKK_UINT64_LE )
+BITABLE_INTERPOLATION_KERNELS( uint32_be, BKK_UINT32_BE )
+BITABLE_INTERPOLATION_KERNELS( uint64_be, BKK_UINT64_BE )
+
+/** Select the search functions for a key kind.
+  * Fixed width key kinds compare the whole key as an integer, so they don't use key prefixes even if the table has them.
+  * @param keyKind The kind of keys in the table.
+  * @param formatFlags The format flags of the table (for key prefixes and interpolation).
+  * @return The search functions to use.
+  */
+static const SearchKernels* select_kernels( BitableKeyKind keyKind, uint32_t formatFlags )
+{
+    int usePrefixes = ( formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0;
+
+    if ( ( formatFlags & BITABLE_FORMAT_INTERPOLATION ) != 0 )
+    {
+        switch ( keyKind )
+        {
+        case BKK_INT32_LE:  return &int32_le_interpolation_kernels;
+        case BKK_UINT32_LE: return &uint32_le_interpolation_kernels;
+        case BKK_INT64_LE:  return &int64_le_interpolation_kernels;
+        case BKK_UINT64_LE: return &uint64_le_interpolation_kernels;
+        case BKK_UINT32_BE: return &uint32_be_interpolation_kernels;
+        case BKK_UINT64_BE: return &uint64_be_interpolation_kernels;
+        default:            break;
+        }
+    }
+
+    switch ( keyKind )
+    {
+    case BKK_CUSTOM:    return usePrefixes ? &custom_prefixed_kernels : &custom_kernels;
+    case BKK_MEMCMP:    return usePrefixes ? &memcmp_prefixed_kernels : &memcmp_kernels;
+    case BKK_INT32_LE:  return &int32_le_kernels;
+    case BKK_UINT32_LE: return &uint32_le_kernels;
+    case BKK_INT64_LE:  return &int64_le_kernels;
+    case BKK_UINT64_LE: return &uint64_le_kernels;
+    case BKK_UINT32_BE: return &uint32_be_kernels;
+    case BKK_UINT64_BE: return &uint64_be_kernels;
+    case BKK_FLOAT64:   return &float64_kernels;
+    default:            return NULL;
+    }
+}
+
+/** Prepare a search key, calculating the key prefix or ordered value used for comparisons.
+  * @param table The table that will be searched.
+  * @param key The key to search for.
+  * @param [out] searchKey The prepared search key.
+  * @return BR_SUCCESS if the key can be searched for, BR_KEY_INVALID if the key is the wrong size for the table's key kind.
+  */
+static BitableResult prepare_search_key( const BitableReadable* table, const BitableValue* key, SearchKey* searchKey )
+{
+    searchKey->key   = key;
+    searchKey->value = 0;
+
+    if ( table->keyKind == BKK_CUSTOM || table->keyKind == BKK_MEMCMP )
+    {
+        if ( ( table->header->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+        {
+            searchKey->value = bitable_key_prefix( key );
+        }
+    }
+    else
+    {
+        if ( key->size != bitable_key_kind_size( table->keyKind ) )
+        {
+            return BR_KEY_INVALID;
+        }
+
+        searchKey->value = bitable_key_ordered( table->keyKind, key->data );
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Get the child page for a key index found in a branch node by a branch search.
+  * @param node The branch node.
+  * @param best The index returned by the branch search.
+  * @return The child page (in the next level down).
+  */
+static uint64_t branch_child( const uint8_t* node, int best )
+{
+    return *(const uint64_t*)node + best + 1;
+}
+
+/** Collect the keys of the cached branch levels in sorted order, with an in order walk of the tree.
+  * @param table The table the branch cache is being built for.
+  * @param level The branch level of the node to walk.
+  * @param page The page of the node within the branch level.
+  * @param bottom The lowest branch level being cached.
+  * @param [out] sorted The key heads in sorted order.
+  * @param [out] position The number of key heads collected so far.
+  */
+static void collect_branch_keys( BitableReadable* table, int level, uint64_t page, int bottom, uint64_t* sorted, uint64_t* position )
+{
+    BranchCache*   cache      = &table->branchCache;
+    const uint8_t* node       = branch_page( table, level, page );
+    uint64_t       baseChild  = *(const uint64_t*)node;
+    int            childCount = *(const uint16_t*)( node + sizeof( uint64_t ) );
+    int            child;
+
+    for ( child = 0; child < childCount; ++child )
+    {
+        // the key for the first child is held by a parent (or there isn't one for the first page in the level).
+        if ( child > 0 )
+        {
+            const BitableBranchIndice* indice = (const BitableBranchIndice*)( node + table->branchHeaderSize + ( child - 1 ) * table->branchIndiceSize );
+            BitableValue               key;
+
+            key.data = node + indice->itemOffset;
+            key.size = indice->keySize;
+
+            sorted[ *position ] = cache->exact ? bitable_key_ordered( table->keyKind, key.data ) : bitable_key_prefix( &key );
+
+            if ( cache->keys != NULL )
+            {
+                cache->keys[ *position ].data = key.data;
+                cache->keys[ *position ].size = indice->keySize;
+            }
+
+            ++*position;
+        }
+
+        if ( level > bottom )
+        {
+            collect_branch_keys( table, level - 1, baseChild + child, bottom, sorted, position );
+        }
+    }
+}
+
+/** Fill the Eytzinger ordered heads of the branch cache with an in order walk of the implicit tree.
+  * @param cache The branch cache to fill.
+  * @param sorted The key heads in sorted order.
+  * @param position The sorted position of the next key head to place.
+  * @param slot The slot in the Eytzinger array to walk from.
+  * @return The sorted position of the next key head to place after the walk.
+  */
+static uint64_t fill_eytzinger( BranchCache* cache, const uint64_t* sorted, uint64_t position, uint64_t slot )
+{
+    if ( slot <= cache->count )
+    {
+        position = fill_eytzinger( cache, sorted, position, slot * 2 );
+
+        cache->heads[ slot ] = sorted[ position ];
+        cache->ranks[ slot ] = (uint32_t)position;
+
+        position = fill_eytzinger( cache, sorted, position + 1, slot * 2 + 1 );
+    }
+
+    return position;
+}
+
+/** Build the in memory cache of the top branch levels, if the key kind supports it and at least one level fits in the budget.
+  * If a cache can't be built, searches just use the memory mapped branch levels.
+  * @param table The table to build the cache for (with the branch files open).
+  * @param options The read options with the number of levels to cache and the budget.
+  */
+static void build_branch_cache( BitableReadable* table, const BitableReadOptions* options )
+{
+    BranchCache* cache  = &table->branchCache;
+    int          depth  = (int)table->header->depth;
+    int          levels = options->cachedBranchLevels < table->header->depth ? (int)options->cachedBranchLevels : depth;
+    int          exact  = table->keyKind != BKK_CUSTOM && table->keyKind != BKK_MEMCMP;
+    uint64_t     bytesPerKey = sizeof( uint64_t ) + sizeof( uint32_t ) + ( exact ? 0 : sizeof( CachedKeyRef ) );
+    uint64_t     count       = 0;
+    uint64_t     position    = 0;
+    uint64_t*    sorted;
+
+    // custom keys can only be cached if they have prefixes to use as heads.
+    if ( table->keyKind == BKK_CUSTOM && ( table->header->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) == 0 )
+    {
+        return;
+    }
+
+    // drop levels from the bottom until the cache fits in the budget.
+    for ( ; levels > 0; --levels )
+    {
+        int below = depth - levels - 1;
+
+        count = ( below < 0 ? table->header->leafPages : table->branchViews[ below ].size / table->header->pageSize ) - 1;
+
+        if ( count < UINT32_MAX && count * bytesPerKey + BITABLE_CACHE_LINE_SIZE <= options->branchCacheBudget )
+        {
+            break;
+        }
+    }
+
+    if ( levels == 0 || count == 0 )
+    {
+        return;
+    }
+
+    cache->count           = count;
+    cache->exact           = exact;
+    cache->headsAllocation = malloc( (size_t)( ( count + 1 ) * sizeof( uint64_t ) + BITABLE_CACHE_LINE_SIZE ) );
+    cache->heads           = (uint64_t*)( ( (uintptr_t)cache->headsAllocation + ( BITABLE_CACHE_LINE_SIZE - 1 ) ) & ~(uintptr_t)( BITABLE_CACHE_LINE_SIZE - 1 ) );
+    cache->ranks           = malloc( (size_t)( ( count + 1 ) * sizeof( uint32_t ) ) );
+    cache->keys            = exact ? NULL : malloc( (size_t)( count * sizeof( CachedKeyRef ) ) );
+    sorted                 = malloc( (size_t)( count * sizeof( uint64_t ) ) );
+
+    // the cache is optional, so if it can't be allocated searches go without it.
+    if ( cache->headsAllocation == NULL || cache->ranks == NULL || ( !exact && cache->keys == NULL ) || sorted == NULL )
+    {
+        free( cache->headsAllocation );
+        free( cache->ranks );
+        free( cache->keys );
+        free( sorted );
+
+        memset( cache, 0, sizeof( BranchCache ) );
+
+        return;
+    }
+
+    collect_branch_keys( table, depth - 1, 0, depth - levels, sorted, &position );
+
+    assert( position == count );
+
+    fill_eytzinger( cache, sorted, 0, 1 );
+
+    free( sorted );
+
+    cache->levels = levels;
+}
+
+/** Branch-free search of the Eytzinger ordered heads for the first head greater than (or greater or equal to) a value.
+  * @param cache The branch cache to search.
+  * @param head The head value to search for.
+  * @param orEqual Non-zero to find the first head greater than the value, zero to find the first head greater or equal.
+  * @return The Eytzinger slot of the head found, 0 if there isn't one.
+  */
+BITABLE_FORCE_INLINE uint64_t branch_cache_slot( const BranchCache* cache, uint64_t head, int orEqual )
+{
+    const uint64_t* heads = cache->heads;
+    uint64_t        slot  = 1;
+
+    while ( slot <= cache->count )
+    {
+        // the descendants 3 levels down are in the same cache line.
+        BITABLE_PREFETCH( heads + slot * 8 );
+
+        slot = slot * 2 + ( orEqual ? heads[ slot ] <= head : heads[ slot ] < head );
+    }
+
+    // strip the right turns taken since the last left turn, leaving the slot where we last went left.
+    return slot >> ( bitable_trailing_ones( slot ) + 1 );
+}
+
+/** Get the number of cached keys before a slot returned by branch_cache_slot.
+  */
+BITABLE_FORCE_INLINE uint64_t branch_cache_rank( const BranchCache* cache, uint64_t slot )
+{
+    return slot == 0 ? cache->count : cache->ranks[ slot ];
+}
+
+/** Search the branch cache for the page in the level below the cached levels that the search key falls in.
+  * @param table The table to search.
+  * @param searchKey The key to search for.
+  * @return The page in the level below the cached branch levels (the leaf level if all levels are cached).
+  */
+static uint64_t branch_cache_search( const BitableReadable* table, const SearchKey* searchKey )
+{
+    const BranchCache* cache = &table->branchCache;
+    uint64_t           head;
+    uint64_t           slot;
+    uint64_t           low;
+    uint64_t           high;
+
+    if ( cache->exact )
+    {
+        return branch_cache_rank( cache, branch_cache_slot( cache, searchKey->value, 1 ) );
+    }
+
+    head = bitable_key_prefix( searchKey->key );
+    slot = branch_cache_slot( cache, head, 0 );
+    low  = branch_cache_rank( cache, slot );
+    high = low;
+
+    // keys with the same head as the search key are contiguous in sorted order, resolve them by comparing the full key.
+    if ( slot != 0 && cache->heads[ slot ] == head )
+    {
+        high = branch_cache_rank( cache, branch_cache_slot( cache, head, 1 ) );
+
+        while ( low < high )
+        {
+            uint64_t mid = low + ( ( high - low ) / 2 );
+
+            if ( compare_key( table, table->keyKind, 0, cache->keys[ mid ].data, (uint16_t)cache->keys[ mid ].size, 0, searchKey ) <= 0 )
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+    }
+
+    return low;
+}
+
+/** Find the page to start the branch search from, using the branch cache if there is one.
+  * @param table The table to search.
+  * @param searchKey The key to search for.
+  * @param [out] level The branch level to continue the search from (-1 if the page is a leaf page).
+  * @return The page in level to continue the search from.
+  */
+static uint64_t search_start( const BitableReadable* table, const SearchKey* searchKey, int* level )
+{
+    *level = ( (int)table->header->depth ) - 1;
+
+    if ( table->branchCache.levels == 0 )
+    {
+        return 0;
+    }
+
+    *level -= table->branchCache.levels;
+
+    return branch_cache_search( table, searchKey );
+}
+
+/** Lower bound search of a leaf page for the search key, then apply the find operation to position the cursor.
+  * @param [out] cursor The cursor to populate, should have the page already set.
+  * @param table The table the leaf page belongs to.
+  * @param low The lowest item in the page to consider (items before it are known to be less than the search key).
+  * @param searchKey The key to search for.
+  * @param operation The find operation.
+  * @param [out] lowerBound The first item in the page greater or equal to the search key (the item count if there isn't one).
+  * @return The result of the find operation.
+  */
+static BitableResult leaf_find( BitableCursor* cursor, const BitableReadable* table, int low, const SearchKey* searchKey, BitableFindOperation operation, int* lowerBound )
+{
+    const uint8_t* node      = leaf_page( table, cursor->page );
+    int            itemCount = leaf_item_count( node );
+    int            bestComparison;
+    int            best      = table->kernels->leafSearch( table, node, low, searchKey, &bestComparison );
+    BitableResult  result    = BR_SUCCESS;
+
+    *lowerBound = best >= 0 ? best : itemCount;
+
+    if ( best >= 0 )
+    {
+        cursor->item = best;
+
+        if ( bestComparison != 0 )
+        {
+            switch ( operation )
+            {
+            case BFO_UPPER:
+
+                result = bitable_previous( cursor, table );
+                break;
+
+            case BFO_EXACT:
+
+                result = ( bestComparison == 0 ) ? BR_SUCCESS : BR_KEY_NOT_FOUND;
+                break;
+
+            default:
+
+                break;
+            }
+        }
+    }
+    else
+    {
+        cursor->item = itemCount - 1;
+
+        switch ( operation )
+        {
+        case BFO_LOWER:
+
+            result = bitable_next( cursor, table );
+            break;
+
+        case BFO_EXACT:
+
+            result = BR_KEY_NOT_FOUND;
+            break;
+
+        default:
+
+            break;
+        }
+    }
+
+    return result;
+}
+
+/** Check the bloom filter to see if an exact find for a key can be rejected without searching. 
+  * @param table The table to check.
+  * @param key The key to check for.
+  * @param operation The find operation.
+  * @return Non-zero if the table has a bloom filter, the operation is BFO_EXACT and the key definitely isn't in the table.
+  */
+static int bloom_rejects( const BitableReadable* table, const BitableValue* key, BitableFindOperation operation )
+{
+    if ( operation != BFO_EXACT || table->bloomBlocks == NULL )
+    {
+        return 0;
+    }
+
+    return !bitable_bloom_may_contain( table->bloomBlocks, table->header->bloomBlockCount, table->header->bloomHashCount, bitable_key_hash( key ) );
+}
+
+BitableResult bitable_find( BitableCursor* cursor, const BitableReadable* table, const BitableValue* searchKey, BitableFindOperation operation )
+{
+    BranchSearchFunction* branchSearch = table->kernels->branchSearch;
+    uint64_t              childPage    = 0;
+    SearchKey             preparedKey;
+    BitableResult         result;
+    int                   lowerBound;
+    int                   level;
+
+    result = prepare_search_key( table, searchKey, &preparedKey );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    if ( bloom_rejects( table, searchKey, operation ) )
+    {
+        return BR_KEY_NOT_FOUND;
+    }
+
+    childPage = search_start( table, &preparedKey, &level );
+
+    // iterate through the branch levels
+    for ( ; level >= 0; --level )
+    {
+        const uint8_t* node = branch_page( table, level, childPage );
+
+        childPage = branch_child( node, branchSearch( table, node, 0, &preparedKey ) );
+    }
+
+    cursor->page = childPage;
+
+    // as opposed to the exact or upper bound search above, we do a lower bound search in the leaf
+    return leaf_find( cursor, table, 0, &preparedKey, operation, &lowerBound );
+}
+
+BitableResult bitable_find_batch( BitableCursor* cursors, const BitableReadable* table, const BitableValue* searchKeys, BitableResult* results, size_t count, BitableFindOperation operation )
+{
+    BranchSearchFunction* branchSearch = table->kernels->branchSearch;
+    BitableResult         batchResult  = BR_SUCCESS;
+    size_t                groupStart;
+
+    // Lookups are done in groups that step through each level in lockstep. 
+    // The nodes for the whole group are prefetched before any of them are searched, 
+    // so the cache/TLB misses for the group overlap rather than happening one after the other.
+    for ( groupStart = 0; groupStart < count; groupStart += BITABLE_FIND_BATCH_GROUP )
+    {
+        uint64_t  childPages[ BITABLE_FIND_BATCH_GROUP ];
+        uint64_t  hashes[ BITABLE_FIND_BATCH_GROUP ];
+        SearchKey preparedKeys[ BITABLE_FIND_BATCH_GROUP ];
+        int       valid[ BITABLE_FIND_BATCH_GROUP ];
+        size_t    groupSize = ( count - groupStart ) < BITABLE_FIND_BATCH_GROUP ? ( count - groupStart ) : BITABLE_FIND_BATCH_GROUP;
+        size_t    where;
+        int       level      = ( (int)table->header->depth ) - 1;
+        int       startLevel = level;
+
+        for ( where = 0; where < groupSize; ++where )
+        {
+            childPages[ where ] = 0;
+            results[ groupStart + where ] = prepare_search_key( table, searchKeys + groupStart + where, preparedKeys + where );
+            valid[ where ] = results[ groupStart + where ] == BR_SUCCESS;
+        }
+
+        // exact finds check the bloom filter first, with the blocks for the group prefetched together like the nodes below.
+        if ( operation == BFO_EXACT && table->bloomBlocks != NULL )
+        {
+            for ( where = 0; where < groupSize; ++where )
+            {
+                hashes[ where ] = bitable_key_hash( searchKeys + groupStart + where );
+
+                BITABLE_PREFETCH( bitable_bloom_block( table->bloomBlocks, table->header->bloomBlockCount, hashes[ where ] ) );
+            }
+
+            for ( where = 0; where < groupSize; ++where )
+            {
+                if ( valid[ where ] && !bitable_bloom_may_contain( table->bloomBlocks, table->header->bloomBlockCount, table->header->bloomHashCount, hashes[ where ] ) )
+                {
+                    results[ groupStart + where ] = BR_KEY_NOT_FOUND;
+                    valid[ where ]                = 0;
+                }
+            }
+        }
+
+        // the branch cache is small and hot, so the cached levels are searched for each key up front.
+        for ( where = 0; where < groupSize; ++where )
+        {
+            if ( valid[ where ] )
+            {
+                childPages[ where ] = search_start( table, preparedKeys + where, &startLevel );
+            }
+        }
 
-    return BR_SUCCESS;
-}
+        for ( level = startLevel; level >= 0; --level )
+        {
+            for ( where = 0; where < groupSize; ++where )
+            {
+                if ( valid[ where ] )
+                {
+                    BITABLE_PREFETCH( branch_page( table, level, childPages[ where ] ) );
+                }
+            }
 
-BitableResult bitable_find( BitableCursor* cursor, const BitableReadable* table, const BitableValue* searchKey, BitableFindOperation operation )
-{
-    BitableComparisonFunction* comparison = table->comparison;
-    uint64_t                   childPage  = 0;
-    int level;
+            for ( where = 0; where < groupSize; ++where )
+            {
+                if ( valid[ where ] )
+                {
+                    const uint8_t* node = branch_page( table, level, childPages[ where ] );
 
-    // iterate through the branch levels
-    for ( level = ( (int)table->header->depth ) - 1; level >= 0; --level )
-    {
-        const void*                node             = (const uint8_t*)table->branchFiles[ level ].address + ( table->header->pageSize * childPage );
-        uint64_t                   baseChild        = *(const uint64_t*)node;
-        int                        childCount       = *(const uint16_t*)( (const uint8_t*)node + sizeof( uint64_t ) );
-        const BitableBranchIndice* nodeIndex        = (const BitableBranchIndice*)( (const uint8_t*)node + sizeof( uint64_t ) + sizeof( uint16_t ) );
-        int                        low              = 0;
-        int                        high             = childCount - 2;
-        int                        best             = -1;
-        int                        comparisonResult = -1;
+                    childPages[ where ] = branch_child( node, branchSearch( table, node, 0, preparedKeys + where ) );
+                }
+            }
+        }
 
-        // Upper bound search with termination on equals -
-        // will find the item equal to first below the key.
-        // If no best item is found, then the child for the first node (which doesn't have a key in the array) is taken.
-        while ( low <= high && comparisonResult != 0 )
+        for ( where = 0; where < groupSize; ++where )
         {
-            int                        mid     = low + ( ( high - low ) / 2 );
-            const BitableBranchIndice* indice  = nodeIndex + mid;
-            BitableValue               readKey;
-
-            readKey.data = (const uint8_t*)node + indice->itemOffset;
-            readKey.size = indice->keySize;
+            if ( valid[ where ] )
+            {
+                BITABLE_PREFETCH( leaf_page( table, childPages[ where ] ) );
+            }
+        }
 
-            comparisonResult = comparison( &readKey, searchKey );
+        for ( where = 0; where < groupSize; ++where )
+        {
+            BitableCursor* cursor = cursors + groupStart + where;
+            int            lowerBound;
 
-            if ( comparisonResult <= 0 )
+            if ( valid[ where ] )
             {
-                best = mid;
-                low  = mid + 1;
+                cursor->page = childPages[ where ];
+
+                results[ groupStart + where ] = leaf_find( cursor, table, 0, preparedKeys + where, operation, &lowerBound );
             }
-            else
+
+            if ( results[ groupStart + where ] != BR_SUCCESS && batchResult == BR_SUCCESS )
             {
-                high = mid - 1;
+                batchResult = results[ groupStart + where ];
             }
         }
-
-        childPage = best >= 0 ? ( baseChild + best + 1 ) : baseChild;
     }
 
-    BitableResult result = BR_SUCCESS;
-
-    cursor->page = childPage;
+    return batchResult;
+}
 
-    // as opposed to the exact or upper bound search above, we do a lower bound search below
+BitableResult bitable_find_sorted( BitableCursor* cursors, const BitableReadable* table, const BitableValue* searchKeys, BitableResult* results, size_t count, BitableFindOperation operation )
+{
+    const uint8_t*         nodes[ BITABLE_MAX_BRANCH_LEVELS ]; // the current node at each branch level
+    int                    bests[ BITABLE_MAX_BRANCH_LEVELS ]; // the key index taken in the current node at each branch level
+    BranchSearchFunction*  branchSearch  = table->kernels->branchSearch;
+    BranchCompareFunction* branchCompare = table->kernels->branchCompare;
+    BitableResult          batchResult   = BR_SUCCESS;
+    int                    depth         = (int)table->header->depth;
+    int                    started       = 0;
+    uint64_t               leafPage      = 0;
+    int                    leafLow       = 0;
+    size_t                 where;
+
+    for ( where = 0; where < count; ++where )
     {
-        const void*              node           = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( childPage + 1 ) );
-        int                      itemCount      = *(const int32_t*)((const uint8_t*)node + sizeof( uint64_t ) );
-        const BitableLeafIndice* leafIndex      = (const BitableLeafIndice*)( (const uint8_t*)node + sizeof( uint64_t ) + sizeof( int32_t ) );
-        int                      low            = 0;
-        int                      high           = itemCount - 1;
-        int                      best           = -1;
-        int                      bestComparison = 1;
-
-        while ( high >= low && bestComparison != 0 )
-        {
-            BitableValue readKey;
-            int mid = low + ( ( high - low ) / 2 );
-            int comparisonResult;
+        BitableCursor* cursor = cursors + where;
+        SearchKey      searchKey;
+        BitableResult  result;
+        int            level  = 0;
 
-            readKey.data = (const uint8_t*)node + ( leafIndex[ mid ].itemOffset );
-            readKey.size = leafIndex[ mid ].keySize;
+        result = prepare_search_key( table, searchKeys + where, &searchKey );
 
-            comparisonResult = comparison( &readKey, searchKey );
+        if ( result != BR_SUCCESS )
+        {
+            results[ where ] = result;
 
-            if ( comparisonResult >= 0 )
+            if ( batchResult == BR_SUCCESS )
             {
-                bestComparison = comparisonResult;
-                best           = mid;
-                high           = mid - 1;
+                batchResult = result;
             }
-            else
+
+            continue;
+        }
+
+        // a rejected key leaves the path alone, the next key is still greater or equal to the key it was found with.
+        if ( bloom_rejects( table, searchKeys + where, operation ) )
+        {
+            results[ where ] = BR_KEY_NOT_FOUND;
+
+            if ( batchResult == BR_SUCCESS )
             {
-                low = mid + 1;
+                batchResult = BR_KEY_NOT_FOUND;
             }
+
+            continue;
         }
 
-        if ( best >= 0 )
+        if ( started )
         {
-            cursor->item = best;
-
-            if ( bestComparison != 0 )
+            // Climb from the bottom branch level until we find a level where the search key is still covered by the child taken, 
+            // i.e. the key is below the next key in that node. If the child taken was the last in its node, the upper bound is the parent's.
+            while ( level < depth )
             {
-                switch ( operation )
-                {
-                case BFO_UPPER:
+                int childCount = *(const uint16_t*)( nodes[ level ] + sizeof( uint64_t ) );
 
-                    result = bitable_previous( cursor, table );
+                if ( bests[ level ] + 1 <= childCount - 2 && branchCompare( table, nodes[ level ], bests[ level ] + 1, &searchKey ) > 0 )
+                {
                     break;
+                }
 
-                case BFO_EXACT:
+                ++level;
+            }
 
-                    result = ( bestComparison == 0 ) ? BR_SUCCESS : BR_KEY_NOT_FOUND;
-                    break;
+            // The node at the level below the covering level (or the root) is still correct, 
+            // but the key taken within it may move forward, so search it again from where we were.
+            if ( level > 0 )
+            {
+                --level;
 
-                default:
+                bests[ level ] = branchSearch( table, nodes[ level ], bests[ level ] > 0 ? bests[ level ] : 0, &searchKey );
 
-                    break;
+                if ( level == 0 )
+                {
+                    uint64_t childPage = branch_child( nodes[ level ], bests[ level ] );
+
+                    leafLow  = childPage == leafPage ? leafLow : 0;
+                    leafPage = childPage;
+                }
+                else
+                {
+                    nodes[ level - 1 ] = branch_page( table, level - 1, branch_child( nodes[ level ], bests[ level ] ) );
                 }
             }
         }
         else
         {
-            cursor->item = itemCount - 1;
+            level   = depth;
+            started = 1;
 
-            switch ( operation )
+            if ( level > 0 )
             {
-            case BFO_LOWER:
-
-                result = bitable_next( cursor, table );
-                break;
+                nodes[ level - 1 ] = branch_page( table, level - 1, 0 );
+            }
+        }
 
-            case BFO_EXACT:
+        // Any levels below are new nodes, so do a full search of them.
+        while ( level > 0 )
+        {
+            --level;
 
-                result = BR_KEY_NOT_FOUND;
-                break;
+            bests[ level ] = branchSearch( table, nodes[ level ], 0, &searchKey );
 
-            default:
+            if ( level > 0 )
+            {
+                nodes[ level - 1 ] = branch_page( table, level - 1, branch_child( nodes[ level ], bests[ level ] ) );
+            }
+            else
+            {
+                uint64_t childPage = branch_child( nodes[ level ], bests[ level ] );
 
-                break;
+                leafLow  = childPage == leafPage ? leafLow : 0;
+                leafPage = childPage;
             }
         }
+
+        // all the keys that land in the same leaf page are resolved before moving on, 
+        // and the search can start from the lower bound of the previous key.
+        cursor->page = leafPage;
+
+        result = leaf_find( cursor, table, leafLow, &searchKey, operation, &leafLow );
+
+        results[ where ] = result;
+
+        if ( result != BR_SUCCESS && batchResult == BR_SUCCESS )
+        {
+            batchResult = result;
+        }
     }
 
-    return result;
+    return batchResult;
 }
 
 BitableResult bitable_next( BitableCursor* cursor, const BitableReadable* table )
@@ -332,9 +1621,8 @@ BitableResult bitable_next( BitableCursor* cursor, const BitableReadable* table
     }
 
     {
-        const void* page      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        int32_t     itemCount = *(const int32_t*)( (const uint8_t*)page + +sizeof( uint64_t ) );
-        int32_t     nextItem  = cursor->item + 1;
+        int32_t itemCount = leaf_item_count( leaf_page( table, cursor->page ) );
+        int32_t nextItem  = cursor->item + 1;
 
         if ( nextItem < itemCount )
         {
@@ -362,9 +1650,8 @@ BitableResult bitable_previous( BitableCursor* cursor, const BitableReadable* ta
     }
 
     {
-        const void* page          = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        int32_t     itemCount     = *(const int32_t*)( (const uint8_t*)page + +sizeof( uint64_t ) );
-        int32_t     previousItem  = cursor->item - 1;
+        int32_t itemCount     = leaf_item_count( leaf_page( table, cursor->page ) );
+        int32_t previousItem  = cursor->item - 1;
 
         if ( previousItem < itemCount && previousItem >= 0 )
         {
@@ -374,12 +1661,7 @@ BitableResult bitable_previous( BitableCursor* cursor, const BitableReadable* ta
         {
             --cursor->page;
 
-            {
-                const void* previousPage      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-                int32_t     previousItemCount = *(const int32_t*)( (const uint8_t*)previousPage + sizeof( uint64_t ) );
-
-                cursor->item = previousItemCount - 1;
-            }
+            cursor->item = leaf_item_count( leaf_page( table, cursor->page ) ) - 1;
         }
         else
         {
@@ -390,6 +1672,37 @@ BitableResult bitable_previous( BitableCursor* cursor, const BitableReadable* ta
     return BR_SUCCESS;
 }
 
+/** Read the value for an item in a leaf page, either from the page itself or the large value store.
+  * @param table The table to read the value from.
+  * @param page The leaf page the item is in.
+  * @param itemIndice The indice of the item in the leaf page.
+  * @param [out] value The value read out.
+  */
+static void read_value( const BitableReadable* table, const uint8_t* page, const BitableLeafIndice* itemIndice, BitableValue* value )
+{
+    const uint32_t dataFromRight = table->header->pageSize - itemIndice->itemOffset;
+
+    value->size = itemIndice->dataSize;
+
+    if ( value->size <= BITABLE_MAX_KEY_SIZE )
+    {
+        const uint32_t paddedOffset = table->header->pageSize - ( ( dataFromRight + itemIndice->dataSize + ( table->header->valueAlignment - 1 ) ) & ~( table->header->valueAlignment - 1 ) );
+        const void*    dataAddress  = page + paddedOffset;
+
+        value->data = value->size > 0 ? dataAddress : NULL;
+    }
+    else
+    {
+        const uint32_t paddedOffset     = table->header->pageSize - ( ( dataFromRight + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 ) );
+        const void*    dataAddress      = page + paddedOffset;
+        size_t         largeValueOffset = (size_t)*(const uint64_t*)dataAddress;
+
+        value->data = table->largeValueView.address + largeValueOffset;
+
+        assert( table->largeValueView.size >= largeValueOffset + value->size );
+    }
+}
+
 BitableResult bitable_key( const BitableCursor* cursor, const BitableReadable* table, BitableValue* key )
 {
     if ( cursor->page >= table->header->leafPages || cursor->item < 0 )
@@ -398,9 +1711,8 @@ BitableResult bitable_key( const BitableCursor* cursor, const BitableReadable* t
     }
 
     {
-        const void*              page      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        int32_t                  itemCount = *(const int32_t*)( (const uint8_t*)page + sizeof( uint64_t ) );
-        const BitableLeafIndice* leafIndex = (const BitableLeafIndice*)( (const uint8_t*)page + sizeof( uint64_t ) + sizeof( int32_t ) );
+        const uint8_t* page      = leaf_page( table, cursor->page );
+        int32_t        itemCount = leaf_item_count( page );
 
         if ( cursor->item < 0 || cursor->item >= itemCount )
         {
@@ -408,10 +1720,10 @@ BitableResult bitable_key( const BitableCursor* cursor, const BitableReadable* t
         }
 
         {
-            const BitableLeafIndice* itemIndice = leafIndex + cursor->item;
+            const BitableLeafIndice* itemIndice = leaf_indice( table, page, cursor->item );
 
             key->size = itemIndice->keySize;
-            key->data = (const uint8_t*)page + itemIndice->itemOffset;
+            key->data = page + itemIndice->itemOffset;
         }
     }
 
@@ -427,9 +1739,30 @@ BitableResult bitable_value( const BitableCursor* cursor, const BitableReadable*
     }
 
     {
-        const void*              page      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        int32_t                  itemCount = *(const int32_t*)( (const uint8_t*)page + sizeof( uint64_t ) );
-        const BitableLeafIndice* leafIndex = (const BitableLeafIndice*)( (const uint8_t*)page + sizeof( uint64_t ) + sizeof( int32_t ) );
+        const uint8_t* page      = leaf_page( table, cursor->page );
+        int32_t        itemCount = leaf_item_count( page );
+
+        if ( cursor->item < 0 || cursor->item >= itemCount )
+        {
+            return BR_INVALID_CURSOR_LOCATION;
+        }
+
+        read_value( table, page, leaf_indice( table, page, cursor->item ), value );
+    }
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_key_value_pair( const BitableCursor* cursor, const BitableReadable* table, BitableValue* key, BitableValue* value )
+{
+    if ( cursor->page >= table->header->leafPages || cursor->item < 0 )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
+
+    {
+        const uint8_t* page      = leaf_page( table, cursor->page );
+        int32_t        itemCount = leaf_item_count( page );
 
         if ( cursor->item < 0 || cursor->item >= itemCount )
         {
@@ -437,35 +1770,124 @@ BitableResult bitable_value( const BitableCursor* cursor, const BitableReadable*
         }
 
         {
-            const BitableLeafIndice* itemIndice     = leafIndex + cursor->item;
-            const int32_t            dataFromRight  = table->header->pageSize - itemIndice->itemOffset;
+            const BitableLeafIndice* itemIndice = leaf_indice( table, page, cursor->item );
 
-            value->size = itemIndice->dataSize;
+            key->size = itemIndice->keySize;
+            key->data = page + itemIndice->itemOffset;
 
-            if ( value->size <= BITABLE_MAX_KEY_SIZE )
-            {
-                const uint32_t paddedOffset = table->header->pageSize - ( ( dataFromRight + itemIndice->dataSize + ( table->header->valueAlignment - 1 ) ) & ~( table->header->valueAlignment - 1 ) );
-                const void*    dataAddress  = (const uint8_t*)page + paddedOffset;
+            read_value( table, page, itemIndice, value );
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Read a batch of consecutive key value pairs from the cursor, stopping at an end position (exclusive).
+  * @param [in,out] cursor The cursor position to start reading from, moved to the position after the last pair read.
+  * @param table The table to read from.
+  * @param endPage The leaf page of the end position.
+  * @param endItem The item of the end position within the end page (may be past the last item in the page).
+  * @param [out] keys Array of at least maxCount keys to read out, or null.
+  * @param [out] values Array of at least maxCount values to read out, or null.
+  * @param maxCount The maximum number of pairs to read.
+  * @param [out] count The number of pairs read.
+  * @return BR_SUCCESS if there are more pairs before the end position, BR_END_OF_SEQUENCE if the end position was reached, BR_INVALID_CURSOR_LOCATION if the cursor isn't valid.
+  */
+static BitableResult next_batch( BitableCursor* cursor, const BitableReadable* table, uint64_t endPage, int32_t endItem, BitableValue* keys, BitableValue* values, uint32_t maxCount, uint32_t* count )
+{
+    uint64_t page = cursor->page;
+    int32_t  item = cursor->item;
+    uint32_t read = 0;
+
+    *count = 0;
+
+    if ( page >= table->header->leafPages || item < 0 )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
+
+    if ( page > endPage )
+    {
+        return BR_END_OF_SEQUENCE;
+    }
+
+    while ( read < maxCount )
+    {
+        const uint8_t* pageAddress = leaf_page( table, page );
+        int32_t        itemCount   = leaf_item_count( pageAddress );
+        int32_t        limit       = ( page == endPage && endItem < itemCount ) ? endItem : itemCount;
+        uint32_t       pageRead;
+        uint32_t       where;
+
+        if ( item > itemCount )
+        {
+            return BR_INVALID_CURSOR_LOCATION;
+        }
+
+        // read as much of the current page as we can in one go.
+        pageRead = item >= limit ? 0 : ( (uint32_t)( limit - item ) < maxCount - read ? (uint32_t)( limit - item ) : maxCount - read );
 
-                value->data = value->size > 0 ? dataAddress : NULL;
+        for ( where = 0; where < pageRead; ++where )
+        {
+            const BitableLeafIndice* itemIndice = leaf_indice( table, pageAddress, item + (int32_t)where );
+
+            if ( keys != NULL )
+            {
+                keys[ read + where ].size = itemIndice->keySize;
+                keys[ read + where ].data = pageAddress + itemIndice->itemOffset;
             }
-            else
+
+            if ( values != NULL )
             {
-                const uint32_t paddedOffset     = table->header->pageSize - ( ( dataFromRight + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 ) );
-                const void*    dataAddress      = (const uint8_t*)page + paddedOffset;
-                size_t         largeValueOffset = (size_t)*(const uint64_t*)dataAddress;
+                read_value( table, pageAddress, itemIndice, values + read + where );
+            }
+        }
 
-                value->data = (const uint8_t*)table->largeValueFile.address + largeValueOffset;
+        read += pageRead;
+        item += (int32_t)pageRead;
 
-                assert( table->largeValueFile.size >= largeValueOffset + value->size );
-            }
+        if ( item < limit )
+        {
+            break;
+        }
+
+        // the end page is finished, stay at the end position (one past the last item for the last page).
+        if ( page >= endPage )
+        {
+            cursor->page = page;
+            cursor->item = item;
+            *count       = read;
+
+            return BR_END_OF_SEQUENCE;
         }
+
+        ++page;
+        item = 0;
     }
 
+    cursor->page = page;
+    cursor->item = item;
+    *count       = read;
+
     return BR_SUCCESS;
 }
 
-BitableResult bitable_key_value_pair( const BitableCursor* cursor, const BitableReadable* table, BitableValue* key, BitableValue* value )
+BitableResult bitable_next_batch( BitableCursor* cursor, const BitableReadable* table, BitableValue* keys, BitableValue* values, uint32_t maxCount, uint32_t* count )
+{
+    return next_batch( cursor, table, table->header->leafPages - 1, INT32_MAX, keys, values, maxCount, count );
+}
+
+BitableResult bitable_next_batch_bounded( BitableCursor* cursor, const BitableCursor* end, const BitableReadable* table, BitableValue* keys, BitableValue* values, uint32_t maxCount, uint32_t* count )
+{
+    if ( end->page >= table->header->leafPages )
+    {
+        return next_batch( cursor, table, table->header->leafPages - 1, INT32_MAX, keys, values, maxCount, count );
+    }
+
+    return next_batch( cursor, table, end->page, end->item, keys, values, maxCount, count );
+}
+
+BitableResult bitable_indice( const BitableCursor* cursor, const BitableReadable* table, uint64_t* indice )
 {
     if ( cursor->page >= table->header->leafPages || cursor->item < 0 )
     {
@@ -473,66 +1895,230 @@ BitableResult bitable_key_value_pair( const BitableCursor* cursor, const Bitable
     }
 
     {
-        const void*              page      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        int32_t                  itemCount = *(const int32_t*)( (const uint8_t*)page + sizeof( uint64_t ) );
-        const BitableLeafIndice* leafIndex = (const BitableLeafIndice*)( (const uint8_t*)page + sizeof( uint64_t ) + sizeof( int32_t ) );
+        const uint8_t* page      = leaf_page( table, cursor->page );
+        int32_t        itemCount = leaf_item_count( page );
 
-        if ( cursor->item < 0 || cursor->item >= itemCount )
+        if ( cursor->item >= itemCount )
         {
             return BR_INVALID_CURSOR_LOCATION;
         }
 
+        *indice = page_initial_indice( table, cursor->page ) + cursor->item;
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Find the position of the item with an indice, searching the leaf pages between a low and high page.
+  * Leaf pages are close to evenly filled, so the search interpolates on the initial indices of the pages, with a bounded fall back to binary search.
+  * @param table The table to search. Should have valid leaf indices.
+  * @param indice The indice to find. Should be within the pages searched.
+  * @param lowPage The lowest page to search, with an initial indice less than or equal to indice.
+  * @param highPage The highest page to search.
+  * @param [out] cursor The position of the item.
+  */
+static void seek_indice( const BitableReadable* table, uint64_t indice, uint64_t lowPage, uint64_t highPage, BitableCursor* cursor )
+{
+    uint64_t lowIndice  = leaf_initial_indice( leaf_page( table, lowPage ) );
+    uint64_t highIndice = leaf_initial_indice( leaf_page( table, highPage ) );
+    int      probe      = 0;
+
+    if ( highIndice <= indice )
+    {
+        lowPage   = highPage;
+        lowIndice = highIndice;
+    }
+
+    // the page at low always starts at or before the indice, the page at high always starts after it.
+    while ( highPage - lowPage > 1 )
+    {
+        uint64_t midPage;
+        uint64_t midIndice;
+
+        if ( probe < BITABLE_INTERPOLATION_PROBES )
+        {
+            double fraction = (double)( indice - lowIndice ) / (double)( highIndice - lowIndice );
+
+            midPage = lowPage + (uint64_t)( fraction * (double)( highPage - lowPage ) );
+            midPage = midPage <= lowPage ? lowPage + 1 : ( midPage >= highPage ? highPage - 1 : midPage );
+            ++probe;
+        }
+        else
         {
-            const BitableLeafIndice* itemIndice     = leafIndex + cursor->item;
-            const uint32_t           dataFromRight  = table->header->pageSize - itemIndice->itemOffset;
+            midPage = lowPage + ( ( highPage - lowPage ) / 2 );
+        }
 
-            key->size   = itemIndice->keySize;
-            key->data   = (const uint8_t*)page + itemIndice->itemOffset;
-            value->size = itemIndice->dataSize;
+        midIndice = leaf_initial_indice( leaf_page( table, midPage ) );
 
-            if ( value->size <= BITABLE_MAX_KEY_SIZE )
-            {
-                const uint32_t paddedOffset = table->header->pageSize - ( ( dataFromRight + itemIndice->dataSize + ( table->header->valueAlignment - 1 ) ) & ~( table->header->valueAlignment - 1 ) );
-                const void*    dataAddress  = (const uint8_t*)page + paddedOffset;
+        if ( midIndice <= indice )
+        {
+            lowPage   = midPage;
+            lowIndice = midIndice;
+        }
+        else
+        {
+            highPage   = midPage;
+            highIndice = midIndice;
+        }
+    }
+
+    cursor->page = lowPage;
+    cursor->item = (int32_t)( indice - lowIndice );
+}
 
-                value->data = value->size > 0 ? dataAddress : NULL;
+/** Check a cursor points at an item in the table.
+  */
+static int valid_cursor( const BitableReadable* table, const BitableCursor* cursor )
+{
+    return cursor->page < table->header->leafPages && cursor->item >= 0 && cursor->item < leaf_item_count( leaf_page( table, cursor->page ) );
+}
+
+BitableResult bitable_split_ranges( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint32_t rangeCount, BitableCursor* boundaries )
+{
+    BitableCursor end;
+    uint32_t      where;
+
+    if ( !valid_cursor( table, lower ) || 
+         !valid_cursor( table, upper ) || 
+         upper->page < lower->page || 
+         ( upper->page == lower->page && upper->item < lower->item ) )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
+
+    boundaries[ 0 ] = *lower;
+
+    if ( rangeCount == 0 )
+    {
+        return BR_SUCCESS;
+    }
+
+    // the end boundary is the position after upper.
+    end       = *upper;
+    end.item += 1;
+
+    if ( end.item >= leaf_item_count( leaf_page( table, end.page ) ) && end.page + 1 < table->header->leafPages )
+    {
+        end.page += 1;
+        end.item  = 0;
+    }
+
+    if ( table->leafIndicesValid )
+    {
+        uint64_t lowerIndice = leaf_initial_indice( leaf_page( table, lower->page ) ) + lower->item;
+        uint64_t endIndice   = leaf_initial_indice( leaf_page( table, upper->page ) ) + upper->item + 1;
+        uint64_t itemCount   = endIndice - lowerIndice;
+
+        for ( where = 1; where < rangeCount; ++where )
+        {
+            uint64_t indice = lowerIndice + ( itemCount / rangeCount ) * where + ( ( itemCount % rangeCount ) * where ) / rangeCount;
+
+            if ( indice >= endIndice )
+            {
+                boundaries[ where ] = end;
             }
             else
             {
-                const uint32_t paddedOffset     = table->header->pageSize - ( ( dataFromRight + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 ) );
-                const void*    dataAddress      = (const uint8_t*)page + paddedOffset;
-                size_t         largeValueOffset = (size_t)*(const uint64_t*)dataAddress;
+                seek_indice( table, indice, lower->page, upper->page, boundaries + where );
+            }
+        }
+    }
+    else
+    {
+        uint64_t pageCount = upper->page - lower->page + 1;
 
-                value->data = (const uint8_t*)table->largeValueFile.address + largeValueOffset;
+        for ( where = 1; where < rangeCount; ++where )
+        {
+            uint64_t page = lower->page + ( pageCount * where ) / rangeCount;
 
-                assert( table->largeValueFile.size >= largeValueOffset + value->size );
+            if ( page == lower->page )
+            {
+                boundaries[ where ] = *lower;
+            }
+            else
+            {
+                boundaries[ where ].page = page;
+                boundaries[ where ].item = 0;
             }
         }
     }
 
+    boundaries[ rangeCount ] = end;
+
     return BR_SUCCESS;
 }
 
+BitableResult bitable_seek_indice( BitableCursor* cursor, const BitableReadable* table, uint64_t indice )
+{
+    if ( indice >= table->header->itemCount )
+    {
+        return BR_END_OF_SEQUENCE;
+    }
 
-BitableResult bitable_indice( const BitableCursor* cursor, const BitableReadable* table, uint64_t* indice )
+    if ( table->leafIndicesValid )
+    {
+        seek_indice( table, indice, 0, table->header->leafPages - 1, cursor );
+    }
+    else
+    {
+        uint64_t page = 0;
+        int32_t  itemCount;
+
+        // without leaf page indices, walk the pages until we reach the one with the indice.
+        while ( indice >= (uint64_t)( itemCount = leaf_item_count( leaf_page( table, page ) ) ) )
+        {
+            indice -= itemCount;
+            ++page;
+        }
+
+        cursor->page = page;
+        cursor->item = (int32_t)indice;
+    }
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_count_range( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint64_t* count )
 {
-    if ( cursor->page >= table->header->leafPages || cursor->item < 0 )
+    uint64_t lowerIndice;
+    uint64_t upperIndice;
+
+    if ( !valid_cursor( table, lower ) || !valid_cursor( table, upper ) || upper->page + 1 < lower->page )
     {
         return BR_INVALID_CURSOR_LOCATION;
     }
 
+    if ( table->leafIndicesValid )
     {
-        const void* page      = (const uint8_t*)table->leafFile.address + ( table->header->pageSize * ( cursor->page + 1 ) );
-        uint64_t    baseIndex = *(const uint64_t*)page;
-        int32_t     itemCount = *(const int32_t*)( (const uint8_t*)page + +sizeof( uint64_t ) );
+        lowerIndice = page_initial_indice( table, lower->page ) + lower->item;
+        upperIndice = page_initial_indice( table, upper->page ) + upper->item;
+    }
+    else
+    {
+        uint64_t where;
 
-        if ( cursor->item >= itemCount )
+        // only the pages between the cursors need to be added up (the upper cursor can be on the page before the lower one, for an empty range).
+        lowerIndice = lower->item;
+        upperIndice = upper->item;
+
+        for ( where = upper->page; where < lower->page; ++where )
         {
-            return BR_INVALID_CURSOR_LOCATION;
+            lowerIndice += leaf_item_count( leaf_page( table, where ) );
+        }
+
+        for ( where = lower->page; where < upper->page; ++where )
+        {
+            upperIndice += leaf_item_count( leaf_page( table, where ) );
         }
+    }
 
-        *indice = baseIndex + cursor->item;
+    // an empty range (like the finds for a key range with no keys in the table) has the upper cursor on the item just before the lower one.
+    if ( upperIndice + 1 < lowerIndice )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
     }
 
+    *count = upperIndice + 1 - lowerIndice;
+
     return BR_SUCCESS;
 }
@@ -0,0 +1,282 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bitablescan.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <memory.h>
+
+/* The number of chunks the scan range is split into per worker, more chunks balances better but costs more steals */
+#define BITABLE_SCAN_CHUNKS_PER_WORKER 64
+
+/* The maximum number of key value pairs passed to the batch callback at once */
+#define BITABLE_SCAN_BATCH_SIZE 256
+
+/* The maximum number of workers in a scan (which keeps the number of chunks well within 32 bits) */
+#define BITABLE_SCAN_MAX_WORKERS 4096
+
+typedef struct ScanWorker ScanWorker;
+
+/** State shared between all the workers in a scan.
+  */
+typedef struct ScanShared
+{
+
+    const BitableReadable* table;
+    const BitableScanCallbacks* callbacks;
+    const BitableCursor* boundaries; // chunk boundaries, chunk i is from boundaries[ i ] up to boundaries[ i + 1 ]
+    ScanWorker* workers;
+    uint32_t workerCount;
+    BitableAtomic stop; // set when the batch callback asks to stop the scan
+
+} ScanShared;
+
+struct ScanWorker
+{
+
+    ScanShared* shared;
+    BitableMutex* mutex; // protects the chunks owned by the worker (which other workers steal from)
+    BitableThread* thread;
+    void* state;
+    uint32_t nextChunk; // the next chunk the worker will take
+    uint32_t endChunk; // the end of the chunks owned by the worker (exclusive)
+    uint32_t index;
+
+};
+
+/** Take the back half of the chunks remaining for another worker.
+  * @param worker The worker stealing.
+  * @param [out] chunk The first chunk stolen, the rest become owned by the stealing worker.
+  * @return Non-zero if chunks were stolen, 0 if there were none left to steal.
+  */
+static int steal_chunks( ScanWorker* worker, uint32_t* chunk )
+{
+    ScanShared* shared = worker->shared;
+    uint32_t    offset;
+
+    // only one lock is ever held at a time, so workers stealing from each other can't deadlock.
+    for ( offset = 1; offset < shared->workerCount; ++offset )
+    {
+        ScanWorker* victim     = shared->workers + ( ( worker->index + offset ) % shared->workerCount );
+        uint32_t    stealStart = 0;
+        uint32_t    stealEnd   = 0;
+
+        bitable_mutex_lock( victim->mutex );
+
+        if ( victim->nextChunk < victim->endChunk )
+        {
+            uint32_t remaining = victim->endChunk - victim->nextChunk;
+
+            stealEnd         = victim->endChunk;
+            stealStart       = stealEnd - ( ( remaining + 1 ) / 2 );
+            victim->endChunk = stealStart;
+        }
+
+        bitable_mutex_unlock( victim->mutex );
+
+        if ( stealEnd > stealStart )
+        {
+            bitable_mutex_lock( worker->mutex );
+
+            worker->nextChunk = stealStart + 1;
+            worker->endChunk  = stealEnd;
+
+            bitable_mutex_unlock( worker->mutex );
+
+            *chunk = stealStart;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/** Take the next chunk for a worker to scan, from its own chunks or stolen from another worker.
+  * @param worker The worker taking a chunk.
+  * @param [out] chunk The chunk taken.
+  * @return Non-zero if a chunk was taken, 0 if the scan is complete.
+  */
+static int take_chunk( ScanWorker* worker, uint32_t* chunk )
+{
+    int taken = 0;
+
+    if ( bitable_atomic_load( &worker->shared->stop ) )
+    {
+        return 0;
+    }
+
+    bitable_mutex_lock( worker->mutex );
+
+    if ( worker->nextChunk < worker->endChunk )
+    {
+        *chunk = worker->nextChunk++;
+        taken  = 1;
+    }
+
+    bitable_mutex_unlock( worker->mutex );
+
+    return taken || steal_chunks( worker, chunk );
+}
+
+/** Run a scan worker, scanning chunks until there are none left.
+  * @param context The ScanWorker.
+  */
+static void run_worker( void* context )
+{
+    ScanWorker*                 worker    = (ScanWorker*)context;
+    ScanShared*                 shared    = worker->shared;
+    const BitableScanCallbacks* callbacks = shared->callbacks;
+    BitableValue*               keys      = malloc( sizeof( BitableValue ) * BITABLE_SCAN_BATCH_SIZE );
+    BitableValue*               values    = malloc( sizeof( BitableValue ) * BITABLE_SCAN_BATCH_SIZE );
+    uint32_t                    chunk;
+
+    // if we can't allocate, leave the chunks for the other workers to steal.
+    while ( keys != NULL && values != NULL && take_chunk( worker, &chunk ) )
+    {
+        BitableCursor cursor = shared->boundaries[ chunk ];
+        BitableResult result;
+        uint32_t      count;
+
+        do
+        {
+            result = bitable_next_batch_bounded( &cursor, shared->boundaries + chunk + 1, shared->table, keys, values, BITABLE_SCAN_BATCH_SIZE, &count );
+
+            if ( count > 0 && callbacks->processBatch( callbacks->context, worker->state, keys, values, count ) != 0 )
+            {
+                bitable_atomic_store( &shared->stop, 1 );
+            }
+
+        } while ( result == BR_SUCCESS && !bitable_atomic_load( &shared->stop ) );
+    }
+
+    free( keys );
+    free( values );
+}
+
+BitableResult bitable_parallel_scan( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint32_t threadCount, const BitableScanCallbacks* callbacks )
+{
+    ScanShared     shared;
+    BitableCursor* boundaries;
+    ScanWorker*    workers;
+    uint32_t       workerCount = threadCount > 0 ? threadCount : bitable_hardware_threads();
+    uint32_t       chunkCount;
+    BitableResult  result;
+    uint32_t       where;
+
+    workerCount = workerCount < BITABLE_SCAN_MAX_WORKERS ? workerCount : BITABLE_SCAN_MAX_WORKERS;
+    chunkCount  = workerCount * BITABLE_SCAN_CHUNKS_PER_WORKER;
+    boundaries  = malloc( sizeof( BitableCursor ) * ( chunkCount + 1 ) );
+    workers     = calloc( workerCount, sizeof( ScanWorker ) );
+
+    if ( boundaries == NULL || workers == NULL )
+    {
+        free( workers );
+        free( boundaries );
+
+        return BR_ALLOCATION_FAILED;
+    }
+
+    result = bitable_split_ranges( table, lower, upper, chunkCount, boundaries );
+
+    for ( where = 0; where < workerCount && result == BR_SUCCESS; ++where )
+    {
+        result = bitable_mutex_create( &workers[ where ].mutex );
+    }
+
+    if ( result != BR_SUCCESS )
+    {
+        for ( where = 0; where < workerCount; ++where )
+        {
+            if ( workers[ where ].mutex != NULL )
+            {
+                bitable_mutex_destroy( workers[ where ].mutex );
+            }
+        }
+
+        free( workers );
+        free( boundaries );
+
+        return result;
+    }
+
+    shared.table       = table;
+    shared.callbacks   = callbacks;
+    shared.boundaries  = boundaries;
+    shared.workers     = workers;
+    shared.workerCount = workerCount;
+
+    bitable_atomic_store( &shared.stop, 0 );
+
+    // each worker starts owning an equal share of the chunks.
+    for ( where = 0; where < workerCount; ++where )
+    {
+        ScanWorker* worker = workers + where;
+
+        worker->shared    = &shared;
+        worker->index     = where;
+        worker->nextChunk = (uint32_t)( ( (uint64_t)chunkCount * where ) / workerCount );
+        worker->endChunk  = (uint32_t)( ( (uint64_t)chunkCount * ( where + 1 ) ) / workerCount );
+        worker->state     = callbacks->createState != NULL ? callbacks->createState( callbacks->context, where ) : NULL;
+    }
+
+    // if a thread fails to start, its chunks are stolen by the workers that did.
+    for ( where = 1; where < workerCount; ++where )
+    {
+        if ( bitable_thread_create( &workers[ where ].thread, run_worker, workers + where ) != BR_SUCCESS )
+        {
+            workers[ where ].thread = NULL;
+        }
+    }
+
+    run_worker( workers );
+
+    // workers steal from each other until they finish, so every thread is joined before any of the mutexes go.
+    for ( where = 0; where < workerCount; ++where )
+    {
+        if ( workers[ where ].thread != NULL )
+        {
+            bitable_thread_join( workers[ where ].thread );
+        }
+    }
+
+    for ( where = 0; where < workerCount; ++where )
+    {
+        bitable_mutex_destroy( workers[ where ].mutex );
+    }
+
+    if ( callbacks->reduce != NULL )
+    {
+        for ( where = 0; where < workerCount; ++where )
+        {
+            callbacks->reduce( callbacks->context, workers[ where ].state, where );
+        }
+    }
+
+    free( workers );
+    free( boundaries );
+
+    return BR_SUCCESS;
+}
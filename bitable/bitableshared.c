@@ -45,5 +45,173 @@ uint64_t bitable_header_checksum( const BitableHeader* header )
     checksum *= 37;
     checksum += header->leafPages;
 
+    // Fields added after the original format are folded in separately, so a header with 
+    // them zeroed (as written by earlier versions) keeps its original checksum.
+    {
+        uint64_t extension = 0;
+
+        extension  = header->formatFlags;
+        extension *= 37;
+        extension += header->keyKind;
+        extension *= 37;
+        extension += header->bloomBlockCount;
+        extension *= 37;
+        extension += header->bloomHashCount;
+
+        if ( ( header->formatFlags & BITABLE_FORMAT_SINGLE_FILE ) != 0 )
+        {
+            uint32_t where;
+
+            for ( where = 0; where < BITABLE_MAX_BRANCH_LEVELS; ++where )
+            {
+                extension *= 37;
+                extension += header->branchExtents[ where ].offset;
+                extension *= 37;
+                extension += header->branchExtents[ where ].size;
+            }
+
+            extension *= 37;
+            extension += header->largeValueExtent.offset;
+            extension *= 37;
+            extension += header->largeValueExtent.size;
+            extension *= 37;
+            extension += header->bloomExtent.offset;
+            extension *= 37;
+            extension += header->bloomExtent.size;
+        }
+
+        checksum ^= extension * 0x9E3779B97F4A7C15;
+    }
+
     return checksum;
-}
\ No newline at end of file
+}
+
+uint64_t bitable_key_prefix( const BitableValue* key )
+{
+    const uint8_t* keyData    = (const uint8_t*)key->data;
+    int32_t        prefixSize = key->size < (int32_t)sizeof( uint64_t ) ? key->size : (int32_t)sizeof( uint64_t );
+    uint64_t       prefix     = 0;
+    int32_t        where;
+
+    for ( where = 0; where < prefixSize; ++where )
+    {
+        prefix |= (uint64_t)keyData[ where ] << ( 56 - ( where * 8 ) );
+    }
+
+    return prefix;
+}
+
+int32_t bitable_key_kind_size( BitableKeyKind keyKind )
+{
+    switch ( keyKind )
+    {
+    case BKK_INT32_LE:
+    case BKK_UINT32_LE:
+    case BKK_UINT32_BE:
+
+        return sizeof( uint32_t );
+
+    case BKK_INT64_LE:
+    case BKK_UINT64_LE:
+    case BKK_UINT64_BE:
+    case BKK_FLOAT64:
+
+        return sizeof( uint64_t );
+
+    default:
+
+        return 0;
+    }
+}
+
+uint64_t bitable_key_hash( const BitableValue* key )
+{
+    // MurmurHash64A, with explicit little endian loads so the hash is the same on every platform.
+    const uint64_t multiplier = 0xC6A4A7935BD1E995ULL;
+    const int      shift      = 47;
+    const uint8_t* data       = (const uint8_t*)key->data;
+    const uint8_t* dataEnd    = data + ( key->size & ~7 );
+    uint64_t       hash       = 0x8445D61A4E774912ULL ^ ( (uint64_t)key->size * multiplier );
+
+    for ( ; data < dataEnd; data += sizeof( uint64_t ) )
+    {
+        uint64_t chunk = bitable_load_u64_le( data );
+
+        chunk *= multiplier;
+        chunk ^= chunk >> shift;
+        chunk *= multiplier;
+
+        hash ^= chunk;
+        hash *= multiplier;
+    }
+
+    switch ( key->size & 7 )
+    {
+    case 7: hash ^= (uint64_t)data[ 6 ] << 48; /* fall through */
+    case 6: hash ^= (uint64_t)data[ 5 ] << 40; /* fall through */
+    case 5: hash ^= (uint64_t)data[ 4 ] << 32; /* fall through */
+    case 4: hash ^= (uint64_t)data[ 3 ] << 24; /* fall through */
+    case 3: hash ^= (uint64_t)data[ 2 ] << 16; /* fall through */
+    case 2: hash ^= (uint64_t)data[ 1 ] << 8;  /* fall through */
+    case 1: hash ^= (uint64_t)data[ 0 ];
+            hash *= multiplier;
+    }
+
+    hash ^= hash >> shift;
+    hash *= multiplier;
+    hash ^= hash >> shift;
+
+    return hash;
+}
+
+uint32_t bitable_bloom_hash_count( uint32_t bitsPerKey )
+{
+    // bits per key * ln(2) is optimal, rounded to the nearest.
+    uint32_t hashCount = ( bitsPerKey * 69 + 50 ) / 100;
+
+    if ( hashCount < 1 )
+    {
+        hashCount = 1;
+    }
+    else if ( hashCount > BITABLE_BLOOM_MAX_HASHES )
+    {
+        hashCount = BITABLE_BLOOM_MAX_HASHES;
+    }
+
+    return hashCount;
+}
+
+void bitable_bloom_add( uint64_t* blocks, uint64_t blockCount, uint32_t hashCount, uint64_t hash )
+{
+    uint64_t* block     = (uint64_t*)bitable_bloom_block( blocks, blockCount, hash );
+    uint32_t  bitHash   = (uint32_t)( ( hash * 0x9E3779B97F4A7C15ULL ) >> 32 ); // re-mix, so the bits are independent of the block chosen
+    uint32_t  bitStep   = (uint32_t)( hash >> 32 ) | 1;
+    uint32_t  where;
+
+    for ( where = 0; where < hashCount; ++where, bitHash += bitStep )
+    {
+        uint32_t bit = bitHash & ( BITABLE_BLOOM_BLOCK_SIZE * 8 - 1 );
+
+        block[ bit >> 6 ] |= (uint64_t)1 << ( bit & 63 );
+    }
+}
+
+int bitable_bloom_may_contain( const uint64_t* blocks, uint64_t blockCount, uint32_t hashCount, uint64_t hash )
+{
+    const uint64_t* block   = bitable_bloom_block( blocks, blockCount, hash );
+    uint32_t        bitHash = (uint32_t)( ( hash * 0x9E3779B97F4A7C15ULL ) >> 32 );
+    uint32_t        bitStep = (uint32_t)( hash >> 32 ) | 1;
+    uint32_t        where;
+
+    for ( where = 0; where < hashCount; ++where, bitHash += bitStep )
+    {
+        uint32_t bit = bitHash & ( BITABLE_BLOOM_BLOCK_SIZE * 8 - 1 );
+
+        if ( ( block[ bit >> 6 ] & ( (uint64_t)1 << ( bit & 63 ) ) ) == 0 )
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
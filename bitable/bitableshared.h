@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include "bitablecommon.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +39,123 @@ extern "C" {
 /* The maximum number of branch levels for a bitable - should be less than 3 digits */
 #define BITABLE_HEADER_MARKER 0xD47A682CF7E614BA
 
+/* Format flag - leaf and branch indices carry a fixed width, order preserving key prefix (BitablePrefixedLeafIndice/BitablePrefixedBranchIndice) */
+#define BITABLE_FORMAT_KEY_PREFIXES 0x1
+
+/* Format flag - the table has a bloom filter of its keys in a sidecar file */
+#define BITABLE_FORMAT_BLOOM_FILTER 0x2
+
+/* Format flag - integer keys are searched with interpolation search */
+#define BITABLE_FORMAT_INTERPOLATION 0x4
+
+/* Format flag - the branch levels, large value store and bloom filter are stored in the leaf file after the leaf pages, at the extents in the header */
+#define BITABLE_FORMAT_SINGLE_FILE 0x8
+
+/* All the format flags understood by this version of the library */
+#define BITABLE_FORMAT_ALL ( BITABLE_FORMAT_KEY_PREFIXES | BITABLE_FORMAT_BLOOM_FILTER | BITABLE_FORMAT_INTERPOLATION | BITABLE_FORMAT_SINGLE_FILE )
+
+/* The size of a bloom filter block in bytes - all the bits for a key are set in a single block (cache line) */
+#define BITABLE_BLOOM_BLOCK_SIZE 64
+
+/* The maximum number of hash bits set per key in the bloom filter */
+#define BITABLE_BLOOM_MAX_HASHES 16
+
+/* The size of the leaf page header (initial indice and item count) before the leaf indices start */
+#define BITABLE_LEAF_HEADER_SIZE ( sizeof( uint64_t ) + sizeof( int32_t ) )
+
+/* The size of the branch page header (initial child page and child count) before the branch indices start */
+#define BITABLE_BRANCH_HEADER_SIZE ( sizeof( uint64_t ) + sizeof( uint16_t ) )
+
+/* The size of leaf and branch page headers when key prefixes are used, padded so the 64bit prefixes are aligned */
+#define BITABLE_PREFIXED_HEADER_SIZE 16
+
+/* Used to define functions that should be inlined (even in C89 on MSVC) */
+#if defined( _MSC_VER )
+#define BITABLE_INLINE static __inline
+#define BITABLE_FORCE_INLINE static __forceinline
+#elif defined( __GNUC__ ) || defined( __clang__ )
+#define BITABLE_INLINE static __inline__
+#define BITABLE_FORCE_INLINE static __inline__ __attribute__( ( always_inline ) )
+#else
+#define BITABLE_INLINE static
+#define BITABLE_FORCE_INLINE static
+#endif
+
+/* Whether the target is big endian */
+#if defined( __BYTE_ORDER__ ) && defined( __ORDER_BIG_ENDIAN__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BITABLE_BIG_ENDIAN 1
+#else
+#define BITABLE_BIG_ENDIAN 0
+#endif
+
+/* Byte swaps, used for loading keys of the opposite endianness */
+#if defined( _MSC_VER )
+#define BITABLE_BSWAP32( value ) _byteswap_ulong( value )
+#define BITABLE_BSWAP64( value ) _byteswap_uint64( value )
+#else
+#define BITABLE_BSWAP32( value ) __builtin_bswap32( value )
+#define BITABLE_BSWAP64( value ) __builtin_bswap64( value )
+#endif
+
+/* The number of lookups that are stepped through the tree in lockstep by bitable_find_batch */
+#define BITABLE_FIND_BATCH_GROUP 16
+
+/* The maximum number of interpolation probes in a page before falling back to binary search */
+#define BITABLE_INTERPOLATION_PROBES 3
+
+/* Below this many items left in the search range, interpolation search falls back to binary search */
+#define BITABLE_INTERPOLATION_MIN_RANGE 8
+
+/* Prefetch the cache line at an address, if the compiler supports it */
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define BITABLE_PREFETCH( address ) __builtin_prefetch( ( address ) )
+#elif defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#include <xmmintrin.h>
+#define BITABLE_PREFETCH( address ) _mm_prefetch( (const char*)( address ), _MM_HINT_T0 )
+#else
+#define BITABLE_PREFETCH( address )
+#endif
+
+/* The size of cache lines the in memory branch cache is aligned to */
+#define BITABLE_CACHE_LINE_SIZE 64
+
+/** Count the number of trailing set bits in a value.
+  * @param value The value to count the trailing set bits in, should not be all ones.
+  * @return The number of trailing set bits.
+  */
+BITABLE_FORCE_INLINE int bitable_trailing_ones( uint64_t value )
+{
+#if defined( _MSC_VER ) && defined( _M_X64 )
+    unsigned long index;
+
+    _BitScanForward64( &index, ~value );
+
+    return (int)index;
+#elif defined( __GNUC__ ) || defined( __clang__ )
+    return __builtin_ctzll( ~value );
+#else
+    int count = 0;
+
+    while ( ( value & 1 ) != 0 )
+    {
+        value >>= 1;
+        ++count;
+    }
+
+    return count;
+#endif
+}
+
+/** A region of a single file table, in bytes from the start of the file.
+ */
+typedef struct BitableExtent
+{
+
+    uint64_t offset;
+    uint64_t size;
+
+} BitableExtent;
+
 /** Header used at the front of the leaf page, should show it is a bitables leaf file, provide the needed stats to load other files,etc.
  */
 typedef struct BitableHeader
@@ -51,6 +170,16 @@ typedef struct BitableHeader
     uint32_t valueAlignment;
     uint32_t pageSize;
     uint64_t leafPages;
+    uint32_t formatFlags;
+    uint32_t keyKind;
+    uint64_t bloomBlockCount;
+    uint32_t bloomHashCount;
+    uint32_t padding;
+
+    // only used with BITABLE_FORMAT_SINGLE_FILE (zero otherwise).
+    BitableExtent branchExtents[ BITABLE_MAX_BRANCH_LEVELS ];
+    BitableExtent largeValueExtent;
+    BitableExtent bloomExtent;
 
 } BitableHeader;
 
@@ -74,12 +203,236 @@ typedef struct BitableBranchIndice
 
 } BitableBranchIndice;
 
+/** Leaf indice used when the table is written with key prefixes. 
+  * The prefix is the first 8 bytes of the key loaded big endian (zero padded), so comparing prefixes as integers
+  * matches lexicographic byte order.
+ */
+typedef struct BitablePrefixedLeafIndice
+{
+
+    BitableLeafIndice indice;
+    uint64_t keyPrefix;
+
+} BitablePrefixedLeafIndice;
+
+/** Branch indice used when the table is written with key prefixes.
+ */
+typedef struct BitablePrefixedBranchIndice
+{
+
+    BitableBranchIndice indice;
+    uint32_t padding;
+    uint64_t keyPrefix;
+
+} BitablePrefixedBranchIndice;
+
 /** Calculate the checksum for a header.
   * @param header The header to provide the checksum for.
   * @return The generated 64bit checksum for the header.
   */
 uint64_t bitable_header_checksum( const BitableHeader* header );
 
+/** Calculate the order preserving prefix for a key (the first 8 bytes loaded big endian, zero padded).
+  * @param key The key to calculate the prefix for.
+  * @return The key prefix.
+  */
+uint64_t bitable_key_prefix( const BitableValue* key );
+
+/** Calculate a 64bit hash of the bytes in a key, used for the bloom filter.
+  * @param key The key to hash.
+  * @return The hash of the key.
+  */
+uint64_t bitable_key_hash( const BitableValue* key );
+
+/** Calculate the number of hash bits to set per key in the bloom filter for a number of bits per key.
+  * @param bitsPerKey The number of bloom filter bits per key.
+  * @return The number of hash bits set per key.
+  */
+uint32_t bitable_bloom_hash_count( uint32_t bitsPerKey );
+
+/** Add a key hash to a blocked bloom filter.
+  * @param blocks The bloom filter blocks (blockCount * BITABLE_BLOOM_BLOCK_SIZE bytes).
+  * @param blockCount The number of blocks in the bloom filter.
+  * @param hashCount The number of hash bits to set per key.
+  * @param hash The key hash (from bitable_key_hash).
+  */
+void bitable_bloom_add( uint64_t* blocks, uint64_t blockCount, uint32_t hashCount, uint64_t hash );
+
+/** Check if a key hash may be in a blocked bloom filter. 
+  * @param blocks The bloom filter blocks (blockCount * BITABLE_BLOOM_BLOCK_SIZE bytes).
+  * @param blockCount The number of blocks in the bloom filter.
+  * @param hashCount The number of hash bits set per key.
+  * @param hash The key hash (from bitable_key_hash).
+  * @return Non-zero if the key may be in the set, 0 if it definitely isn't.
+  */
+int bitable_bloom_may_contain( const uint64_t* blocks, uint64_t blockCount, uint32_t hashCount, uint64_t hash );
+
+/** Get the address of the block in a bloom filter a key hash maps to (for prefetching).
+  * @param blocks The bloom filter blocks.
+  * @param blockCount The number of blocks in the bloom filter.
+  * @param hash The key hash (from bitable_key_hash).
+  * @return The address of the block.
+  */
+BITABLE_FORCE_INLINE const uint64_t* bitable_bloom_block( const uint64_t* blocks, uint64_t blockCount, uint64_t hash )
+{
+    return blocks + ( hash % blockCount ) * ( BITABLE_BLOOM_BLOCK_SIZE / sizeof( uint64_t ) );
+}
+
+/** Check if a key kind is an integer key kind (that can be searched with interpolation).
+  * @param keyKind The key kind.
+  * @return Non-zero if the key kind is an integer key kind.
+  */
+BITABLE_INLINE int bitable_key_kind_is_integer( BitableKeyKind keyKind )
+{
+    return keyKind >= BKK_INT32_LE && keyKind <= BKK_UINT64_BE;
+}
+
+/** Get the size of keys for a key kind.
+  * @param keyKind The key kind.
+  * @return The size in bytes of keys of this kind, or 0 if keys of this kind can be variable sized.
+  */
+int32_t bitable_key_kind_size( BitableKeyKind keyKind );
+
+struct BitableReadable;
+
+/** Get the header of an open readable table (used to copy pages between tables when writing).
+  * @param table The open readable table.
+  * @return The table header.
+  */
+const BitableHeader* bitable_readable_header( const struct BitableReadable* table );
+
+/** Get the address of a leaf page in an open readable table.
+  * @param table The open readable table.
+  * @param page The leaf page number (not including the header page).
+  * @return The address of the leaf page.
+  */
+const uint8_t* bitable_readable_leaf_page( const struct BitableReadable* table, uint64_t page );
+
+/** Get the address of the large value store of an open readable table.
+  * @param table The open readable table.
+  * @return The address of the large value store (NULL if the table doesn't have one).
+  */
+const uint8_t* bitable_readable_large_values( const struct BitableReadable* table );
+
+/** Get the comparison function an open readable table was opened with.
+  * @param table The open readable table.
+  * @return The comparison function (may be NULL for built in key kinds).
+  */
+BitableComparisonFunction* bitable_readable_comparison( const struct BitableReadable* table );
+
+/** Load a little endian 32bit unsigned integer.
+  * @param data The address to load from (no alignment requirement).
+  * @return The loaded value.
+  */
+BITABLE_FORCE_INLINE uint32_t bitable_load_u32_le( const void* data )
+{
+    uint32_t value;
+
+    memcpy( &value, data, sizeof( uint32_t ) );
+
+    return BITABLE_BIG_ENDIAN ? BITABLE_BSWAP32( value ) : value;
+}
+
+/** Load a little endian 64bit unsigned integer.
+  * @param data The address to load from (no alignment requirement).
+  * @return The loaded value.
+  */
+BITABLE_FORCE_INLINE uint64_t bitable_load_u64_le( const void* data )
+{
+    uint64_t value;
+
+    memcpy( &value, data, sizeof( uint64_t ) );
+
+    return BITABLE_BIG_ENDIAN ? BITABLE_BSWAP64( value ) : value;
+}
+
+/** Load a big endian 32bit unsigned integer.
+  * @param data The address to load from (no alignment requirement).
+  * @return The loaded value.
+  */
+BITABLE_FORCE_INLINE uint32_t bitable_load_u32_be( const void* data )
+{
+    uint32_t value;
+
+    memcpy( &value, data, sizeof( uint32_t ) );
+
+    return BITABLE_BIG_ENDIAN ? value : BITABLE_BSWAP32( value );
+}
+
+/** Load a big endian 64bit unsigned integer.
+  * @param data The address to load from (no alignment requirement).
+  * @return The loaded value.
+  */
+BITABLE_FORCE_INLINE uint64_t bitable_load_u64_be( const void* data )
+{
+    uint64_t value;
+
+    memcpy( &value, data, sizeof( uint64_t ) );
+
+    return BITABLE_BIG_ENDIAN ? value : BITABLE_BSWAP64( value );
+}
+
+/** Map a key of a fixed width key kind to an unsigned 64bit integer with the same ordering as the keys.
+  * @param keyKind The key kind, should be a fixed width kind (not BKK_CUSTOM or BKK_MEMCMP).
+  * @param data The key data, which should be the size of the key kind.
+  * @return The ordered value for the key.
+  */
+BITABLE_FORCE_INLINE uint64_t bitable_key_ordered( BitableKeyKind keyKind, const void* data )
+{
+    switch ( keyKind )
+    {
+    case BKK_INT32_LE:
+
+        return bitable_load_u32_le( data ) ^ 0x80000000U;
+
+    case BKK_UINT32_LE:
+
+        return bitable_load_u32_le( data );
+
+    case BKK_INT64_LE:
+
+        return bitable_load_u64_le( data ) ^ 0x8000000000000000ULL;
+
+    case BKK_UINT64_LE:
+
+        return bitable_load_u64_le( data );
+
+    case BKK_UINT32_BE:
+
+        return bitable_load_u32_be( data );
+
+    case BKK_UINT64_BE:
+
+        return bitable_load_u64_be( data );
+
+    case BKK_FLOAT64:
+        {
+            // flip all the bits of negative values so they order in reverse, set the sign bit of positive values so they order after.
+            uint64_t bits = bitable_load_u64_le( data );
+
+            return ( bits & 0x8000000000000000ULL ) != 0 ? ~bits : ( bits | 0x8000000000000000ULL );
+        }
+
+    default:
+
+        return 0;
+    }
+}
+
+/** Compare two keys in unsigned lexicographic byte order, with shorter keys first on a tie.
+  * @param left The data for the left key.
+  * @param leftSize The size of the left key.
+  * @param right The data for the right key.
+  * @param rightSize The size of the right key.
+  * @return Less than 0 if left is less than right, 0 if they are equal and greater than 0 otherwise.
+  */
+BITABLE_FORCE_INLINE int bitable_memcmp_compare( const void* left, int32_t leftSize, const void* right, int32_t rightSize )
+{
+    int comparison = memcmp( left, right, leftSize < rightSize ? leftSize : rightSize );
+
+    return comparison != 0 ? comparison : ( leftSize < rightSize ? -1 : ( leftSize > rightSize ? 1 : 0 ) );
+}
+
 #ifdef __cplusplus
 }
 #endif 
@@ -0,0 +1,1340 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "bitablesort.h"
+#include "bitableshared.h"
+#include "writablefile.h"
+#include "memorymappedfile.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+
+/* The largest block pairs are copied into as they are added (smaller memory budgets use smaller blocks) */
+#define BITABLE_SORT_BLOCK_SIZE ( 1024 * 1024 )
+
+/* The smallest block pairs are copied into as they are added */
+#define BITABLE_SORT_MIN_BLOCK_SIZE ( 16 * 1024 )
+
+/* The smallest memory budget, a few blocks, so each run holds a useful number of pairs */
+#define BITABLE_SORT_MIN_MEMORY_BUDGET ( 4 * BITABLE_SORT_MIN_BLOCK_SIZE )
+
+/* Ranges of entries up to this size are sorted with an insertion sort before merging */
+#define BITABLE_SORT_INSERTION_SIZE 16
+
+/* The minimum number of entries sorted by each thread */
+#define BITABLE_SORT_MIN_SLICE_SIZE 16384
+
+/* The number of pairs appended at a time when everything fits in memory */
+#define BITABLE_SORT_APPEND_BATCH 256
+
+/* The maximum number of runs merged at once, more runs than this are merged a level at a time in groups of this many */
+#define BITABLE_SORT_MAX_FAN_IN 128
+
+/* The maximum size of a varint encoded 64bit integer */
+#define BITABLE_MAX_VARINT_SIZE 10
+
+/** A block of memory pairs are copied into as they are added. The data follows the block.
+  */
+typedef struct SortBlock
+{
+
+    struct SortBlock* next;
+    size_t size; // the size of the data in the block
+    size_t used;
+
+} SortBlock;
+
+/** A pair in the sort buffer.
+  */
+typedef struct SortEntry
+{
+
+    uint64_t ordered; // the ordered value of a fixed width key, the key prefix of a memcmp key, or 0 for a custom key
+    const uint8_t* data; // the key, followed by the value
+    int32_t keySize;
+    int32_t valueSize;
+
+} SortEntry;
+
+/** A part of sorting the buffer, run on one thread. Either sorting a range, or merging two adjacent sorted ranges.
+  */
+typedef struct SortTask
+{
+
+    const struct BitableSorter* sorter;
+    SortEntry* source;
+    SortEntry* destination; // where merges are written, or the scratch space for sorting a range
+    size_t begin;
+    size_t middle; // the start of the second range of a merge
+    size_t end;
+
+} SortTask;
+
+/** A run file being written, along with the previous key written to it (which the next key is encoded against).
+  */
+typedef struct RunWriter
+{
+
+    BitableWritableFile* file;
+    uint32_t run; // the number of the run file
+    uint64_t previousOrdered;
+    int32_t previousSize;
+    uint8_t previousKey[ BITABLE_MAX_KEY_SIZE ];
+
+} RunWriter;
+
+/** A source of sorted pairs in the final merge, either a run file or the sorted buffer.
+  */
+typedef struct SortSource
+{
+
+    BitableMemoryMappedFile file; // the mapped run file (not used for the buffer)
+    const uint8_t* position; // the next record in the run file
+    const uint8_t* end;
+    const SortEntry* entry; // the next entry in the buffer
+    const SortEntry* entryEnd;
+    uint64_t ordered;
+    BitableValue key;
+    BitableValue value;
+    int valid;
+    uint8_t keyBuffer[ BITABLE_MAX_KEY_SIZE ]; // keys decoded from run files
+
+} SortSource;
+
+/** A loser tree over the sources of the final merge, like the one used by the merge cursor.
+  */
+typedef struct SortMerge
+{
+
+    const struct BitableSorter* sorter;
+    SortSource* sources;
+    uint32_t* tree; // tree[ 0 ] is the winning source, tree[ 1 .. count - 1 ] are the losers at each internal node (leaves are count .. 2 * count - 1)
+    uint32_t count;
+
+} SortMerge;
+
+struct BitableSorter
+{
+
+    BitableSortOptions options;
+    char* scratchPath;
+    char* runPath; // the buffer the path of a run file is built in
+    int32_t keySize; // the size of keys for fixed width key kinds (0 for variable)
+    size_t blockSize;
+    SortBlock* blocks; // the block being filled, followed by the full blocks
+    SortEntry* entries;
+    size_t entryCount;
+    size_t entryCapacity;
+    size_t memoryUsed; // the blocks, plus the entries in use and the scratch space to sort them
+    uint32_t* runs; // the numbers of the run files, oldest first
+    uint32_t runCount;
+    uint32_t runCapacity;
+    uint32_t nextRun; // the number of the next run file written
+
+};
+
+/** Build the path of a run file.
+  * @param sorter The sorter.
+  * @param run The run number.
+  * @return The path, in the sorter's path buffer (so only valid until the next call).
+  */
+static const char* run_path( BitableSorter* sorter, uint32_t run )
+{
+    sprintf( sorter->runPath, "%s.run%04u", sorter->scratchPath, run );
+
+    return sorter->runPath;
+}
+
+/** Delete the run files written by a sorter.
+  * @param sorter The sorter.
+  */
+static void delete_runs( BitableSorter* sorter )
+{
+    uint32_t run;
+
+    for ( run = 0; run < sorter->runCount; ++run )
+    {
+        bitable_wf_delete( run_path( sorter, sorter->runs[ run ] ) );
+    }
+
+    sorter->runCount = 0;
+}
+
+/** Empty the sort buffer, freeing its blocks (the entries are kept for reuse).
+  * @param sorter The sorter.
+  */
+static void reset_buffer( BitableSorter* sorter )
+{
+    while ( sorter->blocks != NULL )
+    {
+        SortBlock* next = sorter->blocks->next;
+
+        free( sorter->blocks );
+
+        sorter->blocks = next;
+    }
+
+    sorter->entryCount = 0;
+    sorter->memoryUsed = 0;
+}
+
+/** Compare two keys, checking the ordered values first.
+  * @param sorter The sorter.
+  * @param leftOrdered The ordered value of the left key.
+  * @param left The left key.
+  * @param rightOrdered The ordered value of the right key.
+  * @param right The right key.
+  * @return Less than 0 if left is less than right, 0 if they are equal and greater than 0 otherwise.
+  */
+static int compare_keys( const BitableSorter* sorter, uint64_t leftOrdered, const BitableValue* left, uint64_t rightOrdered, const BitableValue* right )
+{
+    if ( leftOrdered != rightOrdered )
+    {
+        return leftOrdered < rightOrdered ? -1 : 1;
+    }
+
+    switch ( sorter->options.keyKind )
+    {
+    case BKK_CUSTOM:
+
+        return sorter->options.comparison( left, right );
+
+    case BKK_MEMCMP:
+
+        return bitable_memcmp_compare( left->data, left->size, right->data, right->size );
+
+    default:
+
+        return 0;
+    }
+}
+
+/** Compare the keys of two entries in the sort buffer.
+  * @param sorter The sorter.
+  * @param left The left entry.
+  * @param right The right entry.
+  * @return Less than 0 if the left key is less than the right key, 0 if they are equal and greater than 0 otherwise.
+  */
+static int compare_entries( const BitableSorter* sorter, const SortEntry* left, const SortEntry* right )
+{
+    BitableValue leftKey;
+    BitableValue rightKey;
+
+    leftKey.data  = left->data;
+    leftKey.size  = left->keySize;
+    rightKey.data = right->data;
+    rightKey.size = right->keySize;
+
+    return compare_keys( sorter, left->ordered, &leftKey, right->ordered, &rightKey );
+}
+
+/** Merge two adjacent sorted ranges of entries, taking from the first range on equal keys so the merge is stable.
+  * @param sorter The sorter.
+  * @param source The entries to merge.
+  * @param destination Where the merged entries are written, at the same positions.
+  * @param begin The start of the first range.
+  * @param middle The start of the second range.
+  * @param end The end of the second range.
+  */
+static void merge_ranges( const BitableSorter* sorter, const SortEntry* source, SortEntry* destination, size_t begin, size_t middle, size_t end )
+{
+    size_t left  = begin;
+    size_t right = middle;
+    size_t where = begin;
+
+    while ( left < middle && right < end )
+    {
+        if ( compare_entries( sorter, source + right, source + left ) < 0 )
+        {
+            destination[ where++ ] = source[ right++ ];
+        }
+        else
+        {
+            destination[ where++ ] = source[ left++ ];
+        }
+    }
+
+    memcpy( destination + where, source + left, ( middle - left ) * sizeof( SortEntry ) );
+    memcpy( destination + where + ( middle - left ), source + right, ( end - right ) * sizeof( SortEntry ) );
+}
+
+/** Sort a range of entries with a stable bottom up merge sort, starting with insertion sorted runs.
+  * @param context The sort task for the range, with the destination used as scratch space. The sorted entries end up in the source.
+  */
+static void sort_range( void* context )
+{
+    const SortTask*      task    = context;
+    const BitableSorter* sorter  = task->sorter;
+    SortEntry*           source  = task->source;
+    SortEntry*           scratch = task->destination;
+    size_t               width;
+    size_t               start;
+
+    for ( start = task->begin; start < task->end; start += BITABLE_SORT_INSERTION_SIZE )
+    {
+        size_t runEnd = start + BITABLE_SORT_INSERTION_SIZE < task->end ? start + BITABLE_SORT_INSERTION_SIZE : task->end;
+        size_t where;
+
+        for ( where = start + 1; where < runEnd; ++where )
+        {
+            SortEntry entry = source[ where ];
+            size_t    to    = where;
+
+            while ( to > start && compare_entries( sorter, source + to - 1, &entry ) > 0 )
+            {
+                source[ to ] = source[ to - 1 ];
+                --to;
+            }
+
+            source[ to ] = entry;
+        }
+    }
+
+    for ( width = BITABLE_SORT_INSERTION_SIZE; width < task->end - task->begin; width *= 2 )
+    {
+        SortEntry* swap;
+
+        for ( start = task->begin; start < task->end; start += width * 2 )
+        {
+            size_t middle = start + width < task->end ? start + width : task->end;
+            size_t end    = middle + width < task->end ? middle + width : task->end;
+
+            merge_ranges( sorter, source, scratch, start, middle, end );
+        }
+
+        swap    = source;
+        source  = scratch;
+        scratch = swap;
+    }
+
+    if ( source != task->source )
+    {
+        memcpy( task->source + task->begin, source + task->begin, ( task->end - task->begin ) * sizeof( SortEntry ) );
+    }
+}
+
+/** Merge the two ranges of a sort task.
+  * @param context The sort task.
+  */
+static void merge_task( void* context )
+{
+    const SortTask* task = context;
+
+    merge_ranges( task->sorter, task->source, task->destination, task->begin, task->middle, task->end );
+}
+
+/** Run a set of sort tasks on their own threads. The calling thread runs the first task, and any task that a thread couldn't be started for.
+  * @param function The function to run the tasks with.
+  * @param tasks The tasks.
+  * @param taskCount The number of tasks.
+  */
+static void run_tasks( BitableThreadFunction* function, SortTask* tasks, uint32_t taskCount )
+{
+    BitableThread** threads = calloc( taskCount, sizeof( BitableThread* ) );
+    uint32_t        where;
+
+    // without room to keep track of the threads, the calling thread runs every task.
+    if ( threads == NULL )
+    {
+        for ( where = 0; where < taskCount; ++where )
+        {
+            function( tasks + where );
+        }
+
+        return;
+    }
+
+    for ( where = 1; where < taskCount; ++where )
+    {
+        if ( bitable_thread_create( threads + where, function, tasks + where ) != BR_SUCCESS )
+        {
+            threads[ where ] = NULL;
+        }
+    }
+
+    function( tasks );
+
+    for ( where = 1; where < taskCount; ++where )
+    {
+        if ( threads[ where ] != NULL )
+        {
+            bitable_thread_join( threads[ where ] );
+        }
+        else
+        {
+            function( tasks + where );
+        }
+    }
+
+    free( threads );
+}
+
+/** Sort the buffer, then remove duplicate keys (keeping the entry added last). Slices of the buffer are sorted in parallel, then merged together
+  * in pairs, in parallel where there is more than one pair.
+  * @param sorter The sorter.
+  * @return BR_SUCCESS if the buffer was sorted, BR_ALLOCATION_FAILED if the scratch space for sorting couldn't be allocated (leaving the buffer unsorted).
+  */
+static BitableResult sort_buffer( BitableSorter* sorter )
+{
+    uint32_t   threadCount = sorter->options.threadCount > 0 ? sorter->options.threadCount : bitable_hardware_threads();
+    size_t     maxSlices   = sorter->entryCount / BITABLE_SORT_MIN_SLICE_SIZE + 1;
+    uint32_t   sliceCount  = threadCount < maxSlices ? threadCount : (uint32_t)maxSlices;
+    SortEntry* source      = sorter->entries;
+    SortEntry* destination = malloc( sorter->entryCapacity * sizeof( SortEntry ) );
+    size_t*    bounds      = malloc( ( sliceCount + 1 ) * sizeof( size_t ) );
+    SortTask*  tasks       = malloc( sliceCount * sizeof( SortTask ) );
+    size_t     kept        = 0;
+    size_t     where;
+    uint32_t   slice;
+
+    if ( destination == NULL || bounds == NULL || tasks == NULL )
+    {
+        free( destination );
+        free( bounds );
+        free( tasks );
+
+        return BR_ALLOCATION_FAILED;
+    }
+
+    for ( slice = 0; slice <= sliceCount; ++slice )
+    {
+        bounds[ slice ] = (size_t)( (uint64_t)sorter->entryCount * slice / sliceCount );
+    }
+
+    for ( slice = 0; slice < sliceCount; ++slice )
+    {
+        tasks[ slice ].sorter      = sorter;
+        tasks[ slice ].source      = source;
+        tasks[ slice ].destination = destination;
+        tasks[ slice ].begin       = bounds[ slice ];
+        tasks[ slice ].middle      = bounds[ slice ];
+        tasks[ slice ].end         = bounds[ slice + 1 ];
+    }
+
+    run_tasks( sort_range, tasks, sliceCount );
+
+    // merge the sorted slices in pairs until there is one left, an odd slice out is carried over to the next pass.
+    while ( sliceCount > 1 )
+    {
+        uint32_t   pairCount = sliceCount / 2;
+        SortEntry* swap;
+
+        for ( slice = 0; slice < pairCount; ++slice )
+        {
+            tasks[ slice ].sorter      = sorter;
+            tasks[ slice ].source      = source;
+            tasks[ slice ].destination = destination;
+            tasks[ slice ].begin       = bounds[ slice * 2 ];
+            tasks[ slice ].middle      = bounds[ slice * 2 + 1 ];
+            tasks[ slice ].end         = bounds[ slice * 2 + 2 ];
+        }
+
+        if ( ( sliceCount & 1 ) != 0 )
+        {
+            memcpy( destination + bounds[ sliceCount - 1 ], source + bounds[ sliceCount - 1 ], ( bounds[ sliceCount ] - bounds[ sliceCount - 1 ] ) * sizeof( SortEntry ) );
+        }
+
+        run_tasks( merge_task, tasks, pairCount );
+
+        for ( slice = 0; slice <= pairCount; ++slice )
+        {
+            bounds[ slice ] = bounds[ slice * 2 ];
+        }
+
+        bounds[ ( sliceCount + 1 ) / 2 ] = sorter->entryCount;
+
+        sliceCount = ( sliceCount + 1 ) / 2;
+        swap        = source;
+        source      = destination;
+        destination = swap;
+    }
+
+    sorter->entries = source;
+
+    free( destination );
+    free( bounds );
+    free( tasks );
+
+    // the sort is stable, so the last of a run of equal keys is the one added last.
+    for ( where = 0; where < sorter->entryCount; ++where )
+    {
+        if ( kept > 0 && compare_entries( sorter, sorter->entries + kept - 1, sorter->entries + where ) == 0 )
+        {
+            sorter->entries[ kept - 1 ] = sorter->entries[ where ];
+        }
+        else
+        {
+            sorter->entries[ kept++ ] = sorter->entries[ where ];
+        }
+    }
+
+    sorter->entryCount = kept;
+
+    return BR_SUCCESS;
+}
+
+/** Encode an unsigned integer as a varint, 7 bits at a time from the least significant, with the top bit of each byte set if more follow.
+  * @param [out] output Where to write the varint, with space for at least BITABLE_MAX_VARINT_SIZE bytes.
+  * @param value The value to encode.
+  * @return The number of bytes written.
+  */
+static size_t encode_varint( uint8_t* output, uint64_t value )
+{
+    size_t size = 0;
+
+    while ( value >= 0x80 )
+    {
+        output[ size++ ] = (uint8_t)( value | 0x80 );
+        value          >>= 7;
+    }
+
+    output[ size++ ] = (uint8_t)value;
+
+    return size;
+}
+
+/** Decode a varint written by encode_varint.
+  * @param [in,out] position The position of the varint, moved past it.
+  * @param end The end of the data the varint is in.
+  * @param [out] value The decoded value.
+  * @return Non-zero if the varint was decoded, zero if it runs past the end of the data.
+  */
+static int decode_varint( const uint8_t** position, const uint8_t* end, uint64_t* value )
+{
+    const uint8_t* at    = *position;
+    uint64_t       read  = 0;
+    uint32_t       shift = 0;
+
+    while ( at < end && shift < 64 )
+    {
+        uint8_t byte = *at++;
+
+        read |= (uint64_t)( byte & 0x7F ) << shift;
+
+        if ( ( byte & 0x80 ) == 0 )
+        {
+            *position = at;
+            *value    = read;
+
+            return 1;
+        }
+
+        shift += 7;
+    }
+
+    return 0;
+}
+
+/** Rebuild a fixed width key from its ordered value (the inverse of bitable_key_ordered).
+  * @param keyKind The key kind, should be a fixed width kind.
+  * @param ordered The ordered value of the key.
+  * @param [out] output Where to write the key.
+  */
+static void key_from_ordered( BitableKeyKind keyKind, uint64_t ordered, uint8_t* output )
+{
+    uint32_t value32;
+    uint64_t value64;
+
+    switch ( keyKind )
+    {
+    case BKK_INT32_LE:
+    case BKK_UINT32_LE:
+
+        value32 = (uint32_t)( keyKind == BKK_INT32_LE ? ordered ^ 0x80000000U : ordered );
+        value32 = BITABLE_BIG_ENDIAN ? BITABLE_BSWAP32( value32 ) : value32;
+
+        memcpy( output, &value32, sizeof( uint32_t ) );
+        break;
+
+    case BKK_UINT32_BE:
+
+        value32 = (uint32_t)ordered;
+        value32 = BITABLE_BIG_ENDIAN ? value32 : BITABLE_BSWAP32( value32 );
+
+        memcpy( output, &value32, sizeof( uint32_t ) );
+        break;
+
+    case BKK_UINT64_BE:
+
+        value64 = BITABLE_BIG_ENDIAN ? ordered : BITABLE_BSWAP64( ordered );
+
+        memcpy( output, &value64, sizeof( uint64_t ) );
+        break;
+
+    case BKK_FLOAT64:
+
+        // positive values had the sign bit set, negative values had all their bits flipped.
+        value64 = ( ordered & 0x8000000000000000ULL ) != 0 ? ( ordered & ~0x8000000000000000ULL ) : ~ordered;
+        value64 = BITABLE_BIG_ENDIAN ? BITABLE_BSWAP64( value64 ) : value64;
+
+        memcpy( output, &value64, sizeof( uint64_t ) );
+        break;
+
+    default:
+
+        value64 = keyKind == BKK_INT64_LE ? ordered ^ 0x8000000000000000ULL : ordered;
+        value64 = BITABLE_BIG_ENDIAN ? BITABLE_BSWAP64( value64 ) : value64;
+
+        memcpy( output, &value64, sizeof( uint64_t ) );
+        break;
+    }
+}
+
+/** Create the next run file.
+  * @param sorter The sorter.
+  * @param [out] writer The writer for the run.
+  * @return BR_SUCCESS if the run file was created, otherwise the error from creating it.
+  */
+static BitableResult begin_run( BitableSorter* sorter, RunWriter* writer )
+{
+    BitableResult result = bitable_wf_create_buffered( &writer->file, run_path( sorter, sorter->nextRun ), sorter->options.writeBufferSize );
+
+    writer->run             = sorter->nextRun;
+    writer->previousOrdered = 0;
+    writer->previousSize    = 0;
+
+    return result;
+}
+
+/** Write a pair to a run file. Each record in a run starts with a header of varints, then the key bytes, then the value. For fixed width keys, the header is
+  * the difference of the key's ordered value from the previous key's (and no key bytes are written). For other keys, it is the size of the prefix shared 
+  * with the previous key and the size of the rest of the key (which is all that's written). The header ends with the value size.
+  * @param sorter The sorter.
+  * @param writer The run being written.
+  * @param ordered The ordered value of the key.
+  * @param key The key, which should come after the previous key in the run.
+  * @param value The value.
+  * @return BR_SUCCESS if the pair was written, otherwise the error from the failing file operation.
+  */
+static BitableResult write_record( const BitableSorter* sorter, RunWriter* writer, uint64_t ordered, const BitableValue* key, const BitableValue* value )
+{
+    const uint8_t* keyData = key->data;
+    uint8_t        header[ BITABLE_MAX_VARINT_SIZE * 3 ];
+    size_t         headerSize;
+    int32_t        shared  = 0;
+    BitableValue   fragments[ 3 ];
+
+    if ( sorter->keySize > 0 )
+    {
+        headerSize = encode_varint( header, ordered - writer->previousOrdered );
+        shared     = key->size;
+    }
+    else
+    {
+        int32_t sharedLimit = writer->previousSize < key->size ? writer->previousSize : key->size;
+
+        while ( shared < sharedLimit && writer->previousKey[ shared ] == keyData[ shared ] )
+        {
+            ++shared;
+        }
+
+        headerSize  = encode_varint( header, (uint64_t)shared );
+        headerSize += encode_varint( header + headerSize, (uint64_t)( key->size - shared ) );
+
+        memcpy( writer->previousKey + shared, keyData + shared, key->size - shared );
+    }
+
+    headerSize += encode_varint( header + headerSize, (uint64_t)value->size );
+
+    writer->previousOrdered = ordered;
+    writer->previousSize    = key->size;
+
+    fragments[ 0 ].data = header;
+    fragments[ 0 ].size = (int32_t)headerSize;
+    fragments[ 1 ].data = keyData + shared;
+    fragments[ 1 ].size = key->size - shared;
+    fragments[ 2 ].data = value->data;
+    fragments[ 2 ].size = value->size;
+
+    return bitable_wf_write_gather( writer->file, fragments, 3 );
+}
+
+/** Close a run file, deleting it if writing it failed.
+  * @param sorter The sorter.
+  * @param writer The run being written.
+  * @param result The result of writing the run.
+  * @return BR_SUCCESS if the run was written and closed, otherwise the error from writing or closing it.
+  */
+static BitableResult end_run( BitableSorter* sorter, RunWriter* writer, BitableResult result )
+{
+    BitableResult closeResult = bitable_wf_close( writer->file );
+
+    result = result == BR_SUCCESS ? closeResult : result;
+
+    if ( result != BR_SUCCESS )
+    {
+        bitable_wf_delete( run_path( sorter, writer->run ) );
+
+        return result;
+    }
+
+    ++sorter->nextRun;
+
+    return BR_SUCCESS;
+}
+
+/** Sort the buffer and write it out as a run file (see write_record), then empty the buffer. If the run can't be written, the buffer is left as it is.
+  * @param sorter The sorter.
+  * @return BR_SUCCESS if the run was written, BR_ALLOCATION_FAILED if there wasn't the memory to sort and track it, otherwise the error from the failing 
+  *         file operation.
+  */
+static BitableResult spill_run( BitableSorter* sorter )
+{
+    RunWriter*    writer;
+    BitableResult result;
+    size_t        where;
+
+    // make room to track the run up front, so a run that has been written can't be lost.
+    if ( sorter->runCount == sorter->runCapacity )
+    {
+        uint32_t  capacity = sorter->runCapacity > 0 ? sorter->runCapacity * 2 : 16;
+        uint32_t* runs     = realloc( sorter->runs, capacity * sizeof( uint32_t ) );
+
+        if ( runs == NULL )
+        {
+            return BR_ALLOCATION_FAILED;
+        }
+
+        sorter->runs        = runs;
+        sorter->runCapacity = capacity;
+    }
+
+    writer = malloc( sizeof( RunWriter ) );
+
+    if ( writer == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    result = sort_buffer( sorter );
+
+    if ( result == BR_SUCCESS )
+    {
+        result = begin_run( sorter, writer );
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        for ( where = 0; where < sorter->entryCount && result == BR_SUCCESS; ++where )
+        {
+            const SortEntry* entry = sorter->entries + where;
+            BitableValue     key;
+            BitableValue     value;
+
+            key.data   = entry->data;
+            key.size   = entry->keySize;
+            value.data = entry->data + entry->keySize;
+            value.size = entry->valueSize;
+
+            result = write_record( sorter, writer, entry->ordered, &key, &value );
+        }
+
+        result = end_run( sorter, writer, result );
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        sorter->runs[ sorter->runCount++ ] = writer->run;
+
+        reset_buffer( sorter );
+    }
+
+    free( writer );
+
+    return result;
+}
+
+/** Move a merge source on to its next pair.
+  * @param sorter The sorter.
+  * @param source The source to move.
+  */
+static void advance_source( const BitableSorter* sorter, SortSource* source )
+{
+    uint64_t shared;
+    uint64_t suffixSize;
+    uint64_t valueSize;
+
+    if ( source->file.address == NULL )
+    {
+        source->valid = source->entry < source->entryEnd;
+
+        if ( source->valid )
+        {
+            source->ordered    = source->entry->ordered;
+            source->key.data   = source->entry->data;
+            source->key.size   = source->entry->keySize;
+            source->value.data = source->entry->data + source->entry->keySize;
+            source->value.size = source->entry->valueSize;
+
+            ++source->entry;
+        }
+
+        return;
+    }
+
+    source->valid = 0;
+
+    if ( source->position >= source->end )
+    {
+        return;
+    }
+
+    if ( sorter->keySize > 0 )
+    {
+        uint64_t difference;
+
+        if ( !decode_varint( &source->position, source->end, &difference ) || 
+             !decode_varint( &source->position, source->end, &valueSize ) ||
+             valueSize > (uint64_t)( source->end - source->position ) )
+        {
+            return;
+        }
+
+        source->ordered += difference;
+
+        key_from_ordered( sorter->options.keyKind, source->ordered, source->keyBuffer );
+
+        source->key.size = sorter->keySize;
+    }
+    else
+    {
+        if ( !decode_varint( &source->position, source->end, &shared ) || 
+             !decode_varint( &source->position, source->end, &suffixSize ) ||
+             !decode_varint( &source->position, source->end, &valueSize ) ||
+             shared > (uint64_t)source->key.size ||
+             shared + suffixSize > BITABLE_MAX_KEY_SIZE ||
+             suffixSize + valueSize > (uint64_t)( source->end - source->position ) )
+        {
+            return;
+        }
+
+        // the shared prefix is still in the key buffer from the previous key.
+        memcpy( source->keyBuffer + shared, source->position, (size_t)suffixSize );
+
+        source->position += suffixSize;
+        source->key.size  = (int32_t)( shared + suffixSize );
+        source->ordered   = sorter->options.keyKind == BKK_MEMCMP ? bitable_key_prefix( &source->key ) : 0;
+    }
+
+    source->value.data  = source->position;
+    source->value.size  = (int32_t)valueSize;
+    source->position   += valueSize;
+    source->valid       = 1;
+}
+
+/** Check if one merge source comes before another. Exhausted sources lose to everything, and on equal keys the newer source wins.
+  * @param merge The merge.
+  * @param left The index of the left source.
+  * @param right The index of the right source.
+  * @return Non-zero if the left source beats the right one.
+  */
+static int source_beats( const SortMerge* merge, uint32_t left, uint32_t right )
+{
+    const SortSource* leftSource  = merge->sources + left;
+    const SortSource* rightSource = merge->sources + right;
+    int               comparison;
+
+    if ( !leftSource->valid )
+    {
+        return 0;
+    }
+
+    if ( !rightSource->valid )
+    {
+        return 1;
+    }
+
+    comparison = compare_keys( merge->sorter, leftSource->ordered, &leftSource->key, rightSource->ordered, &rightSource->key );
+
+    return comparison != 0 ? comparison < 0 : left > right;
+}
+
+/** Build a subtree of the loser tree, recording the loser at each internal node.
+  * @param merge The merge.
+  * @param node The root node of the subtree.
+  * @return The winning source of the subtree.
+  */
+static uint32_t build_merge_tree( SortMerge* merge, uint32_t node )
+{
+    uint32_t left;
+    uint32_t right;
+
+    if ( node >= merge->count )
+    {
+        return node - merge->count;
+    }
+
+    left  = build_merge_tree( merge, node * 2 );
+    right = build_merge_tree( merge, node * 2 + 1 );
+
+    if ( source_beats( merge, left, right ) )
+    {
+        merge->tree[ node ] = right;
+        return left;
+    }
+
+    merge->tree[ node ] = left;
+    return right;
+}
+
+/** Move the winning source of the merge on, and replay its matches to the root.
+  * @param merge The merge.
+  */
+static void advance_merge( SortMerge* merge )
+{
+    uint32_t winner = merge->tree[ 0 ];
+    uint32_t source = winner;
+    uint32_t node;
+
+    advance_source( merge->sorter, merge->sources + source );
+
+    for ( node = ( source + merge->count ) >> 1; node > 0; node >>= 1 )
+    {
+        if ( source_beats( merge, merge->tree[ node ], winner ) )
+        {
+            uint32_t loser = winner;
+
+            winner              = merge->tree[ node ];
+            merge->tree[ node ] = loser;
+        }
+    }
+
+    merge->tree[ 0 ] = winner;
+}
+
+/** Merge a range of the run files (and optionally the sorted buffer) into a table or a new run file, keeping only the newest pair for each key.
+  * @param sorter The sorter.
+  * @param firstRun The index in the run list of the oldest run to merge.
+  * @param runCount The number of runs to merge, in age order from the first.
+  * @param withBuffer Non-zero to merge the sorted buffer too, as the newest source.
+  * @param table The table to append to, or NULL to write to a run file.
+  * @param writer The run file to write to, if table is NULL.
+  * @return BR_SUCCESS if the pairs were merged, BR_FILE_OPEN_FAILED or BR_FILE_OPERATION_FAILED if a run file couldn't be mapped or written, 
+  *         BR_ALLOCATION_FAILED if the merge couldn't be allocated, otherwise the error from appending to the table.
+  */
+static BitableResult merge_runs( BitableSorter* sorter, uint32_t firstRun, uint32_t runCount, int withBuffer, BitableWritable* table, RunWriter* writer )
+{
+    SortMerge     merge;
+    uint8_t       lastKey[ BITABLE_MAX_KEY_SIZE ];
+    BitableResult result = BR_SUCCESS;
+    uint32_t      where;
+
+    merge.sorter  = sorter;
+    merge.count   = runCount + 1;
+    merge.sources = calloc( merge.count, sizeof( SortSource ) );
+    merge.tree    = calloc( merge.count, sizeof( uint32_t ) );
+
+    if ( merge.sources == NULL || merge.tree == NULL )
+    {
+        free( merge.sources );
+        free( merge.tree );
+
+        return BR_ALLOCATION_FAILED;
+    }
+
+    // runs are the older sources, in the order they were spilled, and the buffer is the newest.
+    for ( where = 0; where < runCount && result == BR_SUCCESS; ++where )
+    {
+        SortSource* source = merge.sources + where;
+
+        result = bitable_mmf_open( &source->file, run_path( sorter, sorter->runs[ firstRun + where ] ), BRO_SEQUENTIAL );
+
+        if ( result == BR_SUCCESS )
+        {
+            source->position = source->file.address;
+            source->end      = source->position + source->file.size;
+            source->key.data = source->keyBuffer;
+
+            advance_source( sorter, source );
+        }
+        else
+        {
+            source->file.address = NULL;
+        }
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        SortSource* buffer = merge.sources + runCount;
+
+        buffer->entry    = sorter->entries;
+        buffer->entryEnd = sorter->entries + ( withBuffer ? sorter->entryCount : 0 );
+
+        advance_source( sorter, buffer );
+
+        merge.tree[ 0 ] = build_merge_tree( &merge, 1 );
+
+        while ( merge.sources[ merge.tree[ 0 ] ].valid )
+        {
+            SortSource*  winner      = merge.sources + merge.tree[ 0 ];
+            uint64_t     lastOrdered = winner->ordered;
+            BitableValue last;
+
+            if ( table != NULL )
+            {
+                result = bitable_append( table, &winner->key, &winner->value );
+            }
+            else
+            {
+                result = write_record( sorter, writer, winner->ordered, &winner->key, &winner->value );
+            }
+
+            if ( result != BR_SUCCESS )
+            {
+                break;
+            }
+
+            // the winner's key is overwritten when it moves on, so keep a copy to skip the older duplicates of it.
+            memcpy( lastKey, winner->key.data, winner->key.size );
+
+            last.data = lastKey;
+            last.size = winner->key.size;
+
+            do
+            {
+                advance_merge( &merge );
+                winner = merge.sources + merge.tree[ 0 ];
+            } 
+            while ( winner->valid && compare_keys( sorter, winner->ordered, &winner->key, lastOrdered, &last ) == 0 );
+        }
+    }
+
+    for ( where = 0; where < runCount; ++where )
+    {
+        if ( merge.sources[ where ].file.address != NULL )
+        {
+            bitable_mmf_close( &merge.sources[ where ].file );
+        }
+    }
+
+    free( merge.sources );
+    free( merge.tree );
+
+    return result;
+}
+
+/** Merge the runs a level at a time, until there are few enough to merge at once (BITABLE_SORT_MAX_FAN_IN). Each level merges disjoint groups of up to
+  * BITABLE_SORT_MAX_FAN_IN runs, oldest first, into single runs that take their places, so every run is read once per level.
+  * @param sorter The sorter.
+  * @return BR_SUCCESS if the runs were merged, BR_ALLOCATION_FAILED if there wasn't the memory for a merge, otherwise the error from reading or 
+  *         writing a run file. The runs not merged yet are kept either way.
+  */
+static BitableResult compact_runs( BitableSorter* sorter )
+{
+    RunWriter*    writer = malloc( sizeof( RunWriter ) );
+    BitableResult result = BR_SUCCESS;
+    uint32_t      where;
+
+    if ( writer == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    while ( sorter->runCount > BITABLE_SORT_MAX_FAN_IN && result == BR_SUCCESS )
+    {
+        uint32_t first  = 0;
+        uint32_t merged = 0; // the runs of the next level are gathered at the front of the run list, in age order
+
+        while ( first < sorter->runCount )
+        {
+            uint32_t groupSize = sorter->runCount - first < BITABLE_SORT_MAX_FAN_IN ? sorter->runCount - first : BITABLE_SORT_MAX_FAN_IN;
+
+            // a run left over on its own goes to the next level as it is.
+            if ( groupSize == 1 )
+            {
+                sorter->runs[ merged++ ] = sorter->runs[ first++ ];
+                continue;
+            }
+
+            result = begin_run( sorter, writer );
+
+            if ( result == BR_SUCCESS )
+            {
+                result = merge_runs( sorter, first, groupSize, 0, NULL, writer );
+                result = end_run( sorter, writer, result );
+            }
+
+            if ( result != BR_SUCCESS )
+            {
+                break;
+            }
+
+            for ( where = first; where < first + groupSize; ++where )
+            {
+                bitable_wf_delete( run_path( sorter, sorter->runs[ where ] ) );
+            }
+
+            sorter->runs[ merged++ ] = writer->run;
+
+            first += groupSize;
+        }
+
+        // on failure, the runs that weren't merged follow the ones that were.
+        memmove( sorter->runs + merged, sorter->runs + first, ( sorter->runCount - first ) * sizeof( uint32_t ) );
+
+        sorter->runCount = merged + ( sorter->runCount - first );
+    }
+
+    free( writer );
+
+    return result;
+}
+
+void bitable_sort_default_options( BitableSortOptions* options )
+{
+    memset( options, 0, sizeof( BitableSortOptions ) );
+
+    options->keyKind         = BKK_CUSTOM;
+    options->memoryBudget    = 256 * 1024 * 1024;
+    options->writeBufferSize = 1024 * 1024;
+}
+
+BitableResult bitable_sort_create( BitableSorter** sorter, const char* scratchPath, const BitableSortOptions* options )
+{
+    BitableSorter* created;
+
+    if ( (uint32_t)options->keyKind >= BKK_COUNT || ( options->keyKind == BKK_CUSTOM && options->comparison == NULL ) )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
+
+    if ( options->memoryBudget < BITABLE_SORT_MIN_MEMORY_BUDGET )
+    {
+        return BR_MEMORY_BUDGET_INVALID;
+    }
+
+    created = calloc( 1, sizeof( BitableSorter ) );
+
+    if ( created == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    created->options     = *options;
+    created->keySize     = bitable_key_kind_size( options->keyKind );
+    created->scratchPath = malloc( strlen( scratchPath ) + 1 );
+    created->runPath     = malloc( strlen( scratchPath ) + 16 );
+    created->blockSize   = options->memoryBudget / 16;
+    created->blockSize   = created->blockSize < BITABLE_SORT_MIN_BLOCK_SIZE ? BITABLE_SORT_MIN_BLOCK_SIZE : created->blockSize;
+    created->blockSize   = created->blockSize > BITABLE_SORT_BLOCK_SIZE ? BITABLE_SORT_BLOCK_SIZE : created->blockSize;
+
+    if ( created->scratchPath == NULL || created->runPath == NULL )
+    {
+        bitable_sort_free( created );
+
+        return BR_ALLOCATION_FAILED;
+    }
+
+    strcpy( created->scratchPath, scratchPath );
+
+    *sorter = created;
+
+    return BR_SUCCESS;
+}
+
+void bitable_sort_free( BitableSorter* sorter )
+{
+    delete_runs( sorter );
+    reset_buffer( sorter );
+
+    free( sorter->entries );
+    free( sorter->runs );
+    free( sorter->scratchPath );
+    free( sorter->runPath );
+    free( sorter );
+}
+
+BitableResult bitable_sort_add( BitableSorter* sorter, const BitableValue* key, const BitableValue* value )
+{
+    SortBlock*    block;
+    SortEntry*    entry;
+    uint8_t*      data;
+    size_t        size;
+    BitableResult result;
+
+    if ( key->size < 0 || key->size > BITABLE_MAX_KEY_SIZE || ( sorter->keySize > 0 && key->size != sorter->keySize ) )
+    {
+        return BR_KEY_INVALID;
+    }
+
+    if ( value->size < 0 )
+    {
+        return BR_VALUE_INVALID;
+    }
+
+    size = (size_t)key->size + (size_t)value->size;
+
+    // when memory runs out before the budget does, the buffer is spilled early (freeing its blocks and emptying its entries) and the allocation retried.
+    if ( sorter->entryCount == sorter->entryCapacity )
+    {
+        size_t     capacity = sorter->entryCapacity > 0 ? sorter->entryCapacity * 2 : 1024;
+        SortEntry* entries  = realloc( sorter->entries, capacity * sizeof( SortEntry ) );
+
+        if ( entries != NULL )
+        {
+            sorter->entries       = entries;
+            sorter->entryCapacity = capacity;
+        }
+        else if ( sorter->entryCount == 0 )
+        {
+            return BR_ALLOCATION_FAILED;
+        }
+        else
+        {
+            result = spill_run( sorter );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+        }
+    }
+
+    block = sorter->blocks;
+
+    // pairs larger than a block get a block of their own.
+    if ( block == NULL || block->size - block->used < size )
+    {
+        size_t blockSize = size > sorter->blockSize ? size : sorter->blockSize;
+
+        block = malloc( sizeof( SortBlock ) + blockSize );
+
+        if ( block == NULL && sorter->entryCount > 0 )
+        {
+            result = spill_run( sorter );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+
+            block = malloc( sizeof( SortBlock ) + blockSize );
+        }
+
+        if ( block == NULL )
+        {
+            return BR_ALLOCATION_FAILED;
+        }
+
+        block->next = sorter->blocks;
+        block->size = blockSize;
+        block->used = 0;
+
+        sorter->blocks      = block;
+        sorter->memoryUsed += blockSize;
+    }
+
+    data = (uint8_t*)( block + 1 ) + block->used;
+
+    memcpy( data, key->data, key->size );
+    memcpy( data + key->size, value->data, value->size );
+
+    block->used        += size;
+    sorter->memoryUsed += sizeof( SortEntry ) * 2;
+
+    entry            = sorter->entries + sorter->entryCount++;
+    entry->data      = data;
+    entry->keySize   = key->size;
+    entry->valueSize = value->size;
+
+    switch ( sorter->options.keyKind )
+    {
+    case BKK_CUSTOM:
+
+        entry->ordered = 0;
+        break;
+
+    case BKK_MEMCMP:
+
+        entry->ordered = bitable_key_prefix( key );
+        break;
+
+    default:
+
+        entry->ordered = bitable_key_ordered( sorter->options.keyKind, data );
+        break;
+    }
+
+    if ( sorter->memoryUsed >= sorter->options.memoryBudget )
+    {
+        return spill_run( sorter );
+    }
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_sort_finish( BitableSorter* sorter, BitableWritable* table )
+{
+    BitableResult result = BR_SUCCESS;
+
+    if ( sorter->entryCount > 0 )
+    {
+        result = sort_buffer( sorter );
+    }
+
+    if ( sorter->runCount > BITABLE_SORT_MAX_FAN_IN && result == BR_SUCCESS )
+    {
+        result = compact_runs( sorter );
+    }
+
+    if ( sorter->runCount > 0 && result == BR_SUCCESS )
+    {
+        result = merge_runs( sorter, 0, sorter->runCount, 1, table, NULL );
+    }
+    else if ( result == BR_SUCCESS )
+    {
+        BitableValue keys[ BITABLE_SORT_APPEND_BATCH ];
+        BitableValue values[ BITABLE_SORT_APPEND_BATCH ];
+        size_t       first;
+
+        // everything fit in memory, so the sorted buffer is appended straight to the table.
+        for ( first = 0; first < sorter->entryCount && result == BR_SUCCESS; first += BITABLE_SORT_APPEND_BATCH )
+        {
+            size_t count = sorter->entryCount - first < BITABLE_SORT_APPEND_BATCH ? sorter->entryCount - first : BITABLE_SORT_APPEND_BATCH;
+            size_t where;
+
+            for ( where = 0; where < count; ++where )
+            {
+                const SortEntry* entry = sorter->entries + first + where;
+
+                keys[ where ].data   = entry->data;
+                keys[ where ].size   = entry->keySize;
+                values[ where ].data = entry->data + entry->keySize;
+                values[ where ].size = entry->valueSize;
+            }
+
+            result = bitable_append_batch( table, keys, values, count );
+        }
+    }
+
+    delete_runs( sorter );
+    reset_buffer( sorter );
+
+    return result;
+}
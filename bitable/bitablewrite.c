@@ -26,6 +26,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "bitablewrite.h"
 #include "bitableshared.h"
 #include "writablefile.h"
+#include "memorymappedfile.h"
+#include "thread.h"
 #include <memory.h>
 #include <assert.h>
 
@@ -33,7 +35,8 @@ typedef struct BufferedFile
 {
 
     BitableWritableFile* file;
-    uint8_t* buffer;
+    uint8_t* buffer; // the page being filled, either the page allocation or space reserved in the file when pages are packed in place
+    uint8_t* allocation; // the page buffer allocated for the file (NULL when pages are packed in place)
 
 } BufferedFile;
 
@@ -44,9 +47,10 @@ typedef struct LeafLevel
     BufferedFile bufferedFile;
     uint64_t* initialIndice;
     int32_t* itemCount; // the number of items in the current node.
-    BitableLeafIndice* itemIndices;
+    uint8_t* itemIndices;
     uint16_t leftSize; // amount that has been allocated on the left of the node in memory (header and index into node key/data table)
     uint16_t rightSize; // amount that has been allocated on the right of the node in memory (node key/data table)
+    int unbranchedPage; // the current node was started for an item that was never committed, so is still empty and not yet in the branch level
 
 } LeafLevel;
 
@@ -57,12 +61,72 @@ typedef struct BranchLevel
     BufferedFile bufferedFile;
     uint64_t* initialChildPage;
     uint16_t* itemCount; // the number of items in the current node.
-    BitableBranchIndice* childIndices;
+    uint8_t* childIndices;
     uint16_t leftSize; // amount that has been allocated on the left of the node in memory (header and index into node key/data table)
     uint16_t rightSize; // amount that has been allocated on the right of the node in memory (node key/data table)
 
 } BranchLevel;
 
+/* The number of bytes of leaf pages packed by each thread in a round of a parallel append */
+#define BITABLE_PARALLEL_SLICE_SIZE ( 8 * 1024 * 1024 )
+
+/* The maximum number of bytes of leaf pages packed in a round of a parallel append (there are two rounds in flight), slices shrink to fit with many threads */
+#define BITABLE_PARALLEL_ROUND_SIZE ( 64 * 1024 * 1024 )
+
+/* The maximum number of threads packing pages in a parallel append, which also keeps the pages in a round within 32 bits */
+#define BITABLE_PARALLEL_MAX_THREADS 64
+
+/** Where the value of an item reserved for appending is being written, when it is a large value.
+  */
+typedef enum PendingLargeValue
+{
+    PLV_NONE     = 0, // the value isn't a large value (or it has already been written)
+    PLV_RESERVED = 1, // the value is being written in place in the large value store
+    PLV_STAGED   = 2  // the value is being written to the staging buffer, to be written to the large value store when it's committed
+
+} PendingLargeValue;
+
+/** An item reserved in the current leaf page by bitable_append_reserve, waiting for bitable_append_commit.
+  */
+typedef struct PendingItem
+{
+
+    int reserved; // there is a reserved item
+    int startsPage; // the item starts a new leaf page, which gets added to the branch level when the key is committed
+    uint16_t keyOffset; // the offset of the key in the leaf page
+    uint16_t leftSize; // the leaf page allocation on the left, including the item
+    uint16_t rightSize; // the leaf page allocation on the right, including the item
+    uint16_t keySize;
+    int32_t dataSize;
+    PendingLargeValue largeValue;
+    uint64_t largeValueOffset; // the offset of a large value in the large value store
+
+} PendingItem;
+
+/** The start of a leaf page in a parallel append, worked out before the page is packed.
+  */
+typedef struct ParallelPage
+{
+
+    size_t firstItem; // the first item in the page
+    uint64_t largeValueStart; // the size of the large value store before the page's large values
+
+} ParallelPage;
+
+/** A slice of the leaf pages in a round of a parallel append, packed by one thread.
+  */
+typedef struct ParallelSlice
+{
+
+    const struct BitableWritable* table;
+    const BitableValue* keys;
+    const BitableValue* data;
+    const ParallelPage* pages; // the starts of the pages in the slice, followed by the start of the page after the slice
+    uint32_t pageCount;
+    uint8_t* output; // where the pages are packed
+
+} ParallelSlice;
+
 typedef struct BitableWritable
 {
 
@@ -75,16 +139,98 @@ typedef struct BitableWritable
     BitablePaths paths;
 
     uint32_t depth;
+    uint32_t writeBufferSize; // the size of the write combining buffer for each file
+    uint32_t writeQueueDepth; // the number of asynchronous writes in flight for the leaf and large value files (0 for synchronous writes)
+    uint32_t writeFileFlags; // BitableWritableFileFlags for the leaf and large value files
     uint16_t pageSize;
     uint16_t keyAlignment;
     uint16_t valueAlignment;
+    uint32_t formatFlags;
+    BitableKeyKind keyKind;
+    int32_t keySize; // the size of keys for fixed width key kinds (0 for variable)
+    uint16_t leafHeaderSize; // size of the leaf page header before the indices
+    uint16_t leafIndiceSize; // size of each indice in a leaf page
+    uint16_t branchHeaderSize; // size of the branch page header before the indices
+    uint16_t branchIndiceSize; // size of each indice in a branch page
+
+    uint32_t bloomBitsPerKey; // bloom filter bits per key (0 if there is no bloom filter)
+    uint32_t bloomHashCount; // number of bits set per key in the bloom filter
+    uint64_t bloomBlockCount; // number of blocks in the bloom filter (0 while it is yet to be sized)
+    uint64_t* bloomBlocks; // the bloom filter, when it is built while appending
+    uint64_t* bloomHashes; // buffered key hashes, when the bloom filter is built at close
+    uint64_t bloomHashCapacity; // the capacity of the key hash buffer
+
+    PendingItem pending; // the item reserved for appending in place
+    uint8_t* largeValueStaging; // staging buffer for reserved large values that don't fit in the large value store's write buffer
+    uint32_t largeValueStagingSize; // the capacity of the staging buffer
 
 } BitableWritable;
 
 
-static BitableResult create_buffered_file( BufferedFile* bufferedFile, const char* path, uint16_t pageSize )
+/** Get the options used to create the leaf file and large value store of a table.
+  * @param table The table being written.
+  * @param [out] fileOptions The options to create the files with.
+  */
+static void data_file_options( const BitableWritable* table, BitableWritableFileOptions* fileOptions )
+{
+    fileOptions->bufferSize = table->writeBufferSize;
+    fileOptions->queueDepth = table->writeQueueDepth;
+    fileOptions->flags      = table->writeFileFlags;
+}
+
+/** Start filling a new page of a buffered file. When pages are packed in place the page is reserved in the file, otherwise the page buffer is reused.
+  * @param bufferedFile The file to start a page in.
+  * @param pageSize The size of the page.
+  * @return BR_SUCCESS if the page was started, otherwise the error from reserving space in the file.
+  */
+static BitableResult begin_page( BufferedFile* bufferedFile, uint16_t pageSize )
+{
+    BitableResult result;
+    void*         page;
+
+    if ( bufferedFile->allocation != NULL )
+    {
+        return BR_SUCCESS;
+    }
+
+    result = bitable_wf_reserve( bufferedFile->file, pageSize, &page );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    bufferedFile->buffer = page;
+
+    return BR_SUCCESS;
+}
+
+/** Write out the page being filled in a buffered file (when pages are packed in place, it is already in the file and just needs committing).
+  * @param bufferedFile The file to write the page of.
+  * @param pageSize The size of the page.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+static BitableResult write_page( BufferedFile* bufferedFile, uint16_t pageSize )
+{
+    if ( bufferedFile->allocation == NULL )
+    {
+        return bitable_wf_commit( bufferedFile->file, pageSize );
+    }
+
+    return bitable_wf_write( bufferedFile->file, bufferedFile->buffer, pageSize );
+}
+
+/** Create a file written a page at a time.
+  * @param bufferedFile The buffered file to create.
+  * @param path The path of the file.
+  * @param pageSize The size of the pages.
+  * @param fileOptions The options to create the file with.
+  * @param packInPlace Non-zero to fill pages in space reserved in a memory mapped file, instead of in a page buffer. Only used when the file is actually memory mapped (see bitable_wf_is_mapped).
+  * @return A return code indicating either success, or the reason for failure.
+  */
+static BitableResult create_buffered_file( BufferedFile* bufferedFile, const char* path, uint16_t pageSize, const BitableWritableFileOptions* fileOptions, int packInPlace )
 {
-    BitableResult result = bitable_wf_create( &bufferedFile->file, path );
+    BitableResult result = bitable_wf_create_with_options( &bufferedFile->file, path, fileOptions );
 
     if ( result != BR_SUCCESS )
     {
@@ -92,19 +238,37 @@ static BitableResult create_buffered_file( BufferedFile* bufferedFile, const cha
         return result;
     }
 
-    bufferedFile->buffer = calloc( pageSize, sizeof( uint8_t ) );
+    // pages are only packed in place when the file really is mapped, as a write buffer may be smaller than a page (or not there at all).
+    if ( packInPlace && bitable_wf_is_mapped( bufferedFile->file ) )
+    {
+        bufferedFile->allocation = NULL;
+
+        return begin_page( bufferedFile, pageSize );
+    }
+
+    bufferedFile->allocation = calloc( pageSize, sizeof( uint8_t ) );
+    bufferedFile->buffer     = bufferedFile->allocation;
+
+    if ( bufferedFile->allocation == NULL )
+    {
+        bitable_wf_close( bufferedFile->file );
+        bufferedFile->file = NULL;
+        return BR_ALLOCATION_FAILED;
+    }
 
     return BR_SUCCESS;
 }
 
 static void cleanup_buffered( BufferedFile* bufferedFile )
 {
-    if ( bufferedFile->buffer != NULL )
+    if ( bufferedFile->allocation != NULL )
     {
-        free( bufferedFile->buffer );
-        bufferedFile->buffer = NULL;
+        free( bufferedFile->allocation );
+        bufferedFile->allocation = NULL;
     }
 
+    bufferedFile->buffer = NULL;
+
     if ( bufferedFile->file != NULL )
     {
         bitable_wf_close( bufferedFile->file );
@@ -112,10 +276,288 @@ static void cleanup_buffered( BufferedFile* bufferedFile )
     }
 }
 
+/** Get the number of bloom filter blocks to use for a number of items.
+  * @param itemCount The number of items to put in the filter.
+  * @param bitsPerKey The number of bloom filter bits per key.
+  * @return The number of blocks.
+  */
+static uint64_t bloom_block_count( uint64_t itemCount, uint32_t bitsPerKey )
+{
+    const uint64_t blockBits  = BITABLE_BLOOM_BLOCK_SIZE * 8;
+    uint64_t       blockCount = ( itemCount * bitsPerKey + ( blockBits - 1 ) ) / blockBits;
+
+    return blockCount > 0 ? blockCount : 1;
+}
+
+/** Make room in the key hash buffer for items about to be appended, when the bloom filter is yet to be sized.
+  * Called before the items are placed, so a failure leaves the table as it was.
+  * @param table The table being appended to.
+  * @param count The number of items about to be appended.
+  * @return BR_SUCCESS if there is room for the items' hashes, BR_ALLOCATION_FAILED if the buffer couldn't be grown.
+  */
+static BitableResult bloom_reserve( BitableWritable* table, uint64_t count )
+{
+    uint64_t  capacity = table->bloomHashCapacity;
+    uint64_t* hashes;
+
+    if ( table->bloomBitsPerKey == 0 || table->bloomBlocks != NULL || table->itemCount + count <= capacity )
+    {
+        return BR_SUCCESS;
+    }
+
+    while ( capacity < table->itemCount + count )
+    {
+        capacity = capacity > 0 ? capacity * 2 : 4096;
+    }
+
+    if ( capacity > SIZE_MAX / sizeof( uint64_t ) )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    hashes = realloc( table->bloomHashes, (size_t)capacity * sizeof( uint64_t ) );
+
+    if ( hashes == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    table->bloomHashes       = hashes;
+    table->bloomHashCapacity = capacity;
+
+    return BR_SUCCESS;
+}
+
+/** Add a key to the bloom filter, either directly or to the key hash buffer when the filter is yet to be sized (room is made by bloom_reserve).
+  * @param table The table being appended to.
+  * @param key The key being appended.
+  */
+static void bloom_add_key( BitableWritable* table, const BitableValue* key )
+{
+    uint64_t hash = bitable_key_hash( key );
+
+    if ( table->bloomBlocks != NULL )
+    {
+        bitable_bloom_add( table->bloomBlocks, table->bloomBlockCount, table->bloomHashCount, hash );
+        return;
+    }
+
+    assert( table->itemCount < table->bloomHashCapacity );
+
+    table->bloomHashes[ table->itemCount ] = hash;
+}
+
+/** Write a block of data that may be larger than a single write allows.
+  * @param file The file to write to.
+  * @param data The data to write.
+  * @param size The size of the data in bytes.
+  * @return BR_SUCCESS if the data was written, or the error from the failing write.
+  */
+static BitableResult write_all( BitableWritableFile* file, const void* data, uint64_t size )
+{
+    const uint8_t* cursor    = (const uint8_t*)data;
+    uint64_t       remaining = size;
+    BitableResult  result    = BR_SUCCESS;
+
+    // write in chunks, as a large block may not fit in a single write.
+    while ( remaining > 0 && result == BR_SUCCESS )
+    {
+        uint32_t writeSize = remaining > 0x40000000 ? 0x40000000 : (uint32_t)remaining;
+
+        result     = bitable_wf_write( file, cursor, writeSize );
+        cursor    += writeSize;
+        remaining -= writeSize;
+    }
+
+    return result;
+}
+
+/** Build the bloom filter from buffered hashes, if it wasn't sized up front.
+  * @param table The table being completed.
+  * @return BR_SUCCESS if the filter was built, BR_ALLOCATION_FAILED if it couldn't be allocated.
+  */
+static BitableResult build_bloom_filter( BitableWritable* table )
+{
+    uint64_t where;
+
+    if ( table->bloomBlocks != NULL )
+    {
+        return BR_SUCCESS;
+    }
+
+    table->bloomBlockCount = bloom_block_count( table->itemCount, table->bloomBitsPerKey );
+    table->bloomBlocks     = calloc( (size_t)table->bloomBlockCount, BITABLE_BLOOM_BLOCK_SIZE );
+
+    if ( table->bloomBlocks == NULL )
+    {
+        return BR_ALLOCATION_FAILED;
+    }
+
+    for ( where = 0; where < table->itemCount; ++where )
+    {
+        bitable_bloom_add( table->bloomBlocks, table->bloomBlockCount, table->bloomHashCount, table->bloomHashes[ where ] );
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Write out the bloom filter sidecar file, building the filter from buffered hashes if required.
+  * @param table The table being completed.
+  * @param options The completion options (to check if we need to sync).
+  * @return BR_SUCCESS if the bloom filter was written, or the error from the failing file operation.
+  */
+static BitableResult write_bloom_filter( BitableWritable* table, BitableCompletionOptions options )
+{
+    BitableWritableFile* file;
+    BitableResult        result;
+
+    result = build_bloom_filter( table );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = bitable_wf_create( &file, table->paths.bloomPath );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = write_all( file, table->bloomBlocks, table->bloomBlockCount * BITABLE_BLOOM_BLOCK_SIZE );
+
+    if ( result == BR_SUCCESS && ( options & BCO_DURABLE ) == BCO_DURABLE )
+    {
+        result = bitable_wf_sync( file );
+    }
+
+    bitable_wf_close( file );
+
+    return result;
+}
+
+/** Append a block of data to the end of a single file table (the leaf file), padded out to a page boundary.
+  * @param table The table being completed.
+  * @param data The data to append.
+  * @param size The size of the data in bytes.
+  * @param [in,out] fileSize The current size of the leaf file, which will be updated.
+  * @param [out] extent The extent the data was written to.
+  * @return BR_SUCCESS if the data was appended, BR_ALLOCATION_FAILED if the padding couldn't be allocated, or the error from the failing write.
+  */
+static BitableResult append_extent( BitableWritable* table, const void* data, uint64_t size, uint64_t* fileSize, BitableExtent* extent )
+{
+    BitableWritableFile* file       = table->leafLevel.bufferedFile.file;
+    uint64_t             paddedSize = ( size + ( table->pageSize - 1 ) ) & ~(uint64_t)( table->pageSize - 1 );
+    BitableResult        result     = write_all( file, data, size );
+
+    if ( result == BR_SUCCESS && paddedSize > size )
+    {
+        uint8_t* padding = calloc( table->pageSize, sizeof( uint8_t ) );
+
+        result = padding != NULL ? bitable_wf_write( file, padding, (uint32_t)( paddedSize - size ) ) : BR_ALLOCATION_FAILED;
+
+        free( padding );
+    }
+
+    extent->offset = *fileSize;
+    extent->size   = size;
+    *fileSize     += paddedSize;
+
+    return result;
+}
+
+/** Close a file written while appending and copy it onto the end of a single file table.
+  * @param table The table being completed.
+  * @param bufferedFile The file to close and copy.
+  * @param path The path of the file.
+  * @param [in,out] fileSize The current size of the leaf file, which will be updated.
+  * @param [out] extent The extent the file was copied to.
+  * @return BR_SUCCESS if the file was copied, or the error from the failing file operation.
+  */
+static BitableResult append_file_extent( BitableWritable* table, BufferedFile* bufferedFile, const char* path, uint64_t* fileSize, BitableExtent* extent )
+{
+    BitableMemoryMappedFile source;
+    BitableResult           result = bitable_wf_flush( bufferedFile->file );
+
+    // the file has to be closed before it can be mapped on some platforms.
+    cleanup_buffered( bufferedFile );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = bitable_mmf_open( &source, path, BRO_SEQUENTIAL );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = append_extent( table, source.address, source.size, fileSize, extent );
+
+    bitable_mmf_close( &source );
+
+    return result;
+}
+
+/** Concatenate the branch levels, large value store and bloom filter onto the end of the leaf file, recording their extents in the header.
+  * @param table The table being completed, with all the leaf pages written.
+  * @param [out] header The header to record the extents in.
+  * @return BR_SUCCESS if everything was appended, or the error from the failing file operation.
+  */
+static BitableResult append_extents( BitableWritable* table, BitableHeader* header )
+{
+    uint64_t      fileSize = ( table->leafLevel.leafPageCount + 1 ) * table->pageSize;
+    BitableResult result;
+    uint32_t      where;
+
+    for ( where = 0; where < table->depth; ++where )
+    {
+        result = append_file_extent( table, &table->branchLevels[ where ].bufferedFile, table->paths.branchPaths[ where ], &fileSize, &header->branchExtents[ where ] );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    if ( table->largeValueFile.file != NULL )
+    {
+        result = append_file_extent( table, &table->largeValueFile, table->paths.largeValuePath, &fileSize, &header->largeValueExtent );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    if ( table->bloomBitsPerKey > 0 )
+    {
+        result = build_bloom_filter( table );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = append_extent( table, table->bloomBlocks, table->bloomBlockCount * BITABLE_BLOOM_BLOCK_SIZE, &fileSize, &header->bloomExtent );
+        }
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
 static void cleanup_writable( BitableWritable* table )
 {
     int where;
 
+    free( table->bloomBlocks );
+    free( table->bloomHashes );
+    free( table->largeValueStaging );
     bitable_free_paths( &table->paths );
     cleanup_buffered( &table->largeValueFile );
     cleanup_buffered( &table->leafLevel.bufferedFile );
@@ -128,330 +570,1529 @@ static void cleanup_writable( BitableWritable* table )
     memset( table, 0, sizeof( BitableWritable ) );
 }
 
+/** Point the leaf level's header and indices at the leaf page being filled.
+  * @param table The table being written.
+  */
+static void point_leaf_level( BitableWritable* table )
+{
+    LeafLevel* leafLevel = &table->leafLevel;
+
+    leafLevel->initialIndice = (uint64_t*)leafLevel->bufferedFile.buffer;
+    leafLevel->itemCount     = (int32_t*)( leafLevel->initialIndice + 1 );
+    leafLevel->itemIndices   = leafLevel->bufferedFile.buffer + table->leafHeaderSize;
+}
+
+/** Write out the leaf page being filled and start a new one, pointing the leaf level at it.
+  * @param table The table being written.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+static BitableResult next_leaf_page( BitableWritable* table )
+{
+    LeafLevel*    leafLevel = &table->leafLevel;
+    BufferedFile* leafFile  = &leafLevel->bufferedFile;
+    BitableResult result    = write_page( leafFile, table->pageSize );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = begin_page( leafFile, table->pageSize );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    point_leaf_level( table );
+
+    return BR_SUCCESS;
+}
+
 static BitableResult add_page_to_branch( BitableWritable* table, const BitableValue* key, uint32_t depth )
 {
     BitableResult result;
 
-    if ( table->depth > BITABLE_MAX_BRANCH_LEVELS )
-    {
-        return BR_MAXIMUM_TABLE_TREE_DEPTH;
+    if ( table->depth > BITABLE_MAX_BRANCH_LEVELS )
+    {
+        return BR_MAXIMUM_TABLE_TREE_DEPTH;
+    }
+
+    {
+        BranchLevel*  branchLevel = table->branchLevels + depth;
+        BufferedFile* branchFile  = &branchLevel->bufferedFile;
+
+        // note, we should only ever increment depth by 1, so we should always be adding the current
+        if ( branchFile->file == NULL )
+        {
+            BitableWritableFileOptions fileOptions;
+
+            assert( depth == table->depth );
+
+            // branch levels are small, so they aren't worth the extra buffers or bypassing the cache (they're copied into single file tables anyway).
+            fileOptions.bufferSize = table->writeBufferSize;
+            fileOptions.queueDepth = 0;
+            fileOptions.flags      = BWFF_NONE;
+
+            result = create_buffered_file( branchFile, table->paths.branchPaths[ depth ], table->pageSize, &fileOptions, 0 );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+
+            table->depth = depth + 1;
+
+            branchLevel->initialChildPage  = (uint64_t*)branchFile->buffer;
+            branchLevel->itemCount         = (uint16_t*)( branchLevel->initialChildPage + 1 );
+            branchLevel->childIndices      = branchFile->buffer + table->branchHeaderSize;
+
+            // when we start a new level we add 2 items - the first node of the previous level (which doesn't need it's key stored)
+            // and the second node of the previous level (just added) that does.
+            *branchLevel->initialChildPage = 0;
+            *branchLevel->itemCount        = 2;
+            branchLevel->childPageCount    = 2;
+            branchLevel->leftSize          = table->branchHeaderSize + table->branchIndiceSize;
+            branchLevel->rightSize         = ( key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+
+            {
+                uint16_t             keyOffset      = table->pageSize - branchLevel->rightSize;
+                void*                keyDestination = (uint8_t*)branchFile->buffer + keyOffset;
+                BitableBranchIndice* keyIndice      = (BitableBranchIndice*)branchLevel->childIndices;
+
+                keyIndice->itemOffset = keyOffset;
+                keyIndice->keySize    = (uint16_t)key->size;
+
+                if ( ( table->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+                {
+                    ( (BitablePrefixedBranchIndice*)keyIndice )->keyPrefix = bitable_key_prefix( key );
+                }
+
+                memcpy( keyDestination, key->data, key->size );
+            }
+        }
+        else
+        {
+            uint16_t newLeftSize  = branchLevel->leftSize + table->branchIndiceSize;
+            uint16_t newRightSize = ( branchLevel->rightSize + key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+
+            if ( newLeftSize + newRightSize > table->pageSize )
+            {
+                result = bitable_wf_write( branchFile->file, branchFile->buffer, table->pageSize );
+
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
+
+                result = add_page_to_branch( table, key, depth + 1 );
+
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
+
+                *branchLevel->initialChildPage += branchLevel->childPageCount;
+                *branchLevel->itemCount         = 1;
+                branchLevel->childPageCount     = 1;
+                branchLevel->leftSize           = table->branchHeaderSize;
+                branchLevel->rightSize          = 0;
+            }
+            else
+            {
+                uint16_t             keyOffset      = table->pageSize - newRightSize;
+                void*                keyDestination = (uint8_t*)branchFile->buffer + keyOffset;
+                BitableBranchIndice* keyIndice      = (BitableBranchIndice*)( branchLevel->childIndices + ( *branchLevel->itemCount - 1 ) * table->branchIndiceSize );
+
+                keyIndice->itemOffset = keyOffset;
+                keyIndice->keySize    = (uint16_t)key->size;
+
+                if ( ( table->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+                {
+                    ( (BitablePrefixedBranchIndice*)keyIndice )->keyPrefix = bitable_key_prefix( key );
+                }
+
+                memcpy( keyDestination, key->data, key->size );
+
+                branchLevel->childPageCount += 1;
+                *branchLevel->itemCount     += 1;
+                branchLevel->leftSize        = newLeftSize;
+                branchLevel->rightSize       = newRightSize;
+            }
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Work out where the next large value will be written in the large value store. Values are aligned to the value alignment,
+  * and padded to start on a new page if they would otherwise straddle a page boundary they would fit within.
+  * @param table The table being appended to.
+  * @param storeSize The size of the large value store before the value.
+  * @param size The size of the large value.
+  * @return The offset the value will be written at in the large value store.
+  */
+static uint64_t large_value_position( const BitableWritable* table, uint64_t storeSize, int32_t size )
+{
+    uint64_t paddedStoreOffset = ( storeSize + ( table->valueAlignment - 1 ) ) & ~( (uint64_t)table->valueAlignment - 1 );
+
+    // If the new data won't fit in the current page in the large value store, pad out to pagesize alignment
+    if ( ( ( paddedStoreOffset & ( table->pageSize - 1 ) ) + size ) > table->pageSize )
+    {
+        // Note, page size is guaranteed to be a larger power of 2 than table->valueAlignment, so in this case the alignment to page size is enough.
+        return ( storeSize + ( table->pageSize - 1 ) ) & ~( (uint64_t)table->pageSize - 1 );
+    }
+
+    return paddedStoreOffset;
+}
+
+/** Pad the end of the large value store to where the next large value will be written (see large_value_position), creating the store if needed.
+  * @param table The table being appended to.
+  * @param size The size of the large value that will be written.
+  * @return BR_SUCCESS if the store was padded, or the error from the failing file operation.
+  */
+static BitableResult pad_large_value_store( BitableWritable* table, int32_t size )
+{
+    BitableResult result;
+    uint64_t      paddedStoreOffset = large_value_position( table, table->largeValueStoreSize, size );
+
+    if ( table->largeValueFile.file == NULL )
+    {
+        BitableWritableFileOptions fileOptions;
+
+        data_file_options( table, &fileOptions );
+
+        result = create_buffered_file( &table->largeValueFile, table->paths.largeValuePath, table->pageSize, &fileOptions, 0 );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    // we have to pad at the end of the large value store before we append.
+    if ( paddedStoreOffset > table->largeValueStoreSize )
+    {
+        result = bitable_wf_write( table->largeValueFile.file, table->largeValueFile.buffer, (uint32_t)( paddedStoreOffset - table->largeValueStoreSize ) );
+
+        table->largeValueStoreSize = paddedStoreOffset;
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Write a large value to the end of the large value store (see pad_large_value_store for the padding).
+  * @param table The table being appended to.
+  * @param fragments The fragments of the large value to write, in order.
+  * @param fragmentCount The number of fragments.
+  * @param size The total size of the large value.
+  * @param [out] offset The offset of the value in the large value store.
+  * @return BR_SUCCESS if the value was written, or the error from the failing file operation.
+  */
+static BitableResult write_large_value( BitableWritable* table, const BitableValue* fragments, uint32_t fragmentCount, int32_t size, uint64_t* offset )
+{
+    BitableResult result = pad_large_value_store( table, size );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    result = bitable_wf_write_gather( table->largeValueFile.file, fragments, fragmentCount );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    *offset = table->largeValueStoreSize;
+
+    table->largeValueStoreSize += size;
+
+    return BR_SUCCESS;
+}
+
+BitableWritable* bitable_write_allocate()
+{
+    return calloc( 1, sizeof( BitableWritable ) );
+}
+
+void bitable_write_default_options( BitableWriteOptions* options )
+{
+    memset( options, 0, sizeof( BitableWriteOptions ) );
+
+    options->pageSize        = 4096;
+    options->keyAlignment    = 8;
+    options->dataAlignment   = 8;
+    options->flags           = BWF_NONE;
+    options->keyKind         = BKK_CUSTOM;
+    options->writeBufferSize = 1024 * 1024;
+}
+
+BitableResult bitable_write_create( BitableWritable* table, const char* path, uint16_t pageSize, uint16_t keyAlignment, uint16_t dataAlignment )
+{
+    BitableWriteOptions options;
+
+    bitable_write_default_options( &options );
+
+    options.pageSize      = pageSize;
+    options.keyAlignment  = keyAlignment;
+    options.dataAlignment = dataAlignment;
+
+    return bitable_write_create_with_options( table, path, &options );
+}
+
+BitableResult bitable_write_create_with_options( BitableWritable* table, const char* path, const BitableWriteOptions* options )
+{
+    BitableResult result;
+    uint16_t      pageSize      = options->pageSize;
+    uint16_t      keyAlignment  = options->keyAlignment;
+    uint16_t      dataAlignment = options->dataAlignment;
+
+    if ( table->leafLevel.bufferedFile.buffer != NULL )
+    {
+        return BR_ALREADY_OPEN;
+    }
+
+    // check page size is in the correct range and a power of 2
+    if ( pageSize < BITABLE_MIN_PAGE_SIZE || pageSize > BITABLE_MAX_PAGE_SIZE || ( pageSize & ( pageSize - 1 ) ) > 0 )
+    {
+        return BR_PAGESIZE_INVALID;
+    }
+
+    // check page size is in the correct range and a power of 2
+    if ( keyAlignment < 1 ||
+         dataAlignment < 1 ||
+         keyAlignment > BITABLE_MAX_ALIGNMENT ||
+         keyAlignment > BITABLE_MAX_ALIGNMENT ||
+         ( keyAlignment & ( keyAlignment - 1 ) ) > 0 ||
+         ( dataAlignment & ( dataAlignment - 1 ) ) > 0 )
+    {
+        return BR_ALIGNMENT_INVALID;
+    }
+
+    if ( (uint32_t)options->keyKind >= BKK_COUNT )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
+
+    if ( ( options->flags & BWF_INTERPOLATION ) != 0 && !bitable_key_kind_is_integer( options->keyKind ) )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
+
+    table->pageSize        = pageSize;
+    table->keyAlignment    = keyAlignment;
+    table->valueAlignment  = dataAlignment;
+    table->itemCount       = 0;
+    table->depth           = 0; // this will be incremented when the first branch level is added.
+    table->formatFlags     = 0;
+    table->keyKind         = options->keyKind;
+    table->keySize         = bitable_key_kind_size( options->keyKind );
+    table->bloomBitsPerKey = options->bloomBitsPerKey;
+    table->writeBufferSize = options->writeBufferSize;
+    table->writeQueueDepth = options->writeQueueDepth;
+    table->writeFileFlags  = ( options->flags & BWF_DIRECT_IO ) != 0 ? BWFF_DIRECT : BWFF_NONE;
+
+    if ( ( options->flags & BWF_MAPPED_OUTPUT ) != 0 )
+    {
+        table->writeFileFlags |= BWFF_MAPPED;
+    }
+
+    if ( options->bloomBitsPerKey > 0 )
+    {
+        table->formatFlags   |= BITABLE_FORMAT_BLOOM_FILTER;
+        table->bloomHashCount = bitable_bloom_hash_count( options->bloomBitsPerKey );
+
+        if ( options->expectedItemCount > 0 )
+        {
+            table->bloomBlockCount = bloom_block_count( options->expectedItemCount, options->bloomBitsPerKey );
+            table->bloomBlocks     = calloc( (size_t)table->bloomBlockCount, BITABLE_BLOOM_BLOCK_SIZE );
+
+            if ( table->bloomBlocks == NULL )
+            {
+                return BR_ALLOCATION_FAILED;
+            }
+        }
+    }
+
+    if ( ( options->flags & BWF_INTERPOLATION ) != 0 )
+    {
+        table->formatFlags |= BITABLE_FORMAT_INTERPOLATION;
+    }
+
+    if ( ( options->flags & BWF_SINGLE_FILE ) != 0 )
+    {
+        table->formatFlags |= BITABLE_FORMAT_SINGLE_FILE;
+    }
+
+    if ( ( options->flags & BWF_KEY_PREFIXES ) != 0 )
+    {
+        table->formatFlags     |= BITABLE_FORMAT_KEY_PREFIXES;
+        table->leafHeaderSize   = BITABLE_PREFIXED_HEADER_SIZE;
+        table->leafIndiceSize   = sizeof( BitablePrefixedLeafIndice );
+        table->branchHeaderSize = BITABLE_PREFIXED_HEADER_SIZE;
+        table->branchIndiceSize = sizeof( BitablePrefixedBranchIndice );
+    }
+    else
+    {
+        table->leafHeaderSize   = BITABLE_LEAF_HEADER_SIZE;
+        table->leafIndiceSize   = sizeof( BitableLeafIndice );
+        table->branchHeaderSize = BITABLE_BRANCH_HEADER_SIZE;
+        table->branchIndiceSize = sizeof( BitableBranchIndice );
+    }
+
+    bitable_build_paths( &table->paths, path );
+
+    {
+        LeafLevel*                 leafLevel = &table->leafLevel;
+        BitableWritableFileOptions fileOptions;
+
+        data_file_options( table, &fileOptions );
+
+        result = create_buffered_file( &leafLevel->bufferedFile, table->paths.leafPath, pageSize, &fileOptions, 1 );
+
+        if ( result == BR_SUCCESS && options->expectedFileSize > 0 )
+        {
+            bitable_wf_preallocate( leafLevel->bufferedFile.file, options->expectedFileSize );
+        }
+
+        // write out space for the header.
+        if ( result == BR_SUCCESS )
+        {
+            result = next_leaf_page( table );
+        }
+
+        leafLevel->leafPageCount   = 1;
+        leafLevel->unbranchedPage  = 0;
+
+        if ( result == BR_SUCCESS )
+        {
+            // when we start a new level we add 2 items - the first node of the previous level (which doesn't need it's key stored)
+            // and the second node of the previous level (just added) that does.
+            *leafLevel->itemCount  = 0;
+            leafLevel->leftSize = table->leafHeaderSize;
+            leafLevel->rightSize = 0;
+        }
+    }
+
+    if ( result != BR_SUCCESS )
+    {
+        cleanup_writable( table );
+        return result;
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Work out the allocation on the right of a leaf page (keys and values, growing down from the end of the page) after adding an item. 
+  * Keys are aligned to the key alignment, then values to the value alignment. Large values take an 8 byte aligned offset into the large value store instead.
+  * @param table The table being appended to.
+  * @param rightSize The allocation on the right of the page before the item.
+  * @param keySize The size of the key.
+  * @param dataSize The size of the value.
+  * @param [out] keyAllocation The allocation on the right of the page up to the end of the key (so the key is at pageSize - keyAllocation).
+  * @return The allocation on the right of the page including the item.
+  */
+static uint16_t leaf_item_allocation( const BitableWritable* table, uint16_t rightSize, int32_t keySize, int32_t dataSize, uint16_t* keyAllocation )
+{
+    uint16_t newKeyAllocation = ( rightSize + keySize + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+
+    *keyAllocation = newKeyAllocation;
+
+    if ( dataSize <= BITABLE_MAX_KEY_SIZE )
+    {
+        return ( newKeyAllocation + dataSize + ( table->valueAlignment - 1 ) ) & ~( table->valueAlignment - 1 );
+    }
+
+    return ( newKeyAllocation + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 );
+}
+
+/** Place an item in a leaf page, copying the key and value (or the offset of a large value) into the page and filling out its indice.
+  * @param table The table being appended to.
+  * @param page The leaf page.
+  * @param where The position of the item in the page.
+  * @param rightSize The allocation on the right of the page before the item.
+  * @param key The key of the item.
+  * @param value The value of the item.
+  * @param largeValueOffset The offset of the value in the large value store, if it is a large value.
+  * @return The allocation on the right of the page including the item.
+  */
+static uint16_t place_leaf_item( const BitableWritable* table, 
+                                 uint8_t* page, 
+                                 size_t where, 
+                                 uint16_t rightSize, 
+                                 const BitableValue* key, 
+                                 const BitableValue* value, 
+                                 uint64_t largeValueOffset )
+{
+    uint16_t           keyAllocation;
+    uint16_t           newRightSize = leaf_item_allocation( table, rightSize, key->size, value->size, &keyAllocation );
+    uint16_t           keyOffset    = table->pageSize - keyAllocation;
+    BitableLeafIndice* itemIndice   = (BitableLeafIndice*)( page + table->leafHeaderSize + where * table->leafIndiceSize );
+
+    if ( value->size > BITABLE_MAX_KEY_SIZE )
+    {
+        *(uint64_t*)( page + ( table->pageSize - newRightSize ) ) = largeValueOffset;
+    }
+    else if ( value->size > 0 )
+    {
+        memcpy( page + ( table->pageSize - newRightSize ), value->data, value->size );
+    }
+
+    if ( key->size > 0 )
+    {
+        memcpy( page + keyOffset, key->data, key->size );
+    }
+
+    itemIndice->dataSize   = value->size;
+    itemIndice->itemOffset = keyOffset;
+    itemIndice->keySize    = (uint16_t)key->size;
+
+    if ( ( table->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+    {
+        ( (BitablePrefixedLeafIndice*)itemIndice )->keyPrefix = bitable_key_prefix( key );
+    }
+
+    return newRightSize;
+}
+
+/** Reserve space for an item at the end of the current leaf page, writing out the page and starting a new one if the item doesn't fit.
+  * The item is recorded as pending, to be finished by commit_item once the key and value have been written. Large values aren't reserved here.
+  * @param table The table being appended to.
+  * @param keySize The size of the key.
+  * @param dataSize The size of the value.
+  * @param [out] keyDestination Set to where the key should be written in the leaf page.
+  * @param [out] dataDestination Set to where the value should be written in the leaf page (NULL for large values).
+  * @return BR_SUCCESS if the item was reserved, BR_KEY_INVALID if the key size isn't valid, BR_VALUE_INVALID if the value size is negative, or the error from writing out the page.
+  */
+static BitableResult reserve_item( BitableWritable* table, int32_t keySize, int32_t dataSize, void** keyDestination, void** dataDestination )
+{
+    LeafLevel*        leafLevel         = &table->leafLevel;
+    BufferedFile*     leafFile          = &leafLevel->bufferedFile;
+    PendingItem*      pending           = &table->pending;
+    uint16_t          newLeftSize       = leafLevel->leftSize + table->leafIndiceSize;
+    uint16_t          newKeyAllocation;
+    uint16_t          newRightSize;
+    BitableResult result;
+
+    assert( !pending->reserved );
+
+    if ( keySize < 0 || keySize > BITABLE_MAX_KEY_SIZE || ( table->keySize > 0 && keySize != table->keySize ) )
+    {
+        return BR_KEY_INVALID;
+    }
+
+    if ( dataSize < 0 )
+    {
+        return BR_VALUE_INVALID;
+    }
+
+    result = bloom_reserve( table, 1 );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    // a page started for an item that was abandoned still needs adding to the branch level with this item.
+    pending->startsPage = leafLevel->unbranchedPage;
+
+    newRightSize = leaf_item_allocation( table, leafLevel->rightSize, keySize, dataSize, &newKeyAllocation );
+
+    // leaf page would overflow putting in this data, write the page and start a new one.
+    if ( newLeftSize + newRightSize > table->pageSize )
+    {
+        result = next_leaf_page( table );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+
+        newLeftSize  = table->leafHeaderSize + table->leafIndiceSize; // allocate at least the header and one indice
+        newRightSize = leaf_item_allocation( table, 0, keySize, dataSize, &newKeyAllocation );
+
+        // the page is added to the branch level when the item is committed, as that needs the key.
+        pending->startsPage = 1;
+
+        *leafLevel->itemCount     = 0;
+        *leafLevel->initialIndice = table->itemCount;
+
+        ++leafLevel->leafPageCount;
+    }
+
+    pending->reserved   = 1;
+    pending->keyOffset  = table->pageSize - newKeyAllocation;
+    pending->leftSize   = newLeftSize;
+    pending->rightSize  = newRightSize;
+    pending->keySize    = (uint16_t)keySize; // this is safe as maximum keysize is guaranteed to fit in a u16.
+    pending->dataSize   = dataSize;
+    pending->largeValue = PLV_NONE;
+
+    *keyDestination  = leafFile->buffer + pending->keyOffset;
+    *dataDestination = dataSize <= BITABLE_MAX_KEY_SIZE ? leafFile->buffer + ( table->pageSize - newRightSize ) : NULL;
+
+    return BR_SUCCESS;
+}
+
+/** Drop the pending item reserved by reserve_item, when it can't be finished. If the item started a new leaf page, the page has already replaced
+  * the previous one (which has been written out), so it's kept as an empty page, to be added to the branch level with the next item put in it.
+  * @param table The table being appended to.
+  */
+static void abandon_item( BitableWritable* table )
+{
+    LeafLevel*   leafLevel = &table->leafLevel;
+    PendingItem* pending   = &table->pending;
+
+    assert( pending->reserved );
+
+    pending->reserved = 0;
+
+    if ( pending->startsPage )
+    {
+        leafLevel->leftSize       = table->leafHeaderSize;
+        leafLevel->rightSize      = 0;
+        leafLevel->unbranchedPage = 1;
+    }
+}
+
+/** Finish the pending item reserved by reserve_item, once its key and value have been written. Adds the item's indice (and its page to the branch level,
+  * if it started a new page) and finishes writing a reserved or staged large value.
+  * @param table The table being appended to.
+  * @return BR_SUCCESS if the item was committed, or the error from writing the large value or the branch page.
+  */
+static BitableResult commit_item( BitableWritable* table )
+{
+    LeafLevel*         leafLevel  = &table->leafLevel;
+    BufferedFile*      leafFile   = &leafLevel->bufferedFile;
+    PendingItem*       pending    = &table->pending;
+    BitableLeafIndice* itemIndice = (BitableLeafIndice*)( leafLevel->itemIndices + *leafLevel->itemCount * table->leafIndiceSize );
+    BitableResult      result     = BR_SUCCESS;
+    BitableValue       key;
+
+    assert( pending->reserved );
+
+    if ( pending->largeValue == PLV_RESERVED )
+    {
+        result = bitable_wf_commit( table->largeValueFile.file, (uint32_t)pending->dataSize );
+    }
+    else if ( pending->largeValue == PLV_STAGED )
+    {
+        result = bitable_wf_write( table->largeValueFile.file, table->largeValueStaging, (uint32_t)pending->dataSize );
+    }
+
+    if ( result != BR_SUCCESS )
+    {
+        abandon_item( table );
+        return result;
+    }
+
+    if ( pending->largeValue != PLV_NONE )
+    {
+        table->largeValueStoreSize += (uint32_t)pending->dataSize;
+    }
+
+    if ( pending->dataSize > BITABLE_MAX_KEY_SIZE )
+    {
+        *(uint64_t*)( leafFile->buffer + ( table->pageSize - pending->rightSize ) ) = pending->largeValueOffset;
+    }
+
+    key.data = leafFile->buffer + pending->keyOffset;
+    key.size = pending->keySize;
+
+    if ( pending->startsPage )
+    {
+        result = add_page_to_branch( table, &key, 0 );
+
+        if ( result != BR_SUCCESS )
+        {
+            abandon_item( table );
+            return result;
+        }
+
+        leafLevel->unbranchedPage = 0;
+    }
+
+    pending->reserved = 0;
+
+    itemIndice->dataSize   = pending->dataSize;
+    itemIndice->itemOffset = pending->keyOffset;
+    itemIndice->keySize    = pending->keySize;
+
+    if ( ( table->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != 0 )
+    {
+        ( (BitablePrefixedLeafIndice*)itemIndice )->keyPrefix = bitable_key_prefix( &key );
+    }
+
+    leafLevel->leftSize  = pending->leftSize;
+    leafLevel->rightSize = pending->rightSize;
+
+    if ( table->bloomBitsPerKey > 0 )
+    {
+        bloom_add_key( table, &key );
+    }
+
+    *leafLevel->itemCount += 1;
+    ++table->itemCount;
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_append( BitableWritable* table, const BitableValue* key, const BitableValue* data )
+{
+    BitableResult result;
+    void*         keyDestination;
+    void*         dataDestination;
+
+    if ( table->pending.reserved )
+    {
+        return BR_APPEND_STATE_INVALID;
+    }
+
+    result = reserve_item( table, key->size, data->size, &keyDestination, &dataDestination );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    if ( key->size > 0 )
+    {
+        memcpy( keyDestination, key->data, key->size );
+    }
+
+    // large values are written straight from the caller's memory, rather than reserved.
+    if ( data->size > BITABLE_MAX_KEY_SIZE )
+    {
+        result = write_large_value( table, data, 1, data->size, &table->pending.largeValueOffset );
+
+        if ( result != BR_SUCCESS )
+        {
+            abandon_item( table );
+            return result;
+        }
+    }
+    else if ( data->size > 0 )
+    {
+        memcpy( dataDestination, data->data, data->size );
+    }
+
+    return commit_item( table );
+}
+
+/** Get the total size of a set of fragments.
+  * @param fragments The fragments.
+  * @param fragmentCount The number of fragments.
+  * @param [out] size The total size of the fragments.
+  * @return Non-zero if the total size is valid (fits in a BitableValue), zero otherwise.
+  */
+static int fragments_size( const BitableValue* fragments, uint32_t fragmentCount, int32_t* size )
+{
+    int64_t  total = 0;
+    uint32_t where;
+
+    for ( where = 0; where < fragmentCount; ++where )
+    {
+        if ( fragments[ where ].size < 0 )
+        {
+            return 0;
+        }
+
+        total += fragments[ where ].size;
+    }
+
+    if ( total > INT32_MAX )
+    {
+        return 0;
+    }
+
+    *size = (int32_t)total;
+
+    return 1;
+}
+
+/** Copy a set of fragments one after the other.
+  * @param destination Where to copy the fragments to.
+  * @param fragments The fragments.
+  * @param fragmentCount The number of fragments.
+  */
+static void copy_fragments( void* destination, const BitableValue* fragments, uint32_t fragmentCount )
+{
+    uint8_t* cursor = destination;
+    uint32_t where;
+
+    for ( where = 0; where < fragmentCount; ++where )
+    {
+        if ( fragments[ where ].size > 0 )
+        {
+            memcpy( cursor, fragments[ where ].data, fragments[ where ].size );
+
+            cursor += fragments[ where ].size;
+        }
+    }
+}
+
+BitableResult bitable_append_gather( BitableWritable* table, 
+                                     const BitableValue* keyFragments, 
+                                     uint32_t keyFragmentCount, 
+                                     const BitableValue* dataFragments, 
+                                     uint32_t dataFragmentCount )
+{
+    BitableResult result;
+    int32_t       keySize;
+    int32_t       dataSize;
+    void*         keyDestination;
+    void*         dataDestination;
+
+    if ( table->pending.reserved )
+    {
+        return BR_APPEND_STATE_INVALID;
+    }
+
+    if ( !fragments_size( keyFragments, keyFragmentCount, &keySize ) )
+    {
+        return BR_KEY_INVALID;
+    }
+
+    if ( !fragments_size( dataFragments, dataFragmentCount, &dataSize ) )
+    {
+        return BR_VALUE_INVALID;
+    }
+
+    result = reserve_item( table, keySize, dataSize, &keyDestination, &dataDestination );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    copy_fragments( keyDestination, keyFragments, keyFragmentCount );
+
+    // large values are written straight from the fragments, with a single gathered write where they don't fit in the write buffer.
+    if ( dataSize > BITABLE_MAX_KEY_SIZE )
+    {
+        result = write_large_value( table, dataFragments, dataFragmentCount, dataSize, &table->pending.largeValueOffset );
+
+        if ( result != BR_SUCCESS )
+        {
+            abandon_item( table );
+            return result;
+        }
+    }
+    else
+    {
+        copy_fragments( dataDestination, dataFragments, dataFragmentCount );
+    }
+
+    return commit_item( table );
+}
+
+BitableResult bitable_append_batch( BitableWritable* table, const BitableValue* keys, const BitableValue* data, size_t count )
+{
+    LeafLevel*    leafLevel = &table->leafLevel;
+    BufferedFile* leafFile  = &leafLevel->bufferedFile;
+    size_t        first     = 0;
+    BitableResult invalid   = BR_SUCCESS;
+    BitableResult result;
+
+    if ( table->pending.reserved )
+    {
+        return BR_APPEND_STATE_INVALID;
+    }
+
+    result = bloom_reserve( table, count );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    while ( first < count && invalid == BR_SUCCESS )
+    {
+        uint32_t leftSize  = leafLevel->leftSize;
+        uint16_t rightSize = leafLevel->rightSize;
+        uint16_t keyAllocation;
+        size_t   last;
+        size_t   where;
+
+        // find the run of items that fit in the current page, checking them as we go.
+        for ( last = first; last < count; ++last )
+        {
+            uint16_t newRightSize;
+
+            if ( keys[ last ].size < 0 || keys[ last ].size > BITABLE_MAX_KEY_SIZE || ( table->keySize > 0 && keys[ last ].size != table->keySize ) )
+            {
+                invalid = BR_KEY_INVALID;
+                break;
+            }
+
+            if ( data[ last ].size < 0 )
+            {
+                invalid = BR_VALUE_INVALID;
+                break;
+            }
+
+            newRightSize = leaf_item_allocation( table, rightSize, keys[ last ].size, data[ last ].size, &keyAllocation );
+
+            // an item always goes in an empty page, as it couldn't fit anywhere else.
+            if ( leftSize + table->leafIndiceSize + newRightSize > table->pageSize && ( last > first || *leafLevel->itemCount > 0 ) )
+            {
+                break;
+            }
+
+            leftSize  += table->leafIndiceSize;
+            rightSize  = newRightSize;
+        }
+
+        // the next item doesn't fit, write the page and start a new one. The new page is added to the branch level with the first key put in it,
+        // so if that fails the page is left empty for the next append, as for an abandoned reservation.
+        if ( last == first && invalid == BR_SUCCESS )
+        {
+            result = next_leaf_page( table );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+
+            *leafLevel->itemCount     = 0;
+            *leafLevel->initialIndice = table->itemCount;
+            leafLevel->leftSize       = table->leafHeaderSize;
+            leafLevel->rightSize      = 0;
+            leafLevel->unbranchedPage = 1;
+
+            ++leafLevel->leafPageCount;
+
+            continue;
+        }
+
+        // a new page (or one started for an abandoned reservation) is added to the branch level with the first key put in it.
+        if ( leafLevel->unbranchedPage && last > first )
+        {
+            result = add_page_to_branch( table, keys + first, 0 );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+
+            leafLevel->unbranchedPage = 0;
+        }
+
+        // copy the run into the page, after the items already in it.
+        for ( where = first; where < last; ++where )
+        {
+            uint64_t largeValueOffset = 0;
+
+            if ( data[ where ].size > BITABLE_MAX_KEY_SIZE )
+            {
+                result = write_large_value( table, data + where, 1, data[ where ].size, &largeValueOffset );
+
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
+            }
+
+            leafLevel->rightSize = place_leaf_item( table, leafFile->buffer, *leafLevel->itemCount, leafLevel->rightSize, keys + where, data + where, largeValueOffset );
+
+            // the bloom filter buffers key hashes by item number, so the item count has to move on with each key.
+            if ( table->bloomBitsPerKey > 0 )
+            {
+                bloom_add_key( table, keys + where );
+            }
+
+            *leafLevel->itemCount += 1;
+            leafLevel->leftSize   += table->leafIndiceSize;
+
+            ++table->itemCount;
+        }
+
+        first = last;
+    }
+
+    return invalid;
+}
+
+/** Work out where the leaf pages for a run of items start, for a round of a parallel append. Each page is filled with as many items as fit,
+  * as they would be appended one at a time.
+  * @param table The table being appended to.
+  * @param keys The keys being appended.
+  * @param data The values being appended.
+  * @param first The first item in the round.
+  * @param count The total number of items being appended.
+  * @param [in,out] storeSize The size of the large value store, updated past the large values of the round.
+  * @param [out] pages The starts of the pages, followed by the start of the page after the round.
+  * @param maximumPages The maximum number of pages in the round.
+  * @return The number of pages in the round.
+  */
+static uint32_t find_parallel_pages( const BitableWritable* table, 
+                                     const BitableValue* keys, 
+                                     const BitableValue* data, 
+                                     size_t first, 
+                                     size_t count, 
+                                     uint64_t* storeSize, 
+                                     ParallelPage* pages, 
+                                     uint32_t maximumPages )
+{
+    uint32_t pageCount = 0;
+    size_t   item      = first;
+
+    while ( item < count && pageCount < maximumPages )
+    {
+        uint32_t leftSize  = table->leafHeaderSize;
+        uint16_t rightSize = 0;
+        uint16_t keyAllocation;
+
+        pages[ pageCount ].firstItem       = item;
+        pages[ pageCount ].largeValueStart = *storeSize;
+
+        // an item always goes in an empty page, as it couldn't fit anywhere else.
+        do
+        {
+            uint16_t newRightSize = leaf_item_allocation( table, rightSize, keys[ item ].size, data[ item ].size, &keyAllocation );
+
+            if ( leftSize + table->leafIndiceSize + newRightSize > table->pageSize && item > pages[ pageCount ].firstItem )
+            {
+                break;
+            }
+
+            if ( data[ item ].size > BITABLE_MAX_KEY_SIZE )
+            {
+                *storeSize = large_value_position( table, *storeSize, data[ item ].size ) + data[ item ].size;
+            }
+
+            leftSize  += table->leafIndiceSize;
+            rightSize  = newRightSize;
+
+            ++item;
+        }
+        while ( item < count );
+
+        ++pageCount;
+    }
+
+    pages[ pageCount ].firstItem       = item;
+    pages[ pageCount ].largeValueStart = *storeSize;
+
+    return pageCount;
+}
+
+/** Pack a slice of leaf pages for a parallel append. Large value offsets are worked out the same way they are when the values are written.
+  * @param context The slice to pack.
+  */
+static void pack_parallel_slice( void* context )
+{
+    const ParallelSlice*   slice = context;
+    const BitableWritable* table = slice->table;
+    uint32_t               page;
+
+    for ( page = 0; page < slice->pageCount; ++page )
+    {
+        uint8_t* output    = slice->output + (size_t)page * table->pageSize;
+        size_t   firstItem = slice->pages[ page ].firstItem;
+        size_t   itemCount = slice->pages[ page + 1 ].firstItem - firstItem;
+        uint64_t storeSize = slice->pages[ page ].largeValueStart;
+        uint16_t rightSize = 0;
+        size_t   where;
+
+        memset( output, 0, table->pageSize );
+
+        *(uint64_t*)output                        = firstItem;
+        *(int32_t*)( output + sizeof( uint64_t ) ) = (int32_t)itemCount;
+
+        for ( where = 0; where < itemCount; ++where )
+        {
+            const BitableValue* value            = slice->data + firstItem + where;
+            uint64_t            largeValueOffset = 0;
+
+            if ( value->size > BITABLE_MAX_KEY_SIZE )
+            {
+                largeValueOffset = large_value_position( table, storeSize, value->size );
+                storeSize        = largeValueOffset + value->size;
+            }
+
+            rightSize = place_leaf_item( table, output, where, rightSize, slice->keys + firstItem + where, value, largeValueOffset );
+        }
+    }
+}
+
+/** Write out a round of packed leaf pages for a parallel append, along with their large values, branch entries and bloom filter keys.
+  * @param table The table being appended to.
+  * @param keys The keys being appended.
+  * @param data The values being appended.
+  * @param pages The starts of the pages in the round, followed by the start of the page after the round.
+  * @param pageCount The number of pages in the round.
+  * @param packed The packed pages.
+  * @param holdLastPage Non-zero to leave the last page of the round unwritten, to become the current leaf page.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+static BitableResult write_parallel_round( BitableWritable* table, 
+                                           const BitableValue* keys, 
+                                           const BitableValue* data, 
+                                           const ParallelPage* pages, 
+                                           uint32_t pageCount, 
+                                           const uint8_t* packed, 
+                                           int holdLastPage )
+{
+    LeafLevel*    leafLevel  = &table->leafLevel;
+    uint32_t      writePages = holdLastPage ? pageCount - 1 : pageCount;
+    BitableResult result     = BR_SUCCESS;
+    uint32_t      page;
+    size_t        where;
+
+    if ( writePages > 0 )
+    {
+        result = bitable_wf_write( leafLevel->bufferedFile.file, packed, writePages * table->pageSize );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    for ( page = 0; page < pageCount; ++page )
+    {
+        // the table's first page is already the current leaf page, every page after it gets a branch entry.
+        if ( pages[ page ].firstItem > 0 )
+        {
+            result = add_page_to_branch( table, keys + pages[ page ].firstItem, 0 );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+
+            ++leafLevel->leafPageCount;
+        }
+    }
+
+    for ( where = pages[ 0 ].firstItem; where < pages[ pageCount ].firstItem; ++where )
+    {
+        if ( data[ where ].size > BITABLE_MAX_KEY_SIZE )
+        {
+            uint64_t largeValueOffset;
+
+            result = write_large_value( table, data + where, 1, data[ where ].size, &largeValueOffset );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+        }
+
+        // the bloom filter buffers key hashes by item number, so the item count has to move on with each key.
+        if ( table->bloomBitsPerKey > 0 )
+        {
+            bloom_add_key( table, keys + where );
+        }
+
+        ++table->itemCount;
+    }
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_append_parallel( BitableWritable* table, const BitableValue* keys, const BitableValue* data, size_t count, uint32_t threadCount )
+{
+    LeafLevel*      leafLevel      = &table->leafLevel;
+    BufferedFile*   leafFile       = &leafLevel->bufferedFile;
+    uint32_t        slicePages;
+    uint32_t        roundPages;
+    uint64_t        storeSize      = 0;
+    size_t          nextItem       = 0;
+    ParallelPage*   pages[ 2 ];
+    uint8_t*        packed[ 2 ];
+    uint32_t        pageCounts[ 2 ] = { 0, 0 };
+    ParallelSlice*  slices;
+    BitableThread** threads;
+    BitableResult   result         = BR_SUCCESS;
+    uint32_t        current        = 0;
+    size_t          where;
+
+    if ( table->pending.reserved || table->itemCount > 0 )
+    {
+        return BR_APPEND_STATE_INVALID;
+    }
+
+    for ( where = 0; where < count; ++where )
+    {
+        if ( keys[ where ].size < 0 || keys[ where ].size > BITABLE_MAX_KEY_SIZE || ( table->keySize > 0 && keys[ where ].size != table->keySize ) )
+        {
+            return BR_KEY_INVALID;
+        }
+
+        if ( data[ where ].size < 0 )
+        {
+            return BR_VALUE_INVALID;
+        }
+    }
+
+    if ( count == 0 )
+    {
+        return BR_SUCCESS;
+    }
+
+    result = bloom_reserve( table, count );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    threadCount = threadCount > 0 ? threadCount : bitable_hardware_threads();
+    threadCount = threadCount < BITABLE_PARALLEL_MAX_THREADS ? threadCount : BITABLE_PARALLEL_MAX_THREADS;
+
+    // the round buffers grow with the thread count, so if they can't be allocated try again with fewer threads.
+    for ( ;; )
+    {
+        // the round is capped at a fixed size, so the memory used doesn't grow with the thread count.
+        slicePages  = BITABLE_PARALLEL_SLICE_SIZE / table->pageSize;
+        slicePages  = slicePages * threadCount <= BITABLE_PARALLEL_ROUND_SIZE / table->pageSize ? slicePages : BITABLE_PARALLEL_ROUND_SIZE / table->pageSize / threadCount;
+        slicePages  = slicePages > 0 ? slicePages : 1;
+        roundPages  = slicePages * threadCount;
+        pages[ 0 ]  = malloc( sizeof( ParallelPage ) * ( roundPages + 1 ) );
+        pages[ 1 ]  = malloc( sizeof( ParallelPage ) * ( roundPages + 1 ) );
+
+        // each page is cleared as it is packed, so the round buffers don't need to be.
+        packed[ 0 ] = malloc( (size_t)roundPages * table->pageSize );
+        packed[ 1 ] = malloc( (size_t)roundPages * table->pageSize );
+        slices      = calloc( threadCount, sizeof( ParallelSlice ) );
+        threads     = calloc( threadCount, sizeof( BitableThread* ) );
+
+        if ( pages[ 0 ] != NULL && pages[ 1 ] != NULL && packed[ 0 ] != NULL && packed[ 1 ] != NULL && slices != NULL && threads != NULL )
+        {
+            break;
+        }
+
+        free( threads );
+        free( slices );
+        free( packed[ 0 ] );
+        free( packed[ 1 ] );
+        free( pages[ 0 ] );
+        free( pages[ 1 ] );
+
+        if ( threadCount == 1 )
+        {
+            return BR_ALLOCATION_FAILED;
+        }
+
+        threadCount /= 2;
     }
 
+    // pages are packed a round at a time, with each thread packing a slice of the round while the previous round is written out.
+    for ( ;; )
     {
-        BranchLevel*  branchLevel = table->branchLevels + depth;
-        BufferedFile* branchFile  = &branchLevel->bufferedFile;
+        uint32_t roundPageCount = find_parallel_pages( table, keys, data, nextItem, count, &storeSize, pages[ current ], roundPages );
+        uint32_t slice;
 
-        // note, we should only ever increment depth by 1, so we should always be adding the current
-        if ( branchFile->file == NULL )
+        for ( slice = 0; slice < threadCount; ++slice )
         {
-            assert( depth == table->depth );
+            uint32_t slicePage = (uint32_t)( (uint64_t)roundPageCount * slice / threadCount );
+            uint32_t sliceEnd  = (uint32_t)( (uint64_t)roundPageCount * ( slice + 1 ) / threadCount );
 
-            result =
-                create_buffered_file( branchFile,
-                                    table->paths.branchPaths[ depth ],
-                                    table->pageSize );
+            slices[ slice ].table     = table;
+            slices[ slice ].keys      = keys;
+            slices[ slice ].data      = data;
+            slices[ slice ].pages     = pages[ current ] + slicePage;
+            slices[ slice ].pageCount = sliceEnd - slicePage;
+            slices[ slice ].output    = packed[ current ] + (size_t)slicePage * table->pageSize;
 
-            if ( result != BR_SUCCESS )
+            if ( slices[ slice ].pageCount == 0 || bitable_thread_create( threads + slice, pack_parallel_slice, slices + slice ) != BR_SUCCESS )
             {
-                return result;
+                threads[ slice ] = NULL;
             }
+        }
 
-            table->depth = depth + 1;
-
-            branchLevel->initialChildPage  = (uint64_t*)branchFile->buffer;
-            branchLevel->itemCount         = (uint16_t*)( branchLevel->initialChildPage + 1 );
-            branchLevel->childIndices      = (BitableBranchIndice*)( (uint16_t*)branchLevel->itemCount + 1 );
-
-            // when we start a new level we add 2 items - the first node of the previous level (which doesn't need it's key stored)
-            // and the second node of the previous level (just added) that does.
-            *branchLevel->initialChildPage = 0;
-            *branchLevel->itemCount        = 2;
-            branchLevel->childPageCount    = 2;
-            branchLevel->leftSize          = sizeof( uint64_t ) + sizeof( uint16_t ) + sizeof( BitableBranchIndice );
-            branchLevel->rightSize         = ( key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+        if ( pageCounts[ current ^ 1 ] > 0 )
+        {
+            result = write_parallel_round( table, keys, data, pages[ current ^ 1 ], pageCounts[ current ^ 1 ], packed[ current ^ 1 ], 0 );
+        }
 
+        // slices that didn't get a thread are packed here.
+        for ( slice = 0; slice < threadCount; ++slice )
+        {
+            if ( threads[ slice ] != NULL )
             {
-                uint16_t             keyOffset      = table->pageSize - branchLevel->rightSize;
-                void*                keyDestination = (uint8_t*)branchFile->buffer + keyOffset;
-                BitableBranchIndice* keyIndice      = branchLevel->childIndices;
-
-                keyIndice->itemOffset = keyOffset;
-                keyIndice->keySize    = (uint16_t)key->size;
-
-                memcpy( keyDestination, key->data, key->size );
+                bitable_thread_join( threads[ slice ] );
+            }
+            else if ( slices[ slice ].pageCount > 0 )
+            {
+                pack_parallel_slice( slices + slice );
             }
         }
-        else
-        {
-            uint16_t newLeftSize  = branchLevel->leftSize + sizeof( BitableBranchIndice );
-            uint16_t newRightSize = ( branchLevel->rightSize + key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
 
-            if ( newLeftSize + newRightSize > table->pageSize )
-            {
-                result = bitable_wf_write( branchFile->file, branchFile->buffer, table->pageSize );
+        pageCounts[ current ]  = roundPageCount;
+        nextItem               = pages[ current ][ roundPageCount ].firstItem;
+        current               ^= 1;
 
-                if ( result != BR_SUCCESS )
-                {
-                    return result;
-                }
+        if ( result != BR_SUCCESS )
+        {
+            break;
+        }
 
-                result = add_page_to_branch( table, key, depth + 1 );
+        // the round just packed is the last, write it out now (holding back its last page).
+        if ( nextItem == count )
+        {
+            result = write_parallel_round( table, keys, data, pages[ current ^ 1 ], pageCounts[ current ^ 1 ], packed[ current ^ 1 ], 1 );
+            break;
+        }
+    }
 
-                if ( result != BR_SUCCESS )
-                {
-                    return result;
-                }
+    // the last page becomes the current leaf page, so appends can carry on filling it and it's written when the table is closed.
+    if ( result == BR_SUCCESS )
+    {
+        uint32_t            lastRound     = current ^ 1;
+        const ParallelPage* lastPage      = pages[ lastRound ] + pageCounts[ lastRound ] - 1;
+        uint16_t            rightSize     = 0;
+        uint16_t            keyAllocation;
 
-                *branchLevel->initialChildPage += branchLevel->childPageCount;
-                *branchLevel->itemCount         = 1;
-                branchLevel->childPageCount     = 1;
-                branchLevel->leftSize           = sizeof( uint64_t ) + sizeof( uint16_t );
-                branchLevel->rightSize          = 0;
-            }
-            else
-            {
-                uint16_t             keyOffset      = table->pageSize - newRightSize;
-                void*                keyDestination = (uint8_t*)branchFile->buffer + keyOffset;
-                BitableBranchIndice* keyIndice      = branchLevel->childIndices + ( *branchLevel->itemCount - 1 );
+        result = begin_page( leafFile, table->pageSize );
 
-                keyIndice->itemOffset = keyOffset;
-                keyIndice->keySize    = (uint16_t)key->size;
+        if ( result == BR_SUCCESS )
+        {
+            memcpy( leafFile->buffer, packed[ lastRound ] + (size_t)( pageCounts[ lastRound ] - 1 ) * table->pageSize, table->pageSize );
 
-                memcpy( keyDestination, key->data, key->size );
+            point_leaf_level( table );
 
-                branchLevel->childPageCount += 1;
-                *branchLevel->itemCount     += 1;
-                branchLevel->leftSize        = newLeftSize;
-                branchLevel->rightSize       = newRightSize;
+            for ( where = lastPage->firstItem; where < count; ++where )
+            {
+                rightSize = leaf_item_allocation( table, rightSize, keys[ where ].size, data[ where ].size, &keyAllocation );
             }
+
+            leafLevel->leftSize  = (uint16_t)( table->leafHeaderSize + ( count - lastPage->firstItem ) * table->leafIndiceSize );
+            leafLevel->rightSize = rightSize;
         }
     }
 
-    return BR_SUCCESS;
-}
+    free( threads );
+    free( slices );
+    free( packed[ 0 ] );
+    free( packed[ 1 ] );
+    free( pages[ 0 ] );
+    free( pages[ 1 ] );
 
-BitableWritable* bitable_write_allocate()
-{
-    return calloc( 1, sizeof( BitableWritable ) );
+    return result;
 }
 
-BitableResult bitable_write_create( BitableWritable* table, const char* path, uint16_t pageSize, uint16_t keyAlignment, uint16_t dataAlignment )
+BitableResult bitable_append_reserve( BitableWritable* table, int32_t keySize, int32_t dataSize, void** keyDestination, void** dataDestination )
 {
+    PendingItem*  pending = &table->pending;
     BitableResult result;
 
-    if ( table->leafLevel.bufferedFile.buffer != NULL )
+    if ( pending->reserved )
     {
-        return BR_ALREADY_OPEN;
+        return BR_APPEND_STATE_INVALID;
     }
 
-    // check page size is in the correct range and a power of 2
-    if ( pageSize < BITABLE_MIN_PAGE_SIZE || pageSize > BITABLE_MAX_PAGE_SIZE || ( pageSize & ( pageSize - 1 ) ) > 0 )
-    {
-        return BR_PAGESIZE_INVALID;
-    }
+    result = reserve_item( table, keySize, dataSize, keyDestination, dataDestination );
 
-    // check page size is in the correct range and a power of 2
-    if ( keyAlignment < 1 ||
-         dataAlignment < 1 ||
-         keyAlignment > BITABLE_MAX_ALIGNMENT ||
-         keyAlignment > BITABLE_MAX_ALIGNMENT ||
-         ( keyAlignment & ( keyAlignment - 1 ) ) > 0 ||
-         ( dataAlignment & ( dataAlignment - 1 ) ) > 0 )
+    if ( result != BR_SUCCESS || dataSize <= BITABLE_MAX_KEY_SIZE )
     {
-        return BR_ALIGNMENT_INVALID;
+        return result;
     }
 
-    table->pageSize       = pageSize;
-    table->keyAlignment   = keyAlignment;
-    table->valueAlignment = dataAlignment;
-    table->itemCount      = 0;
-    table->depth          = 0; // this will be incremented when the first branch level is added.
+    // large values are reserved at the end of the large value store, in its write buffer or mapping if there is room, otherwise in the staging buffer.
+    {
+        result = pad_large_value_store( table, dataSize );
 
-    bitable_build_paths( &table->paths, path );
+        if ( result != BR_SUCCESS )
+        {
+            abandon_item( table );
+            return result;
+        }
 
-    {
-        LeafLevel* leafLevel = &table->leafLevel;
+        pending->largeValueOffset = table->largeValueStoreSize;
 
-        result = create_buffered_file( &leafLevel->bufferedFile, table->paths.leafPath, pageSize );
+        if ( bitable_wf_reserve( table->largeValueFile.file, (uint32_t)dataSize, dataDestination ) == BR_SUCCESS )
+        {
+            pending->largeValue = PLV_RESERVED;
 
-        // write out space for the header.
-        bitable_wf_write( leafLevel->bufferedFile.file, leafLevel->bufferedFile.buffer, pageSize );
+            return BR_SUCCESS;
+        }
 
-        leafLevel->leafPageCount   = 1;
+        if ( (uint32_t)dataSize > table->largeValueStagingSize )
+        {
+            uint8_t* staging = realloc( table->largeValueStaging, (size_t)dataSize );
 
-        leafLevel->initialIndice   = (uint64_t*)leafLevel->bufferedFile.buffer;
-        leafLevel->itemCount       = (int32_t*)( leafLevel->initialIndice + 1 );
-        leafLevel->itemIndices     = (BitableLeafIndice*)( leafLevel->itemCount + 1 );
+            if ( staging == NULL )
+            {
+                abandon_item( table );
+                return BR_ALLOCATION_FAILED;
+            }
 
-        // when we start a new level we add 2 items - the first node of the previous level (which doesn't need it's key stored)
-        // and the second node of the previous level (just added) that does.
-        *leafLevel->itemCount  = 0;
-        leafLevel->leftSize = sizeof( uint64_t ) + sizeof( int32_t );
-        leafLevel->rightSize = 0;
-    }
+            table->largeValueStaging     = staging;
+            table->largeValueStagingSize = (uint32_t)dataSize;
+        }
 
-    if ( result != BR_SUCCESS )
-    {
-        cleanup_writable( table );
-        return result;
+        pending->largeValue = PLV_STAGED;
+        *dataDestination    = table->largeValueStaging;
     }
 
     return BR_SUCCESS;
 }
 
-BitableResult bitable_append( BitableWritable* table, const BitableValue* key, const BitableValue* data )
+BitableResult bitable_append_commit( BitableWritable* table )
 {
-    LeafLevel*        leafLevel         = &table->leafLevel;
-    BufferedFile*     leafFile          = &leafLevel->bufferedFile;
-    uint16_t          newLeftSize       = leafLevel->leftSize + ( sizeof( BitableLeafIndice ) );
-    uint16_t          newKeyAllocation;
-    uint16_t          newRightSize;
-    BitableResult result;
-    
-    if ( key->size < 0 || key->size > BITABLE_MAX_KEY_SIZE )
+    if ( !table->pending.reserved )
     {
-        return BR_KEY_INVALID;
+        return BR_APPEND_STATE_INVALID;
     }
 
-    newKeyAllocation = ( leafLevel->rightSize + key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+    return commit_item( table );
+}
 
-    if ( data->size <= BITABLE_MAX_KEY_SIZE )
+BitableResult bitable_append_pages( BitableWritable* table, const BitableReadable* source, uint64_t firstPage, uint64_t pageCount )
+{
+    const BitableHeader* sourceHeader      = bitable_readable_header( source );
+    const uint8_t*       sourceLargeValues = bitable_readable_large_values( source );
+    LeafLevel*           leafLevel         = &table->leafLevel;
+    BufferedFile*        leafFile          = &leafLevel->bufferedFile;
+    uint64_t             page;
+    BitableResult        result;
+
+    if ( table->pending.reserved )
     {
-        newRightSize = ( newKeyAllocation + data->size + ( table->valueAlignment - 1 ) ) & ~( table->valueAlignment - 1 );
+        return BR_APPEND_STATE_INVALID;
     }
-    else
+
+    if ( sourceHeader->pageSize != table->pageSize )
     {
-        newRightSize = ( newKeyAllocation + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 );
+        return BR_PAGESIZE_INVALID;
     }
 
-    // leaf page would overflow putting in this data, write the page and start a new one.
-    if ( newLeftSize + newRightSize > table->pageSize )
+    if ( sourceHeader->keyAlignment != table->keyAlignment || sourceHeader->valueAlignment != table->valueAlignment )
     {
-        BufferedFile* leafFile = &leafLevel->bufferedFile;
-
-        result = bitable_wf_write( leafFile->file, leafFile->buffer, table->pageSize );
+        return BR_ALIGNMENT_INVALID;
+    }
 
-        if ( result != BR_SUCCESS )
-        {
-            return result;
-        }
+    if ( sourceHeader->keyKind != (uint32_t)table->keyKind || 
+         ( sourceHeader->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) != ( table->formatFlags & BITABLE_FORMAT_KEY_PREFIXES ) )
+    {
+        return BR_KEY_KIND_INVALID;
+    }
 
-        newLeftSize =
-            sizeof( uint64_t ) +
-            sizeof( int32_t ) +
-            sizeof( BitableLeafIndice ); // allocate at least the header and one indice
+    if ( firstPage > sourceHeader->leafPages || pageCount > sourceHeader->leafPages - firstPage )
+    {
+        return BR_INVALID_CURSOR_LOCATION;
+    }
 
-        newKeyAllocation = ( key->size + ( table->keyAlignment - 1 ) ) & ~( table->keyAlignment - 1 );
+    for ( page = firstPage; page < firstPage + pageCount; ++page )
+    {
+        const uint8_t* sourcePage = bitable_readable_leaf_page( source, page );
+        int32_t        itemCount  = *(const int32_t*)( sourcePage + sizeof( uint64_t ) );
+        uint32_t       dataFromRight;
+        int32_t        where;
 
-        if ( data->size <= BITABLE_MAX_KEY_SIZE )
+        // the only empty page is the first page of an empty table.
+        if ( itemCount == 0 )
         {
-            newRightSize = ( newKeyAllocation + data->size + ( table->valueAlignment - 1 ) ) & ~( table->valueAlignment - 1 );
-        }
-        else
-        {
-            newRightSize = ( newKeyAllocation + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 );
+            continue;
         }
 
-        result = add_page_to_branch( table, key, 0 );
+        result = bloom_reserve( table, (uint64_t)itemCount );
 
         if ( result != BR_SUCCESS )
         {
             return result;
         }
 
-        *leafLevel->itemCount = 0;
-
-        ++leafLevel->leafPageCount;
-    }
-
-    if ( data->size <= BITABLE_MAX_KEY_SIZE )
-    {
-        if ( data->size > 0 )
+        // finish the current page (if it has anything in it) and start the copy in a new one. An empty page started for an abandoned
+        // reservation is reused, but still needs adding to the branch level.
+        if ( *leafLevel->itemCount > 0 || leafLevel->unbranchedPage )
         {
-            void* dataDestination = leafFile->buffer + ( table->pageSize - newRightSize );
+            const BitableLeafIndice* firstIndice = (const BitableLeafIndice*)( sourcePage + table->leafHeaderSize );
+            BitableValue             firstKey;
 
-            memcpy( dataDestination, data->data, data->size );
-        }
-    }
-    else
-    {
-        uint64_t paddedStoreOffset = ( table->largeValueStoreSize + ( table->valueAlignment - 1 ) ) & ~( table->valueAlignment - 1 );
+            if ( !leafLevel->unbranchedPage )
+            {
+                result = next_leaf_page( table );
 
-        if ( table->largeValueFile.file == NULL )
-        {
-            result = create_buffered_file( &table->largeValueFile, table->paths.largeValuePath, table->pageSize );
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
 
-            if ( result != BR_SUCCESS )
-            {
-                return result;
+                ++leafLevel->leafPageCount;
             }
-        }
-        
-        // If the new data won't fit in the current page in the large value store, pad out to pagesize alignment
-        if ( ( ( paddedStoreOffset & ( table->pageSize - 1 ) ) + data->size ) > table->pageSize )
-        {
-            // Note, page size is guaranteed to be a larger power of 2 than table->valueAlignment, so in this case the alignment to page size is enough.
-            uint64_t paddedStoreSize = ( table->largeValueStoreSize + ( table->pageSize - 1 ) ) & ~( table->pageSize - 1 );
 
-            result =
-                bitable_wf_write( table->largeValueFile.file,
-                                  table->largeValueFile.buffer,
-                                  (uint32_t)( paddedStoreSize - table->largeValueStoreSize ) );
+            firstKey.data = sourcePage + firstIndice->itemOffset;
+            firstKey.size = firstIndice->keySize;
+
+            result = add_page_to_branch( table, &firstKey, 0 );
 
             if ( result != BR_SUCCESS )
             {
                 return result;
             }
 
-            table->largeValueStoreSize = paddedStoreSize;
+            leafLevel->unbranchedPage = 0;
         }
-        else if ( paddedStoreOffset > table->largeValueStoreSize )
+
+        memcpy( leafFile->buffer, sourcePage, table->pageSize );
+
+        *leafLevel->initialIndice = table->itemCount;
+
+        for ( where = 0; where < itemCount; ++where )
         {
-            // we have to pad at the end of the large value store before we append.
-            result = bitable_wf_write( table->largeValueFile.file, table->largeValueFile.buffer, (uint32_t)( paddedStoreOffset - table->largeValueStoreSize ) );
+            const BitableLeafIndice* itemIndice = (const BitableLeafIndice*)( leafLevel->itemIndices + where * table->leafIndiceSize );
+            BitableValue             key;
 
-            table->largeValueStoreSize = paddedStoreOffset;
+            dataFromRight = table->pageSize - itemIndice->itemOffset;
 
-            if ( result != BR_SUCCESS )
+            // large values are copied to the end of this table's large value store, and their offsets patched in the page.
+            if ( itemIndice->dataSize > BITABLE_MAX_KEY_SIZE )
             {
-                return result;
-            }
-        }
+                uint64_t*    largeValueOffset = (uint64_t*)( leafFile->buffer + table->pageSize - ( ( dataFromRight + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 ) ) );
+                BitableValue largeValue;
 
-        result = bitable_wf_write( table->largeValueFile.file, data->data, data->size );
+                largeValue.data = sourceLargeValues + *largeValueOffset;
+                largeValue.size = (int32_t)itemIndice->dataSize;
 
-        if ( result != BR_SUCCESS )
-        {
-            return result;
-        }
+                result = write_large_value( table, &largeValue, 1, largeValue.size, largeValueOffset );
+
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
+            }
 
-        *(uint64_t*)( leafFile->buffer + ( table->pageSize - newRightSize ) ) = table->largeValueStoreSize;
+            if ( table->bloomBitsPerKey > 0 )
+            {
+                key.data = leafFile->buffer + itemIndice->itemOffset;
+                key.size = itemIndice->keySize;
 
-        table->largeValueStoreSize += data->size;
-    }
+                bloom_add_key( table, &key );
+            }
 
-    {
-        uint16_t           keyOffset      = table->pageSize - newKeyAllocation;
-        BitableLeafIndice* itemIndice     = leafLevel->itemIndices + *leafLevel->itemCount;
+            ++table->itemCount;
+        }
 
-        if ( key->size > 0 )
+        // pick up the allocation from the last item in the page, so appends can carry on filling it.
         {
-            void* keyDestination = leafFile->buffer + keyOffset;
+            const BitableLeafIndice* lastIndice = (const BitableLeafIndice*)( leafLevel->itemIndices + ( itemCount - 1 ) * table->leafIndiceSize );
 
-            memcpy( keyDestination, key->data, key->size );
-        }
+            dataFromRight = table->pageSize - lastIndice->itemOffset;
 
-        itemIndice->dataSize   = data->size;
-        itemIndice->itemOffset = keyOffset;
-        itemIndice->keySize    = (uint16_t)key->size; // this is safe as maximum keysize is guaranteed to fit in a u16.
+            if ( lastIndice->dataSize <= BITABLE_MAX_KEY_SIZE )
+            {
+                leafLevel->rightSize = (uint16_t)( ( dataFromRight + lastIndice->dataSize + ( table->valueAlignment - 1 ) ) & ~( table->valueAlignment - 1 ) );
+            }
+            else
+            {
+                leafLevel->rightSize = (uint16_t)( ( dataFromRight + sizeof( uint64_t ) + ( sizeof( uint64_t ) - 1 ) ) & ~( sizeof( uint64_t ) - 1 ) );
+            }
 
-        leafLevel->leftSize  = newLeftSize;
-        leafLevel->rightSize = newRightSize;
+            leafLevel->leftSize = (uint16_t)( table->leafHeaderSize + itemCount * table->leafIndiceSize );
+        }
     }
 
-    *leafLevel->itemCount += 1;
-    ++table->itemCount;
-
     return BR_SUCCESS;
 }
 
@@ -464,6 +2105,19 @@ BitableResult bitable_writable_stats( const BitableWritable* table, BitableStats
     stats->leafPages           = table->leafLevel.leafPageCount;
     stats->pageSize            = table->pageSize;
     stats->valueAlignment      = table->valueAlignment;
+    stats->keyKind             = table->keyKind;
+    stats->bloomFilterSize     = 0;
+    stats->mappedSize          = 0;
+
+    if ( table->bloomBlocks != NULL )
+    {
+        stats->bloomFilterSize = table->bloomBlockCount * BITABLE_BLOOM_BLOCK_SIZE;
+    }
+    else if ( table->bloomBitsPerKey > 0 )
+    {
+        // the size the filter will be when it's built at close.
+        stats->bloomFilterSize = bloom_block_count( table->itemCount, table->bloomBitsPerKey ) * BITABLE_BLOOM_BLOCK_SIZE;
+    }
 
     return BR_SUCCESS;
 }
@@ -471,7 +2125,11 @@ BitableResult bitable_writable_stats( const BitableWritable* table, BitableStats
 static BitableResult finish_writes( BitableWritable* table, BitableCompletionOptions options )
 {
     BitableResult result;
-    BranchLevel* branchLevel;
+    BranchLevel*  branchLevel;
+    BitableHeader header;
+    int           singleFile = ( table->formatFlags & BITABLE_FORMAT_SINGLE_FILE ) != 0;
+
+    memset( &header, 0, sizeof( BitableHeader ) );
 
     for ( branchLevel = table->branchLevels; branchLevel < table->branchLevels + table->depth && branchLevel->bufferedFile.file != NULL; ++branchLevel )
     {
@@ -484,9 +2142,10 @@ static BitableResult finish_writes( BitableWritable* table, BitableCompletionOpt
             return result;
         }
 
-        if ( ( options & BCO_DURABLE ) == BCO_DURABLE )
+        // with a single file, the branch levels are flushed when they are copied into the leaf file, and synced as part of it.
+        if ( !singleFile )
         {
-            result = bitable_wf_sync( branchFile->file );
+            result = ( options & BCO_DURABLE ) == BCO_DURABLE ? bitable_wf_sync( branchFile->file ) : bitable_wf_flush( branchFile->file );
 
             if ( result != BR_SUCCESS )
             {
@@ -495,9 +2154,19 @@ static BitableResult finish_writes( BitableWritable* table, BitableCompletionOpt
         }
     }
 
-    if ( table->largeValueFile.file != NULL && ( options & BCO_DURABLE ) == BCO_DURABLE )
+    if ( table->largeValueFile.file != NULL && !singleFile )
+    {
+        result = ( options & BCO_DURABLE ) == BCO_DURABLE ? bitable_wf_sync( table->largeValueFile.file ) : bitable_wf_flush( table->largeValueFile.file );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    if ( table->bloomBitsPerKey > 0 && !singleFile )
     {
-        result = bitable_wf_sync( table->largeValueFile.file );
+        result = write_bloom_filter( table, options );
 
         if ( result != BR_SUCCESS )
         {
@@ -509,9 +2178,14 @@ static BitableResult finish_writes( BitableWritable* table, BitableCompletionOpt
         LeafLevel*    leafLevel = &table->leafLevel;
         BufferedFile* leafFile  = &leafLevel->bufferedFile;
 
-        if ( leafLevel->itemCount > 0 )
+        // an item reserved and never committed is dropped, along with the (otherwise empty) page it started, as is the page started for an abandoned one.
+        if ( ( table->pending.reserved && table->pending.startsPage ) || leafLevel->unbranchedPage )
+        {
+            --leafLevel->leafPageCount;
+        }
+        else if ( leafLevel->itemCount > 0 )
         {
-            result = bitable_wf_write( leafFile->file, leafFile->buffer, table->pageSize );
+            result = write_page( leafFile, table->pageSize );
 
             if ( result != BR_SUCCESS )
             {
@@ -519,9 +2193,9 @@ static BitableResult finish_writes( BitableWritable* table, BitableCompletionOpt
             }
         }
 
-        if ( ( options & BCO_DURABLE ) == BCO_DURABLE )
+        if ( singleFile )
         {
-            result = bitable_wf_sync( leafFile->file );
+            result = append_extents( table, &header );
 
             if ( result != BR_SUCCESS )
             {
@@ -529,42 +2203,65 @@ static BitableResult finish_writes( BitableWritable* table, BitableCompletionOpt
             }
         }
 
+        if ( ( options & BCO_DURABLE ) == BCO_DURABLE )
         {
-            BitableHeader header;
-
-            header.headerMarker        = BITABLE_HEADER_MARKER;
-            header.itemCount           = table->itemCount;
-            header.largeValueStoreSize = table->largeValueStoreSize;
-            header.depth               = table->depth;
-            header.keyAlignment        = table->keyAlignment;
-            header.valueAlignment      = table->valueAlignment;
-            header.pageSize            = table->pageSize;
-            header.leafPages           = leafLevel->leafPageCount;
-            header.checksum            = bitable_header_checksum( &header );
-
-            result = bitable_wf_seek( leafFile->file, 0 );
+            result = bitable_wf_sync( leafFile->file );
 
             if ( result != BR_SUCCESS )
             {
                 return result;
             }
+        }
 
-            result = bitable_wf_write( leafFile->file, &header, sizeof( BitableHeader ) );
+        header.headerMarker        = BITABLE_HEADER_MARKER;
+        header.itemCount           = table->itemCount;
+        header.largeValueStoreSize = table->largeValueStoreSize;
+        header.depth               = table->depth;
+        header.keyAlignment        = table->keyAlignment;
+        header.valueAlignment      = table->valueAlignment;
+        header.pageSize            = table->pageSize;
+        header.leafPages           = leafLevel->leafPageCount;
+        header.formatFlags         = table->formatFlags;
+        header.keyKind             = table->keyKind;
+        header.bloomBlockCount     = table->bloomBlockCount;
+        header.bloomHashCount      = table->bloomHashCount;
+        header.checksum            = bitable_header_checksum( &header );
+
+        result = bitable_wf_seek( leafFile->file, 0 );
 
-            if ( result != BR_SUCCESS )
-            {
-                return result;
-            }
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
 
-            if ( ( options & BCO_DURABLE ) == BCO_DURABLE )
-            {
-                result = bitable_wf_sync( leafFile->file );
-            }
+        result = bitable_wf_write( leafFile->file, &header, sizeof( BitableHeader ) );
 
-            if ( result != BR_SUCCESS )
-            {
-                return result;
-            }
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+
+        result = ( options & BCO_DURABLE ) == BCO_DURABLE ? bitable_wf_sync( leafFile->file ) : bitable_wf_flush( leafFile->file );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    // the table is complete in the leaf file, so the files used while appending can go.
+    if ( singleFile )
+    {
+        uint32_t where;
+
+        for ( where = 0; where < table->depth; ++where )
+        {
+            bitable_wf_delete( table->paths.branchPaths[ where ] );
+        }
+
+        if ( table->largeValueStoreSize > 0 )
+        {
+            bitable_wf_delete( table->paths.largeValuePath );
         }
     }
 
@@ -35,18 +35,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/mman.h>
 #include <fcntl.h>
 
+/* The size of a transparent huge page (on x86-64 and most aarch64 configurations), used to align anonymous copies.
+ */
+#define BITABLE_HUGE_PAGE_SIZE ( (size_t)2 * 1024 * 1024 )
+
 typedef struct BitableMemoryMappedFileHandle
 {
 
     int fileDescriptor;
 
+    /* The start and size of the whole mapping, which may differ from the address/size of the file for anonymous copies.
+     */
+    void*  mapping;
+    size_t mappingSize;
+
 } BitableMemoryMappedFileHandle;
 
 static void cleanup_mmf( BitableMemoryMappedFile* memoryMappedFile )
 {
-    if ( memoryMappedFile->address != NULL && memoryMappedFile->address != MAP_FAILED )
+    if ( memoryMappedFile->handle != NULL && memoryMappedFile->handle->mapping != NULL )
     {
-        munmap( memoryMappedFile->address, memoryMappedFile->size );
+        munmap( memoryMappedFile->handle->mapping, memoryMappedFile->handle->mappingSize );
     }
 
     memoryMappedFile->address = NULL;
@@ -65,14 +74,24 @@ static void cleanup_mmf( BitableMemoryMappedFile* memoryMappedFile )
 }
 
 BitableResult bitable_mmf_open( BitableMemoryMappedFile* memoryMappedFile, const char* path, BitableReadOpenFlags openFlags )
+{
+    return bitable_mmf_open_resident( memoryMappedFile, path, openFlags, BRR_NONE, NULL );
+}
+
+BitableResult bitable_mmf_open_resident( BitableMemoryMappedFile* memoryMappedFile,
+                                         const char* path,
+                                         BitableReadOpenFlags openFlags,
+                                         uint32_t residencyFlags,
+                                         uint64_t* lockBudget )
 {
     memset( memoryMappedFile, 0, sizeof( BitableMemoryMappedFile ) );
 
-    memoryMappedFile->handle = malloc( sizeof( BitableMemoryMappedFileHandle ) );
+    memoryMappedFile->handle = calloc( 1, sizeof( BitableMemoryMappedFileHandle ) );
 
     {
         struct stat fileStats;
-        int advice = POSIX_FADV_NORMAL;
+        int advice   = POSIX_FADV_NORMAL;
+        int mapFlags = MAP_SHARED;
 
         memoryMappedFile->handle->fileDescriptor = open( path, O_RDONLY );
 
@@ -119,19 +138,160 @@ BitableResult bitable_mmf_open( BitableMemoryMappedFile* memoryMappedFile, const
             return BR_FILE_TOO_LARGE;
         }
 
+#ifdef MAP_POPULATE
+        // an anonymous copy reads the whole file anyway, so there's no point pre-faulting the file mapping.
+        if ( ( residencyFlags & ( BRR_POPULATE | BRR_ANONYMOUS_COPY ) ) == BRR_POPULATE )
+        {
+            mapFlags |= MAP_POPULATE;
+        }
+#endif
+
         memoryMappedFile->size    = (size_t)fileStats.st_size;
-        memoryMappedFile->address = mmap( NULL, memoryMappedFile->size, PROT_READ, MAP_SHARED, memoryMappedFile->handle->fileDescriptor, 0 );
+        memoryMappedFile->address = mmap( NULL, memoryMappedFile->size, PROT_READ, mapFlags, memoryMappedFile->handle->fileDescriptor, 0 );
 
         if ( memoryMappedFile->address == MAP_FAILED )
         {
+            memoryMappedFile->address = NULL;
+
             cleanup_mmf( memoryMappedFile );
             return BR_FILE_OPERATION_FAILED;
         }
+
+        memoryMappedFile->handle->mapping     = memoryMappedFile->address;
+        memoryMappedFile->handle->mappingSize = memoryMappedFile->size;
+
+        // the mapping keeps the file contents available, so we don't need to hold on to the file descriptor.
+        close( memoryMappedFile->handle->fileDescriptor );
+        memoryMappedFile->handle->fileDescriptor = -1;
+
+        if ( ( residencyFlags & BRR_ANONYMOUS_COPY ) != 0 )
+        {
+            BitableMemoryMappedFile copy;
+
+            // if the copy fails, we just keep the file mapping.
+            if ( bitable_mmf_copy( &copy, memoryMappedFile->address, memoryMappedFile->size ) == BR_SUCCESS )
+            {
+                cleanup_mmf( memoryMappedFile );
+                *memoryMappedFile = copy;
+            }
+        }
+        else if ( ( residencyFlags & BRR_HUGE_PAGES ) != 0 )
+        {
+            // only takes effect where the kernel supports huge pages in the page cache for this file system.
+            bitable_mmf_advise_range( memoryMappedFile->address, memoryMappedFile->size, BRR_HUGE_PAGES );
+        }
+
+        if ( ( residencyFlags & BRR_LOCK ) != 0 && lockBudget != NULL )
+        {
+            bitable_mmf_lock_range( memoryMappedFile->address, memoryMappedFile->size, lockBudget );
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+
+BitableResult bitable_mmf_copy( BitableMemoryMappedFile* copy, const void* address, size_t size )
+{
+    size_t   mappingSize = size > 0 ? size : 1;
+    size_t   reserveSize = mappingSize;
+    uint8_t* reserved;
+    uint8_t* mapping;
+
+    memset( copy, 0, sizeof( BitableMemoryMappedFile ) );
+
+    if ( size >= BITABLE_HUGE_PAGE_SIZE )
+    {
+        mappingSize = ( size + BITABLE_HUGE_PAGE_SIZE - 1 ) & ~( BITABLE_HUGE_PAGE_SIZE - 1 );
+        reserveSize = mappingSize + BITABLE_HUGE_PAGE_SIZE;
+    }
+
+    reserved = mmap( NULL, reserveSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+    if ( reserved == MAP_FAILED )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
+    mapping = reserved;
+
+    // trim the reservation down to a huge page aligned range, so the copy can be backed entirely by huge pages.
+    if ( reserveSize > mappingSize )
+    {
+        size_t headSlack;
+
+        mapping   = (uint8_t*)( ( (uintptr_t)reserved + BITABLE_HUGE_PAGE_SIZE - 1 ) & ~(uintptr_t)( BITABLE_HUGE_PAGE_SIZE - 1 ) );
+        headSlack = (size_t)( mapping - reserved );
+
+        if ( headSlack > 0 )
+        {
+            munmap( reserved, headSlack );
+        }
+
+        if ( reserveSize - headSlack > mappingSize )
+        {
+            munmap( mapping + mappingSize, reserveSize - headSlack - mappingSize );
+        }
+
+        bitable_mmf_advise_range( mapping, mappingSize, BRR_HUGE_PAGES );
     }
 
+    memcpy( mapping, address, size );
+    mprotect( mapping, mappingSize, PROT_READ );
+
+    copy->handle                 = calloc( 1, sizeof( BitableMemoryMappedFileHandle ) );
+    copy->handle->fileDescriptor = -1;
+    copy->handle->mapping        = mapping;
+    copy->handle->mappingSize    = mappingSize;
+    copy->address                = mapping;
+    copy->size                   = size;
+
     return BR_SUCCESS;
 }
 
+void bitable_mmf_advise_range( const void* address, size_t size, uint32_t residencyFlags )
+{
+    size_t         pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    const uint8_t* start    = (const uint8_t*)( (uintptr_t)address & ~(uintptr_t)( pageSize - 1 ) );
+    size_t         length   = size + (size_t)( (const uint8_t*)address - start );
+
+    if ( size == 0 )
+    {
+        return;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if ( ( residencyFlags & BRR_HUGE_PAGES ) != 0 )
+    {
+        madvise( (void*)start, length, MADV_HUGEPAGE );
+    }
+#endif
+
+    if ( ( residencyFlags & BRR_POPULATE ) != 0 )
+    {
+        const volatile uint8_t* cursor = start;
+        size_t                  offset;
+
+        // start read-ahead for the whole range, then touch each page so it's mapped in.
+        madvise( (void*)start, length, MADV_WILLNEED );
+
+        for ( offset = 0; offset < length; offset += pageSize )
+        {
+            (void)cursor[ offset ];
+        }
+    }
+}
+
+int bitable_mmf_lock_range( const void* address, size_t size, uint64_t* lockBudget )
+{
+    if ( address != NULL && size <= *lockBudget && mlock( address, size ) == 0 )
+    {
+        *lockBudget -= size;
+        return 1;
+    }
+
+    return 0;
+}
 
 BitableResult bitable_mmf_close( BitableMemoryMappedFile* memoryMappedFile )
 {
@@ -35,13 +35,24 @@ typedef struct BitableMemoryMappedFileHandle
 
     HANDLE fileHandle;
 
+    /* Non-zero if the address is an anonymous copy allocated with VirtualAlloc, rather than a view of the file.
+     */
+    int anonymous;
+
 } BitableMemoryMappedFileHandle;
 
 static void cleanup_mmf( BitableMemoryMappedFile* memoryMappedFile )
 {
     if ( memoryMappedFile->address != NULL )
     {
-        UnmapViewOfFile( memoryMappedFile->address );
+        if ( memoryMappedFile->handle != NULL && memoryMappedFile->handle->anonymous )
+        {
+            VirtualFree( memoryMappedFile->address, 0, MEM_RELEASE );
+        }
+        else
+        {
+            UnmapViewOfFile( memoryMappedFile->address );
+        }
     }
 
     memoryMappedFile->address = NULL;
@@ -59,6 +70,15 @@ static void cleanup_mmf( BitableMemoryMappedFile* memoryMappedFile )
 }
 
 BitableResult bitable_mmf_open( BitableMemoryMappedFile* memoryMappedFile, const char* path, BitableReadOpenFlags openFlags )
+{
+    return bitable_mmf_open_resident( memoryMappedFile, path, openFlags, BRR_NONE, NULL );
+}
+
+BitableResult bitable_mmf_open_resident( BitableMemoryMappedFile* memoryMappedFile,
+                                         const char* path,
+                                         BitableReadOpenFlags openFlags,
+                                         uint32_t residencyFlags,
+                                         uint64_t* lockBudget )
 {
     DWORD         fileFlags          = FILE_ATTRIBUTE_NORMAL;
     int           widePathBufferSize = MultiByteToWideChar( CP_UTF8, 0, path, -1, NULL, 0 );
@@ -139,10 +159,92 @@ BitableResult bitable_mmf_open( BitableMemoryMappedFile* memoryMappedFile, const
         return BR_FILE_OPERATION_FAILED;
     }
 
+    // the view keeps the file contents available, so we don't need to hold on to the file handle.
+    CloseHandle( memoryMappedFile->handle->fileHandle );
+    memoryMappedFile->handle->fileHandle = NULL;
+
+    // there is no huge page backing for file views, so BRR_HUGE_PAGES has no effect here.
+    if ( ( residencyFlags & BRR_ANONYMOUS_COPY ) != 0 )
+    {
+        BitableMemoryMappedFile copy;
+
+        // if the copy fails, we just keep the file view.
+        if ( bitable_mmf_copy( &copy, memoryMappedFile->address, memoryMappedFile->size ) == BR_SUCCESS )
+        {
+            cleanup_mmf( memoryMappedFile );
+            *memoryMappedFile = copy;
+        }
+    }
+    else if ( ( residencyFlags & BRR_POPULATE ) != 0 )
+    {
+        bitable_mmf_advise_range( memoryMappedFile->address, memoryMappedFile->size, BRR_POPULATE );
+    }
+
+    if ( ( residencyFlags & BRR_LOCK ) != 0 && lockBudget != NULL )
+    {
+        bitable_mmf_lock_range( memoryMappedFile->address, memoryMappedFile->size, lockBudget );
+    }
+
     return BR_SUCCESS;
 }
 
 
+BitableResult bitable_mmf_copy( BitableMemoryMappedFile* copy, const void* address, size_t size )
+{
+    DWORD oldProtection;
+    void* mapping;
+
+    memset( copy, 0, sizeof( BitableMemoryMappedFile ) );
+
+    // large pages aren't used, because they require the lock pages privilege and can't be made read-only.
+    mapping = VirtualAlloc( NULL, size > 0 ? size : 1, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+
+    if ( mapping == NULL )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
+    memcpy( mapping, address, size );
+    VirtualProtect( mapping, size > 0 ? size : 1, PAGE_READONLY, &oldProtection );
+
+    copy->handle             = calloc( 1, sizeof( BitableMemoryMappedFileHandle ) );
+    copy->handle->fileHandle = NULL;
+    copy->handle->anonymous  = 1;
+    copy->address            = mapping;
+    copy->size               = size;
+
+    return BR_SUCCESS;
+}
+
+void bitable_mmf_advise_range( const void* address, size_t size, uint32_t residencyFlags )
+{
+    if ( ( residencyFlags & BRR_POPULATE ) != 0 )
+    {
+        SYSTEM_INFO             systemInfo;
+        const volatile uint8_t* cursor = (const volatile uint8_t*)address;
+        size_t                  offset;
+
+        GetSystemInfo( &systemInfo );
+
+        for ( offset = 0; offset < size; offset += systemInfo.dwPageSize )
+        {
+            (void)cursor[ offset ];
+        }
+    }
+}
+
+int bitable_mmf_lock_range( const void* address, size_t size, uint64_t* lockBudget )
+{
+    // VirtualLock is limited by the process working set size, so this may fail if the caller hasn't raised it.
+    if ( address != NULL && size <= *lockBudget && VirtualLock( (LPVOID)address, size ) )
+    {
+        *lockBudget -= size;
+        return 1;
+    }
+
+    return 0;
+}
+
 BitableResult bitable_mmf_close( BitableMemoryMappedFile* memoryMappedFile )
 {
     cleanup_mmf( memoryMappedFile );
@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "thread.h"
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct BitableThread
+{
+
+    pthread_t thread;
+    BitableThreadFunction* function;
+    void* context;
+
+} BitableThread;
+
+typedef struct BitableMutex
+{
+
+    pthread_mutex_t mutex;
+
+} BitableMutex;
+
+typedef struct BitableCondition
+{
+
+    pthread_cond_t condition;
+
+} BitableCondition;
+
+/** Entry point for threads, calls the thread function with its context.
+  * @param parameter The BitableThread being started.
+  * @return Always NULL.
+  */
+static void* thread_start( void* parameter )
+{
+    BitableThread* thread = (BitableThread*)parameter;
+
+    thread->function( thread->context );
+
+    return NULL;
+}
+
+BitableResult bitable_thread_create( BitableThread** thread, BitableThreadFunction* function, void* context )
+{
+    BitableThread* threadResult = malloc( sizeof( BitableThread ) );
+
+    if ( threadResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    threadResult->function = function;
+    threadResult->context  = context;
+
+    if ( pthread_create( &threadResult->thread, NULL, thread_start, threadResult ) != 0 )
+    {
+        free( threadResult );
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    *thread = threadResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_thread_join( BitableThread* thread )
+{
+    pthread_join( thread->thread, NULL );
+    free( thread );
+}
+
+uint32_t bitable_hardware_threads()
+{
+    long processors = sysconf( _SC_NPROCESSORS_ONLN );
+
+    return processors > 0 ? (uint32_t)processors : 1;
+}
+
+BitableResult bitable_mutex_create( BitableMutex** mutex )
+{
+    BitableMutex* mutexResult = malloc( sizeof( BitableMutex ) );
+
+    if ( mutexResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    if ( pthread_mutex_init( &mutexResult->mutex, NULL ) != 0 )
+    {
+        free( mutexResult );
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    *mutex = mutexResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_mutex_lock( BitableMutex* mutex )
+{
+    pthread_mutex_lock( &mutex->mutex );
+}
+
+void bitable_mutex_unlock( BitableMutex* mutex )
+{
+    pthread_mutex_unlock( &mutex->mutex );
+}
+
+void bitable_mutex_destroy( BitableMutex* mutex )
+{
+    pthread_mutex_destroy( &mutex->mutex );
+    free( mutex );
+}
+
+BitableResult bitable_condition_create( BitableCondition** condition )
+{
+    BitableCondition* conditionResult = malloc( sizeof( BitableCondition ) );
+
+    if ( conditionResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    if ( pthread_cond_init( &conditionResult->condition, NULL ) != 0 )
+    {
+        free( conditionResult );
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    *condition = conditionResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_condition_wait( BitableCondition* condition, BitableMutex* mutex )
+{
+    pthread_cond_wait( &condition->condition, &mutex->mutex );
+}
+
+void bitable_condition_broadcast( BitableCondition* condition )
+{
+    pthread_cond_broadcast( &condition->condition );
+}
+
+void bitable_condition_destroy( BitableCondition* condition )
+{
+    pthread_cond_destroy( &condition->condition );
+    free( condition );
+}
+
+int32_t bitable_atomic_load( const BitableAtomic* atomic )
+{
+    return __atomic_load_n( &atomic->value, __ATOMIC_ACQUIRE );
+}
+
+void bitable_atomic_store( BitableAtomic* atomic, int32_t value )
+{
+    __atomic_store_n( &atomic->value, value, __ATOMIC_RELEASE );
+}
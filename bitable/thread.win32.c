@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define WIN32_LEAN_AND_MEAN
+
+#include "thread.h"
+#include <stdlib.h>
+#include <windows.h>
+
+typedef struct BitableThread
+{
+
+    HANDLE threadHandle;
+    BitableThreadFunction* function;
+    void* context;
+
+} BitableThread;
+
+typedef struct BitableMutex
+{
+
+    CRITICAL_SECTION criticalSection;
+
+} BitableMutex;
+
+typedef struct BitableCondition
+{
+
+    CONDITION_VARIABLE conditionVariable;
+
+} BitableCondition;
+
+/** Entry point for threads, calls the thread function with its context.
+  * @param parameter The BitableThread being started.
+  * @return Always 0.
+  */
+static DWORD WINAPI thread_start( LPVOID parameter )
+{
+    BitableThread* thread = (BitableThread*)parameter;
+
+    thread->function( thread->context );
+
+    return 0;
+}
+
+BitableResult bitable_thread_create( BitableThread** thread, BitableThreadFunction* function, void* context )
+{
+    BitableThread* threadResult = malloc( sizeof( BitableThread ) );
+
+    if ( threadResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    threadResult->function     = function;
+    threadResult->context      = context;
+    threadResult->threadHandle = CreateThread( NULL, 0, thread_start, threadResult, 0, NULL );
+
+    if ( threadResult->threadHandle == NULL )
+    {
+        free( threadResult );
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    *thread = threadResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_thread_join( BitableThread* thread )
+{
+    WaitForSingleObject( thread->threadHandle, INFINITE );
+    CloseHandle( thread->threadHandle );
+    free( thread );
+}
+
+uint32_t bitable_hardware_threads()
+{
+    SYSTEM_INFO systemInfo;
+
+    GetSystemInfo( &systemInfo );
+
+    return systemInfo.dwNumberOfProcessors > 0 ? (uint32_t)systemInfo.dwNumberOfProcessors : 1;
+}
+
+BitableResult bitable_mutex_create( BitableMutex** mutex )
+{
+    BitableMutex* mutexResult = malloc( sizeof( BitableMutex ) );
+
+    if ( mutexResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    InitializeCriticalSection( &mutexResult->criticalSection );
+
+    *mutex = mutexResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_mutex_lock( BitableMutex* mutex )
+{
+    EnterCriticalSection( &mutex->criticalSection );
+}
+
+void bitable_mutex_unlock( BitableMutex* mutex )
+{
+    LeaveCriticalSection( &mutex->criticalSection );
+}
+
+void bitable_mutex_destroy( BitableMutex* mutex )
+{
+    DeleteCriticalSection( &mutex->criticalSection );
+    free( mutex );
+}
+
+BitableResult bitable_condition_create( BitableCondition** condition )
+{
+    BitableCondition* conditionResult = malloc( sizeof( BitableCondition ) );
+
+    if ( conditionResult == NULL )
+    {
+        return BR_THREAD_CREATE_FAILED;
+    }
+
+    InitializeConditionVariable( &conditionResult->conditionVariable );
+
+    *condition = conditionResult;
+
+    return BR_SUCCESS;
+}
+
+void bitable_condition_wait( BitableCondition* condition, BitableMutex* mutex )
+{
+    SleepConditionVariableCS( &condition->conditionVariable, &mutex->criticalSection, INFINITE );
+}
+
+void bitable_condition_broadcast( BitableCondition* condition )
+{
+    WakeAllConditionVariable( &condition->conditionVariable );
+}
+
+void bitable_condition_destroy( BitableCondition* condition )
+{
+    // condition variables don't hold any resources on Windows.
+    free( condition );
+}
+
+int32_t bitable_atomic_load( const BitableAtomic* atomic )
+{
+    // a compare exchange that never changes the value is a full barrier read.
+    return (int32_t)InterlockedCompareExchange( (volatile LONG*)&atomic->value, 0, 0 );
+}
+
+void bitable_atomic_store( BitableAtomic* atomic, int32_t value )
+{
+    InterlockedExchange( (volatile LONG*)&atomic->value, (LONG)value );
+}
@@ -22,25 +22,427 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-
 #define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
 
 #include "writablefile.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <memory.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <errno.h>
+
+#if defined( __linux__ )
+#include <sys/syscall.h>
+#if defined( __NR_io_uring_setup ) && defined( __NR_io_uring_enter )
+#include <linux/io_uring.h>
+#define BITABLE_IO_URING 1
+#endif
+#endif
+
+/* The alignment of buffers, file offsets and write sizes for direct I/O (the largest logical block size in common use) */
+#define BITABLE_DIRECT_ALIGNMENT 4096
+
+/* The maximum number of fragments written with a single system call by bitable_wf_write_gather */
+#define BITABLE_MAX_GATHER_FRAGMENTS 16
+
+/* The size of the chunks memory mapped files are grown in */
+#define BITABLE_MAPPED_CHUNK_SIZE ( 64 * 1024 * 1024 )
+
+#if defined( BITABLE_IO_URING )
+
+/** A write buffer for asynchronous writes.
+  */
+typedef struct AsyncBuffer
+{
+
+    uint8_t* data;
+    struct iovec vector; // the part of the buffer still to be written (while in flight)
+    uint64_t offset; // the file offset of the part still to be written
+
+} AsyncBuffer;
+
+/** An io_uring instance (used through the raw system calls) along with the ring of page buffers written through it.
+  */
+typedef struct AsyncRing
+{
+
+    int ringDescriptor;
+    void* submissionRing;
+    size_t submissionRingSize;
+    void* completionRing;
+    size_t completionRingSize;
+    struct io_uring_sqe* submissionEntries;
+    size_t submissionEntriesSize;
+    unsigned* submissionTail;
+    unsigned* submissionMask;
+    unsigned* submissionArray;
+    unsigned* completionHead;
+    unsigned* completionTail;
+    unsigned* completionMask;
+    struct io_uring_cqe* completionEntries;
+    AsyncBuffer* buffers;
+    uint32_t* freeBuffers; // stack of the buffers not being filled or in flight
+    uint32_t freeCount;
+    uint32_t bufferCount;
+    uint32_t current; // the buffer being filled
+    uint32_t inFlight; // the number of buffers submitted and not yet completed
+    uint64_t offset; // the file offset the buffer being filled will be written at
+    BitableResult error; // the first failed write (BR_SUCCESS if there hasn't been one)
+
+} AsyncRing;
+
+#endif
 
 typedef struct BitableWritableFile
 {
 
     int fileDescriptor;
+    uint8_t* buffer; // write combining buffer (NULL if writes go straight through)
+    uint32_t bufferSize;
+    uint32_t bufferUsed;
+    uint64_t position; // the file position, including data still in the buffer
+    uint64_t fileEnd; // the end of the data written to the file, including data still in the buffer
+    uint64_t preallocated; // the size of the space preallocated for the file
+    int direct; // the file is open with O_DIRECT, so writes have to be aligned
+    int mapped; // writes go to a shared memory mapping of the file, instead of through the buffer
+    uint8_t* mapping; // the mapping of the file, NULL until the first write
+    uint64_t mappingSize; // the size of the mapping (and the file, until it is closed)
+
+#if defined( BITABLE_IO_URING )
+    AsyncRing* ring; // when writes are asynchronous, the ring of buffers (buffer is the one being filled), otherwise NULL
+#endif
 
 } BitableWritableFile;
 
+/** Allocate a write buffer, aligned for direct I/O.
+  * @param size The size of the buffer in bytes.
+  * @return The buffer (to be freed with free), or NULL if it couldn't be allocated.
+  */
+static uint8_t* allocate_buffer( uint32_t size )
+{
+    void* buffer;
+
+    if ( posix_memalign( &buffer, BITABLE_DIRECT_ALIGNMENT, size ) != 0 )
+    {
+        return NULL;
+    }
+
+    return buffer;
+}
+
+#if defined( BITABLE_IO_URING )
+
+/** Tear down an io_uring instance and free the buffers. Any writes still in flight should already have completed.
+  * @param ring The ring to destroy.
+  */
+static void ring_destroy( AsyncRing* ring )
+{
+    uint32_t where;
+
+    if ( ring->submissionEntries != NULL && ring->submissionEntries != MAP_FAILED )
+    {
+        munmap( ring->submissionEntries, ring->submissionEntriesSize );
+    }
+
+    if ( ring->completionRing != NULL && ring->completionRing != MAP_FAILED && ring->completionRing != ring->submissionRing )
+    {
+        munmap( ring->completionRing, ring->completionRingSize );
+    }
+
+    if ( ring->submissionRing != NULL && ring->submissionRing != MAP_FAILED )
+    {
+        munmap( ring->submissionRing, ring->submissionRingSize );
+    }
+
+    if ( ring->ringDescriptor != -1 )
+    {
+        close( ring->ringDescriptor );
+    }
+
+    if ( ring->buffers != NULL )
+    {
+        for ( where = 0; where < ring->bufferCount; ++where )
+        {
+            free( ring->buffers[ where ].data );
+        }
+    }
+
+    free( ring->buffers );
+    free( ring->freeBuffers );
+    free( ring );
+}
+
+/** Set up an io_uring instance and a ring of buffers for asynchronous writes.
+  * @param bufferSize The size of each buffer.
+  * @param bufferCount The number of buffers (the maximum number of writes in flight is one less, as one is always being filled).
+  * @return The ring, or NULL if io_uring isn't available (for example, the kernel is too old or it is blocked by a sandbox) or the buffers couldn't be allocated.
+  */
+static AsyncRing* ring_create( uint32_t bufferSize, uint32_t bufferCount )
+{
+    AsyncRing*             ring = calloc( 1, sizeof( AsyncRing ) );
+    struct io_uring_params parameters;
+    uint32_t               where;
+
+    if ( ring == NULL )
+    {
+        return NULL;
+    }
+
+    memset( &parameters, 0, sizeof( parameters ) );
+
+    ring->ringDescriptor = (int)syscall( __NR_io_uring_setup, bufferCount, &parameters );
+
+    if ( ring->ringDescriptor == -1 )
+    {
+        ring_destroy( ring );
+        return NULL;
+    }
+
+    ring->submissionRingSize    = parameters.sq_off.array + parameters.sq_entries * sizeof( unsigned );
+    ring->completionRingSize    = parameters.cq_off.cqes + parameters.cq_entries * sizeof( struct io_uring_cqe );
+    ring->submissionEntriesSize = parameters.sq_entries * sizeof( struct io_uring_sqe );
+
+    // newer kernels map both rings with a single mapping.
+    if ( ( parameters.features & IORING_FEAT_SINGLE_MMAP ) != 0 )
+    {
+        ring->submissionRingSize = ring->completionRingSize > ring->submissionRingSize ? ring->completionRingSize : ring->submissionRingSize;
+        ring->completionRingSize = ring->submissionRingSize;
+    }
+
+    ring->submissionRing = mmap( NULL, ring->submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringDescriptor, IORING_OFF_SQ_RING );
+
+    if ( ring->submissionRing == MAP_FAILED )
+    {
+        ring_destroy( ring );
+        return NULL;
+    }
+
+    if ( ( parameters.features & IORING_FEAT_SINGLE_MMAP ) != 0 )
+    {
+        ring->completionRing = ring->submissionRing;
+    }
+    else
+    {
+        ring->completionRing = mmap( NULL, ring->completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringDescriptor, IORING_OFF_CQ_RING );
+
+        if ( ring->completionRing == MAP_FAILED )
+        {
+            ring_destroy( ring );
+            return NULL;
+        }
+    }
+
+    ring->submissionEntries = mmap( NULL, ring->submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringDescriptor, IORING_OFF_SQES );
+
+    if ( ring->submissionEntries == MAP_FAILED )
+    {
+        ring_destroy( ring );
+        return NULL;
+    }
+
+    ring->submissionTail    = (unsigned*)( (uint8_t*)ring->submissionRing + parameters.sq_off.tail );
+    ring->submissionMask    = (unsigned*)( (uint8_t*)ring->submissionRing + parameters.sq_off.ring_mask );
+    ring->submissionArray   = (unsigned*)( (uint8_t*)ring->submissionRing + parameters.sq_off.array );
+    ring->completionHead    = (unsigned*)( (uint8_t*)ring->completionRing + parameters.cq_off.head );
+    ring->completionTail    = (unsigned*)( (uint8_t*)ring->completionRing + parameters.cq_off.tail );
+    ring->completionMask    = (unsigned*)( (uint8_t*)ring->completionRing + parameters.cq_off.ring_mask );
+    ring->completionEntries = (struct io_uring_cqe*)( (uint8_t*)ring->completionRing + parameters.cq_off.cqes );
+
+    ring->buffers     = calloc( bufferCount, sizeof( AsyncBuffer ) );
+    ring->freeBuffers = calloc( bufferCount, sizeof( uint32_t ) );
+    ring->bufferCount = bufferCount;
+    ring->error       = BR_SUCCESS;
+
+    if ( ring->buffers == NULL || ring->freeBuffers == NULL )
+    {
+        ring_destroy( ring );
+        return NULL;
+    }
+
+    for ( where = 0; where < bufferCount; ++where )
+    {
+        ring->buffers[ where ].data = allocate_buffer( bufferSize );
+
+        if ( ring->buffers[ where ].data == NULL )
+        {
+            ring_destroy( ring );
+            return NULL;
+        }
+    }
+
+    // buffer 0 is filled first, the rest start free.
+    for ( where = bufferCount - 1; where > 0; --where )
+    {
+        ring->freeBuffers[ ring->freeCount++ ] = where;
+    }
+
+    ring->current = 0;
+
+    return ring;
+}
+
+/** Queue the write of the unwritten part of a buffer and submit it to the kernel.
+  * @param file The file being written.
+  * @param ring The ring for the file.
+  * @param index The index of the buffer to write.
+  * @return BR_SUCCESS if the write was submitted, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult ring_submit( BitableWritableFile* file, AsyncRing* ring, uint32_t index )
+{
+    AsyncBuffer*         buffer = ring->buffers + index;
+    unsigned             tail   = *ring->submissionTail;
+    unsigned             slot   = tail & *ring->submissionMask;
+    struct io_uring_sqe* entry  = ring->submissionEntries + slot;
+
+    // there is a submission entry for every buffer, so the submission queue can't be full.
+    memset( entry, 0, sizeof( struct io_uring_sqe ) );
+
+    entry->opcode    = IORING_OP_WRITEV;
+    entry->fd        = file->fileDescriptor;
+    entry->off       = buffer->offset;
+    entry->addr      = (uint64_t)(uintptr_t)&buffer->vector;
+    entry->len       = 1;
+    entry->user_data = index;
+
+    ring->submissionArray[ slot ] = slot;
+
+    __atomic_store_n( ring->submissionTail, tail + 1, __ATOMIC_RELEASE );
+
+    for ( ;; )
+    {
+        if ( syscall( __NR_io_uring_enter, ring->ringDescriptor, 1, 0, 0, NULL, 0 ) >= 0 )
+        {
+            return BR_SUCCESS;
+        }
+
+        if ( errno != EINTR && errno != EAGAIN )
+        {
+            return BR_FILE_OPERATION_FAILED;
+        }
+    }
+}
+
+/** Reap the completed writes from the ring, returning their buffers to the free stack (or resubmitting the rest of short writes).
+  * @param file The file being written.
+  * @param ring The ring for the file.
+  * @param wait Non-zero to wait for at least one write to complete if none have.
+  */
+static void ring_reap( BitableWritableFile* file, AsyncRing* ring, int wait )
+{
+    unsigned head = *ring->completionHead;
+    unsigned tail = __atomic_load_n( ring->completionTail, __ATOMIC_ACQUIRE );
+
+    while ( head == tail && wait && ring->inFlight > 0 )
+    {
+        if ( syscall( __NR_io_uring_enter, ring->ringDescriptor, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 ) == -1 && errno != EINTR && errno != EAGAIN )
+        {
+            // the ring is unusable, so the writes in flight can't be accounted for.
+            ring->error    = BR_FILE_OPERATION_FAILED;
+            ring->inFlight = 0;
+            return;
+        }
+
+        tail = __atomic_load_n( ring->completionTail, __ATOMIC_ACQUIRE );
+    }
+
+    for ( ; head != tail; ++head )
+    {
+        const struct io_uring_cqe* completion = ring->completionEntries + ( head & *ring->completionMask );
+        uint32_t                   index      = (uint32_t)completion->user_data;
+        AsyncBuffer*               buffer     = ring->buffers + index;
+
+        if ( completion->res > 0 && (size_t)completion->res < buffer->vector.iov_len && ring->error == BR_SUCCESS )
+        {
+            buffer->vector.iov_base  = (uint8_t*)buffer->vector.iov_base + completion->res;
+            buffer->vector.iov_len  -= (size_t)completion->res;
+            buffer->offset          += (uint64_t)completion->res;
+
+            if ( ring_submit( file, ring, index ) == BR_SUCCESS )
+            {
+                continue;
+            }
+
+            ring->error = BR_FILE_OPERATION_FAILED;
+        }
+        else if ( completion->res <= 0 && ring->error == BR_SUCCESS )
+        {
+            ring->error = BR_FILE_OPERATION_FAILED;
+        }
+
+        ring->freeBuffers[ ring->freeCount++ ] = index;
+        --ring->inFlight;
+    }
+
+    __atomic_store_n( ring->completionHead, head, __ATOMIC_RELEASE );
+}
+
+/** Submit the buffer being filled and move on to a free one, reaping completions (and waiting if every buffer is in flight).
+  * @param file The file being written.
+  * @param ring The ring for the file.
+  * @return BR_SUCCESS if the buffer was submitted, otherwise the error from the first failed write.
+  */
+static BitableResult ring_flush( BitableWritableFile* file, AsyncRing* ring )
+{
+    AsyncBuffer* buffer = ring->buffers + ring->current;
+
+    if ( file->bufferUsed > 0 && ring->error == BR_SUCCESS )
+    {
+        buffer->vector.iov_base = buffer->data;
+        buffer->vector.iov_len  = file->bufferUsed;
+        buffer->offset          = ring->offset;
+
+        ring->offset     += file->bufferUsed;
+        file->bufferUsed  = 0;
+
+        if ( ring_submit( file, ring, ring->current ) != BR_SUCCESS )
+        {
+            ring->error = BR_FILE_OPERATION_FAILED;
+            return ring->error;
+        }
+
+        ++ring->inFlight;
+
+        ring_reap( file, ring, 0 );
+
+        while ( ring->freeCount == 0 && ring->error == BR_SUCCESS )
+        {
+            ring_reap( file, ring, 1 );
+        }
+
+        if ( ring->freeCount > 0 )
+        {
+            ring->current = ring->freeBuffers[ --ring->freeCount ];
+            file->buffer  = ring->buffers[ ring->current ].data;
+        }
+    }
+
+    file->bufferUsed = 0;
+
+    return ring->error;
+}
+
+/** Wait for all the writes in flight to complete.
+  * @param file The file being written.
+  * @param ring The ring for the file.
+  * @return BR_SUCCESS if all the writes completed, otherwise the error from the first failed write.
+  */
+static BitableResult ring_drain( BitableWritableFile* file, AsyncRing* ring )
+{
+    while ( ring->inFlight > 0 )
+    {
+        ring_reap( file, ring, 1 );
+    }
+
+    return ring->error;
+}
+
+#endif
+
 static void cleanup_wf( BitableWritableFile* file )
 {
     if ( file != NULL )
@@ -50,15 +452,324 @@ static void cleanup_wf( BitableWritableFile* file )
             close( file->fileDescriptor );
         }
 
+#if defined( BITABLE_IO_URING )
+        if ( file->ring != NULL )
+        {
+            ring_destroy( file->ring );
+            file->buffer = NULL; // owned by the ring
+        }
+#endif
+
+        if ( file->mapping != NULL )
+        {
+            munmap( file->mapping, (size_t)file->mappingSize );
+        }
+
+        free( file->buffer );
         free( file );
     }
 }
 
+/** Write out a set of buffers with as few system calls as possible, handling short writes.
+  * @param fileDescriptor The file to write to.
+  * @param buffers The buffers to write, which will be modified to track progress.
+  * @param bufferCount The number of buffers.
+  * @return BR_SUCCESS if everything was written, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult write_vectors( int fileDescriptor, struct iovec* buffers, int bufferCount )
+{
+    while ( bufferCount > 0 )
+    {
+        ssize_t written = writev( fileDescriptor, buffers, bufferCount );
+
+        if ( written == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            return BR_FILE_OPERATION_FAILED;
+        }
+
+        // skip past the buffers written, and into the one partially written.
+        while ( bufferCount > 0 && (size_t)written >= buffers->iov_len )
+        {
+            written -= (ssize_t)buffers->iov_len;
+            ++buffers;
+            --bufferCount;
+        }
+
+        if ( bufferCount > 0 )
+        {
+            buffers->iov_base  = (uint8_t*)buffers->iov_base + written;
+            buffers->iov_len  -= (size_t)written;
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Stop using direct I/O for a file, so unaligned writes can go through the page cache. Any asynchronous writes in flight are completed first.
+  * @param file The file to stop using direct I/O for.
+  * @return BR_SUCCESS if direct I/O was turned off, otherwise the error from completing writes or changing the file flags.
+  */
+static BitableResult drop_direct( BitableWritableFile* file )
+{
+    BitableResult result = BR_SUCCESS;
+    int           flags;
+
+#if defined( BITABLE_IO_URING )
+    if ( file->ring != NULL )
+    {
+        result = ring_drain( file, file->ring );
+    }
+#endif
+
+    file->direct = 0;
+    flags        = fcntl( file->fileDescriptor, F_GETFL );
+
+    if ( flags == -1 || fcntl( file->fileDescriptor, F_SETFL, flags & ~O_DIRECT ) == -1 )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
+    return result;
+}
+
+/** Make sure a range of a memory mapped file is mapped, growing the file (in chunks, or to the preallocated size) and the mapping if needed.
+  * @param file The memory mapped file.
+  * @param end The end of the range that needs to be mapped.
+  * @return BR_SUCCESS if the range is mapped, BR_FILE_OPERATION_FAILED if the file or the mapping couldn't be grown.
+  */
+static BitableResult map_range( BitableWritableFile* file, uint64_t end )
+{
+    uint64_t newSize;
+    void*    newMapping;
+
+    if ( end <= file->mappingSize )
+    {
+        return BR_SUCCESS;
+    }
+
+    newSize = ( end + ( BITABLE_MAPPED_CHUNK_SIZE - 1 ) ) & ~(uint64_t)( BITABLE_MAPPED_CHUNK_SIZE - 1 );
+    newSize = file->preallocated > newSize ? file->preallocated : newSize;
+
+    if ( (uint64_t)(size_t)newSize != newSize )
+    {
+        return BR_FILE_TOO_LARGE;
+    }
+
+#if defined( __linux__ )
+    // allocate the new chunk's extents up front, falling back to a sparse extension where fallocate isn't supported.
+    if ( fallocate( file->fileDescriptor, 0, (off_t)file->mappingSize, (off_t)( newSize - file->mappingSize ) ) != 0 &&
+         ftruncate( file->fileDescriptor, (off_t)newSize ) != 0 )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+#else
+    if ( ftruncate( file->fileDescriptor, (off_t)newSize ) != 0 )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+#endif
+
+    if ( file->mapping == NULL )
+    {
+        newMapping = mmap( NULL, (size_t)newSize, PROT_READ | PROT_WRITE, MAP_SHARED, file->fileDescriptor, 0 );
+    }
+    else
+    {
+#if defined( __linux__ )
+        newMapping = mremap( file->mapping, (size_t)file->mappingSize, (size_t)newSize, MREMAP_MAYMOVE );
+#else
+        munmap( file->mapping, (size_t)file->mappingSize );
+
+        file->mapping     = NULL;
+        file->mappingSize = 0;
+        newMapping        = mmap( NULL, (size_t)newSize, PROT_READ | PROT_WRITE, MAP_SHARED, file->fileDescriptor, 0 );
+#endif
+    }
+
+    if ( newMapping == MAP_FAILED )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
+    file->mapping     = newMapping;
+    file->mappingSize = newSize;
+
+    return BR_SUCCESS;
+}
+
+/** Whether writes to a file have to be copied through its buffers, rather than going straight out when they're large.
+  * @param file The file being written.
+  * @return Non-zero for asynchronous and direct writes, zero otherwise.
+  */
+static int writes_through_buffer( const BitableWritableFile* file )
+{
+#if defined( BITABLE_IO_URING )
+    if ( file->ring != NULL )
+    {
+        return 1;
+    }
+#endif
+
+    return file->direct;
+}
+
+/** Write out the data in the write combining buffer (for asynchronous writes, submit it).
+  * @param file The file to flush the buffer of.
+  * @return BR_SUCCESS if the buffer was written, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult flush_buffer( BitableWritableFile* file )
+{
+    struct iovec  buffer;
+    BitableResult result;
+
+    // direct writes need an aligned offset and size, once that can't be kept up the rest of the file goes through the page cache.
+    if ( file->direct && ( ( ( file->position - file->bufferUsed ) | file->bufferUsed ) & ( BITABLE_DIRECT_ALIGNMENT - 1 ) ) != 0 )
+    {
+        result = drop_direct( file );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+#if defined( BITABLE_IO_URING )
+    if ( file->ring != NULL )
+    {
+        return ring_flush( file, file->ring );
+    }
+#endif
+
+    if ( file->bufferUsed == 0 )
+    {
+        return BR_SUCCESS;
+    }
+
+    buffer.iov_base = file->buffer;
+    buffer.iov_len  = file->bufferUsed;
+
+    result = write_vectors( file->fileDescriptor, &buffer, 1 );
+
+    file->bufferUsed = 0;
+
+    return result;
+}
+
+/** Write out the data in the write combining buffer and wait for any asynchronous writes to complete.
+  * @param file The file to complete the writes of.
+  * @return BR_SUCCESS if everything was written, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult complete_writes( BitableWritableFile* file )
+{
+    BitableResult result = BR_SUCCESS;
+
+    // write the aligned part of the buffer directly, leaving only the unaligned tail to go through the page cache.
+    if ( file->direct && ( file->bufferUsed & ( BITABLE_DIRECT_ALIGNMENT - 1 ) ) != 0 && file->bufferUsed >= BITABLE_DIRECT_ALIGNMENT )
+    {
+        uint32_t tailSize    = file->bufferUsed & ( BITABLE_DIRECT_ALIGNMENT - 1 );
+        uint32_t alignedSize = file->bufferUsed - tailSize;
+        uint8_t  tail[ BITABLE_DIRECT_ALIGNMENT ];
+
+        memcpy( tail, file->buffer + alignedSize, tailSize );
+
+        file->bufferUsed  = alignedSize;
+        file->position   -= tailSize;
+        result            = flush_buffer( file );
+        file->position   += tailSize;
+
+        // the buffer may have changed to another free one for asynchronous writes.
+        if ( result == BR_SUCCESS )
+        {
+            memcpy( file->buffer, tail, tailSize );
+
+            file->bufferUsed = tailSize;
+        }
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        result = flush_buffer( file );
+    }
+
+#if defined( BITABLE_IO_URING )
+    if ( file->ring != NULL )
+    {
+        BitableResult drainResult = ring_drain( file, file->ring );
+
+        return result != BR_SUCCESS ? result : drainResult;
+    }
+#endif
+
+    return result;
+}
+
 BitableResult bitable_wf_create( BitableWritableFile** file, const char* path )
+{
+    return bitable_wf_create_buffered( file, path, 0 );
+}
+
+BitableResult bitable_wf_create_buffered( BitableWritableFile** file, const char* path, uint32_t bufferSize )
+{
+    return bitable_wf_create_async( file, path, bufferSize, 0 );
+}
+
+BitableResult bitable_wf_create_async( BitableWritableFile** file, const char* path, uint32_t bufferSize, uint32_t queueDepth )
+{
+    BitableWritableFileOptions options;
+
+    options.bufferSize = bufferSize;
+    options.queueDepth = queueDepth;
+    options.flags      = BWFF_NONE;
+
+    return bitable_wf_create_with_options( file, path, &options );
+}
+
+BitableResult bitable_wf_create_with_options( BitableWritableFile** file, const char* path, const BitableWritableFileOptions* options )
 {
     BitableWritableFile* fileResult = calloc( 1, sizeof( BitableWritableFile ) );
+    uint32_t             bufferSize = options->bufferSize;
+    int                  openFlags  = O_CREAT | O_TRUNC | O_WRONLY;
+
+    fileResult->fileDescriptor = -1;
+
+    // memory mapped files need to be readable to be mapped, and don't use the buffers or direct I/O.
+    if ( ( options->flags & BWFF_MAPPED ) != 0 )
+    {
+        fileResult->fileDescriptor = open( path, O_CREAT | O_TRUNC | O_RDWR, 0666 );
+        fileResult->mapped         = 1;
+
+        if ( fileResult->fileDescriptor == -1 )
+        {
+            cleanup_wf( fileResult );
+            return BR_FILE_OPEN_FAILED;
+        }
+
+        *file = fileResult;
+
+        return BR_SUCCESS;
+    }
 
-    fileResult->fileDescriptor = open( path, O_CREAT | O_TRUNC | O_WRONLY, 0666 );
+    // direct writes are always buffered, in whole blocks.
+    if ( ( options->flags & BWFF_DIRECT ) != 0 )
+    {
+        bufferSize = bufferSize < BITABLE_DIRECT_ALIGNMENT ? 
+            BITABLE_DIRECT_ALIGNMENT : 
+            ( bufferSize + ( BITABLE_DIRECT_ALIGNMENT - 1 ) ) & ~(uint32_t)( BITABLE_DIRECT_ALIGNMENT - 1 );
+
+        fileResult->fileDescriptor = open( path, openFlags | O_DIRECT, 0666 );
+        fileResult->direct         = fileResult->fileDescriptor != -1;
+    }
+
+    // file systems that don't support direct I/O (like tmpfs) refuse the open, so fall back to the page cache.
+    if ( fileResult->fileDescriptor == -1 )
+    {
+        fileResult->fileDescriptor = open( path, openFlags, 0666 );
+    }
 
     if ( fileResult->fileDescriptor == -1 )
     {
@@ -66,34 +777,351 @@ BitableResult bitable_wf_create( BitableWritableFile** file, const char* path )
         return BR_FILE_OPEN_FAILED;
     }
 
+#if defined( BITABLE_IO_URING )
+    if ( bufferSize > 0 && options->queueDepth > 0 )
+    {
+        // one buffer is always being filled, so there is one more than the number that can be in flight.
+        fileResult->ring = ring_create( bufferSize, options->queueDepth + 1 );
+
+        if ( fileResult->ring != NULL )
+        {
+            fileResult->buffer     = fileResult->ring->buffers[ fileResult->ring->current ].data;
+            fileResult->bufferSize = bufferSize;
+        }
+    }
+#endif
+
+    if ( bufferSize > 0 && fileResult->buffer == NULL )
+    {
+        fileResult->buffer     = allocate_buffer( bufferSize );
+        fileResult->bufferSize = bufferSize;
+
+        if ( fileResult->buffer == NULL )
+        {
+            cleanup_wf( fileResult );
+            return BR_FILE_OPEN_FAILED;
+        }
+    }
+
     *file = fileResult;
 
     return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_preallocate( BitableWritableFile* file, uint64_t size )
+{
+    if ( size <= file->preallocated )
+    {
+        return BR_SUCCESS;
+    }
+
+    // memory mapped files are grown to the preallocated size when they are first mapped.
+    if ( file->mapped )
+    {
+        file->preallocated = size;
+
+        return BR_SUCCESS;
+    }
 
+#if defined( __linux__ ) && defined( FALLOC_FL_KEEP_SIZE )
+    // reserve the extents without changing the file size, so a table that comes in under the estimate doesn't need trimming by readers.
+    if ( fallocate( file->fileDescriptor, FALLOC_FL_KEEP_SIZE, 0, (off_t)size ) == 0 )
+    {
+        file->preallocated = size;
+    }
+#endif
+
+    return BR_SUCCESS;
+}
+
+int bitable_wf_is_mapped( const BitableWritableFile* file )
+{
+    return file->mapped;
 }
 
 BitableResult bitable_wf_seek( BitableWritableFile* file, int64_t position )
 {
+    BitableResult result = complete_writes( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    // memory mapped writes are at explicit offsets too.
+    if ( file->mapped )
+    {
+        file->position = (uint64_t)position;
+
+        return BR_SUCCESS;
+    }
+
+#if defined( BITABLE_IO_URING )
+    // asynchronous writes are at explicit offsets, so there is no file pointer to move.
+    if ( file->ring != NULL )
+    {
+        file->ring->offset = (uint64_t)position;
+        file->position     = (uint64_t)position;
+
+        return BR_SUCCESS;
+    }
+#endif
+
     if ( lseek( file->fileDescriptor, (off_t)position, SEEK_SET ) == (off_t)-1 )
     {
         return BR_FILE_OPERATION_FAILED;
     }
 
+    file->position = (uint64_t)position;
+
     return BR_SUCCESS;
 }
 
 BitableResult bitable_wf_write( BitableWritableFile* file, const void* data, uint32_t size )
 {
-    if ( write( file->fileDescriptor, data, size ) == -1 )
+    BitableResult result;
+
+    if ( size == 0 )
+    {
+        return BR_SUCCESS;
+    }
+
+    if ( file->mapped )
+    {
+        void* destination;
+
+        result = bitable_wf_reserve( file, size, &destination );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+
+        memcpy( destination, data, size );
+
+        return bitable_wf_commit( file, size );
+    }
+
+    file->fileEnd = file->position + size > file->fileEnd ? file->position + size : file->fileEnd;
+
+#if defined( BITABLE_IO_URING )
+    // after a failed asynchronous write, the buffer being filled may still be in flight.
+    if ( file->ring != NULL && file->ring->error != BR_SUCCESS )
+    {
+        return file->ring->error;
+    }
+#endif
+
+    // asynchronous and direct writes always go through the buffers, as the caller's data can't be held on to after returning (and may not be aligned).
+    if ( writes_through_buffer( file ) )
+    {
+        const uint8_t* source = (const uint8_t*)data;
+
+        while ( size > 0 )
+        {
+            uint32_t copySize = file->bufferSize - file->bufferUsed < size ? file->bufferSize - file->bufferUsed : size;
+
+            memcpy( file->buffer + file->bufferUsed, source, copySize );
+
+            file->bufferUsed += copySize;
+            file->position   += copySize;
+            source           += copySize;
+            size             -= copySize;
+
+            if ( file->bufferUsed == file->bufferSize )
+            {
+                result = flush_buffer( file );
+
+                if ( result != BR_SUCCESS )
+                {
+                    return result;
+                }
+            }
+        }
+
+        return BR_SUCCESS;
+    }
+
+    if ( file->bufferUsed + (uint64_t)size <= file->bufferSize )
+    {
+        memcpy( file->buffer + file->bufferUsed, data, size );
+
+        file->bufferUsed += size;
+        file->position   += size;
+
+        return BR_SUCCESS;
+    }
+
+    // writes that wouldn't fit in an empty buffer go out along with the buffered data in a single call.
+    if ( size >= file->bufferSize )
+    {
+        struct iovec buffers[ 2 ];
+        int          bufferCount = 0;
+
+        if ( file->bufferUsed > 0 )
+        {
+            buffers[ bufferCount ].iov_base = file->buffer;
+            buffers[ bufferCount ].iov_len  = file->bufferUsed;
+            ++bufferCount;
+        }
+
+        buffers[ bufferCount ].iov_base = (void*)data;
+        buffers[ bufferCount ].iov_len  = size;
+        ++bufferCount;
+
+        file->bufferUsed  = 0;
+        file->position   += size;
+
+        return write_vectors( file->fileDescriptor, buffers, bufferCount );
+    }
+
+    // only stage the data once the buffer has gone out, so it can't be written after a failed flush (and out of order).
+    result = flush_buffer( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    memcpy( file->buffer, data, size );
+
+    file->bufferUsed  = size;
+    file->position   += size;
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_write_gather( BitableWritableFile* file, const BitableValue* fragments, uint32_t fragmentCount )
+{
+    struct iovec  buffers[ BITABLE_MAX_GATHER_FRAGMENTS + 1 ];
+    int           bufferCount = 0;
+    uint64_t      totalSize   = 0;
+    uint32_t      where;
+    BitableResult result;
+
+    for ( where = 0; where < fragmentCount; ++where )
+    {
+        totalSize += (uint32_t)fragments[ where ].size;
+    }
+
+    // gathers that fit in the buffer (or that have to be copied through it anyway) are written a fragment at a time, as are ones with too many fragments for one call.
+    if ( file->mapped || writes_through_buffer( file ) || totalSize < file->bufferSize || fragmentCount > BITABLE_MAX_GATHER_FRAGMENTS )
+    {
+        for ( where = 0; where < fragmentCount; ++where )
+        {
+            result = bitable_wf_write( file, fragments[ where ].data, (uint32_t)fragments[ where ].size );
+
+            if ( result != BR_SUCCESS )
+            {
+                return result;
+            }
+        }
+
+        return BR_SUCCESS;
+    }
+
+    // otherwise the fragments go out along with the buffered data in a single call.
+    if ( file->bufferUsed > 0 )
+    {
+        buffers[ bufferCount ].iov_base = file->buffer;
+        buffers[ bufferCount ].iov_len  = file->bufferUsed;
+        ++bufferCount;
+    }
+
+    for ( where = 0; where < fragmentCount; ++where )
+    {
+        if ( fragments[ where ].size > 0 )
+        {
+            buffers[ bufferCount ].iov_base = (void*)fragments[ where ].data;
+            buffers[ bufferCount ].iov_len  = (size_t)(uint32_t)fragments[ where ].size;
+            ++bufferCount;
+        }
+    }
+
+    file->position   += totalSize;
+    file->fileEnd     = file->position > file->fileEnd ? file->position : file->fileEnd;
+    file->bufferUsed  = 0;
+
+    return write_vectors( file->fileDescriptor, buffers, bufferCount );
+}
+
+BitableResult bitable_wf_reserve( BitableWritableFile* file, uint32_t size, void** data )
+{
+    BitableResult result;
+
+    if ( file->mapped )
+    {
+        result = map_range( file, file->position + size );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+
+        *data = file->mapping + file->position;
+
+        return BR_SUCCESS;
+    }
+
+#if defined( BITABLE_IO_URING )
+    if ( file->ring != NULL && file->ring->error != BR_SUCCESS )
+    {
+        return file->ring->error;
+    }
+#endif
+
+    if ( size > file->bufferSize )
     {
         return BR_FILE_OPERATION_FAILED;
     }
 
+    if ( file->bufferSize - file->bufferUsed < size )
+    {
+        result = flush_buffer( file );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    *data = file->buffer + file->bufferUsed;
+
     return BR_SUCCESS;
 }
 
+BitableResult bitable_wf_commit( BitableWritableFile* file, uint32_t size )
+{
+    if ( !file->mapped )
+    {
+        file->bufferUsed += size;
+    }
+
+    file->position += size;
+    file->fileEnd   = file->position > file->fileEnd ? file->position : file->fileEnd;
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_flush( BitableWritableFile* file )
+{
+    return complete_writes( file );
+}
+
 BitableResult bitable_wf_sync( BitableWritableFile* file )
 {
+    BitableResult result = complete_writes( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    if ( file->mapping != NULL && msync( file->mapping, (size_t)file->mappingSize, MS_SYNC ) == -1 )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
     if ( fsync( file->fileDescriptor ) == -1 )
     {
         return BR_FILE_OPERATION_FAILED;
@@ -104,6 +1132,28 @@ BitableResult bitable_wf_sync( BitableWritableFile* file )
 
 BitableResult bitable_wf_close( BitableWritableFile* file )
 {
+    BitableResult result = complete_writes( file );
+
+    // release any preallocated space (or the rest of the last chunk of a memory mapped file) past the end of the data.
+    if ( file->preallocated > file->fileEnd || file->mappingSize > file->fileEnd )
+    {
+        if ( ftruncate( file->fileDescriptor, (off_t)file->fileEnd ) == -1 && result == BR_SUCCESS )
+        {
+            result = BR_FILE_OPERATION_FAILED;
+        }
+    }
+
     cleanup_wf( file );
+
+    return result;
+}
+
+BitableResult bitable_wf_delete( const char* path )
+{
+    if ( unlink( path ) == -1 )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
     return BR_SUCCESS;
 }
@@ -33,6 +33,9 @@ typedef struct BitableWritableFile
 {
 
     HANDLE fileHandle;
+    uint8_t* buffer; // write combining buffer (NULL if writes go straight through)
+    uint32_t bufferSize;
+    uint32_t bufferUsed;
 
 } BitableWritableFile;
 
@@ -48,11 +51,52 @@ static void cleanup_wf( BitableWritableFile* file )
             CloseHandle( file->fileHandle );
         }
 
+        free( file->buffer );
         free( file );
     }
 }
 
+/** Write data straight out to a file.
+  * @param file The file to write to.
+  * @param data The data to write.
+  * @param size The size of the data in bytes.
+  * @return BR_SUCCESS if the data was written, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult write_direct( BitableWritableFile* file, const void* data, uint32_t size )
+{
+    DWORD bytesWritten;
+
+    if ( WriteFile( file->fileHandle, data, size, &bytesWritten, NULL ) == FALSE || bytesWritten != size )
+    {
+        return BR_FILE_OPERATION_FAILED;
+    }
+
+    return BR_SUCCESS;
+}
+
+/** Write out the data in the write combining buffer.
+  * @param file The file to flush the buffer of.
+  * @return BR_SUCCESS if the buffer was written, BR_FILE_OPERATION_FAILED otherwise.
+  */
+static BitableResult flush_buffer( BitableWritableFile* file )
+{
+    BitableResult result = BR_SUCCESS;
+
+    if ( file->bufferUsed > 0 )
+    {
+        result           = write_direct( file, file->buffer, file->bufferUsed );
+        file->bufferUsed = 0;
+    }
+
+    return result;
+}
+
 BitableResult bitable_wf_create( BitableWritableFile** file, const char* path )
+{
+    return bitable_wf_create_buffered( file, path, 0 );
+}
+
+BitableResult bitable_wf_create_buffered( BitableWritableFile** file, const char* path, uint32_t bufferSize )
 {
     BitableWritableFile* fileResult         = calloc( 1, sizeof( BitableWritableFile ) );
     int                  widePathBufferSize = MultiByteToWideChar( CP_UTF8, 0, path, -1, NULL, 0 );
@@ -84,14 +128,61 @@ BitableResult bitable_wf_create( BitableWritableFile** file, const char* path )
         return BR_FILE_OPEN_FAILED;
     }
 
+    if ( bufferSize > 0 )
+    {
+        fileResult->buffer     = malloc( bufferSize );
+        fileResult->bufferSize = bufferSize;
+    }
+
     *file = fileResult;
 
     return BR_SUCCESS;
 }
 
+BitableResult bitable_wf_create_async( BitableWritableFile** file, const char* path, uint32_t bufferSize, uint32_t queueDepth )
+{
+    // there is no io_uring here, so writes are synchronous.
+    (void)queueDepth;
+
+    return bitable_wf_create_buffered( file, path, bufferSize );
+}
+
+BitableResult bitable_wf_create_with_options( BitableWritableFile** file, const char* path, const BitableWritableFileOptions* options )
+{
+    // FILE_FLAG_NO_BUFFERING would need sector aligned writes for the whole file (including the header rewrite), so direct I/O is left as a hint here,
+    // as is memory mapped output (reservations are made in the write combining buffer instead).
+    return bitable_wf_create_async( file, path, options->bufferSize, options->queueDepth );
+}
+
+BitableResult bitable_wf_preallocate( BitableWritableFile* file, uint64_t size )
+{
+    FILE_ALLOCATION_INFO allocation;
+
+    // sets the allocation size without moving the end of file, space past the end of file is released when the handle is closed.
+    allocation.AllocationSize.QuadPart = (LONGLONG)size;
+
+    SetFileInformationByHandle( file->fileHandle, FileAllocationInfo, &allocation, sizeof( FILE_ALLOCATION_INFO ) );
+
+    return BR_SUCCESS;
+}
+
+int bitable_wf_is_mapped( const BitableWritableFile* file )
+{
+    // memory mapped output isn't supported here, so files are always written through the buffer.
+    (void)file;
+
+    return 0;
+}
+
 BitableResult bitable_wf_seek( BitableWritableFile* file, int64_t position )
 {
     LARGE_INTEGER convertedPosition;
+    BitableResult result = flush_buffer( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
 
     convertedPosition.QuadPart = position;
 
@@ -105,18 +196,98 @@ BitableResult bitable_wf_seek( BitableWritableFile* file, int64_t position )
 
 BitableResult bitable_wf_write( BitableWritableFile* file, const void* data, uint32_t size )
 {
-    DWORD bytesWritten;
+    BitableResult result;
 
-    if ( WriteFile( file->fileHandle, data, size, &bytesWritten, NULL ) == FALSE || bytesWritten != size )
+    if ( size <= file->bufferSize - file->bufferUsed && size > 0 )
+    {
+        memcpy( file->buffer + file->bufferUsed, data, size );
+
+        file->bufferUsed += size;
+
+        return BR_SUCCESS;
+    }
+
+    result = flush_buffer( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
+    // writes that wouldn't fit in an empty buffer go straight out.
+    if ( size >= file->bufferSize )
+    {
+        return write_direct( file, data, size );
+    }
+
+    memcpy( file->buffer, data, size );
+
+    file->bufferUsed = size;
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_write_gather( BitableWritableFile* file, const BitableValue* fragments, uint32_t fragmentCount )
+{
+    uint32_t where;
+
+    // WriteFileGather needs unbuffered, page sized and aligned buffers, so fragments are written one at a time.
+    for ( where = 0; where < fragmentCount; ++where )
+    {
+        BitableResult result = bitable_wf_write( file, fragments[ where ].data, (uint32_t)fragments[ where ].size );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_reserve( BitableWritableFile* file, uint32_t size, void** data )
+{
+    if ( size > file->bufferSize )
     {
         return BR_FILE_OPERATION_FAILED;
     }
 
+    if ( file->bufferSize - file->bufferUsed < size )
+    {
+        BitableResult result = flush_buffer( file );
+
+        if ( result != BR_SUCCESS )
+        {
+            return result;
+        }
+    }
+
+    *data = file->buffer + file->bufferUsed;
+
+    return BR_SUCCESS;
+}
+
+BitableResult bitable_wf_commit( BitableWritableFile* file, uint32_t size )
+{
+    file->bufferUsed += size;
+
     return BR_SUCCESS;
 }
 
+BitableResult bitable_wf_flush( BitableWritableFile* file )
+{
+    return flush_buffer( file );
+}
+
 BitableResult bitable_wf_sync( BitableWritableFile* file )
 {
+    BitableResult result = flush_buffer( file );
+
+    if ( result != BR_SUCCESS )
+    {
+        return result;
+    }
+
     if ( FlushFileBuffers( file->fileHandle ) == FALSE )
     {
         return BR_FILE_OPERATION_FAILED;
@@ -127,6 +298,35 @@ BitableResult bitable_wf_sync( BitableWritableFile* file )
 
 BitableResult bitable_wf_close( BitableWritableFile* file )
 {
+    BitableResult result = flush_buffer( file );
+
     cleanup_wf( file );
-    return BR_SUCCESS;
+
+    return result;
+}
+
+BitableResult bitable_wf_delete( const char* path )
+{
+    int    widePathBufferSize = MultiByteToWideChar( CP_UTF8, 0, path, -1, NULL, 0 );
+    LPWSTR widePathBuffer     = NULL;
+    BOOL   deleted;
+
+    if ( widePathBufferSize <= 0 )
+    {
+        return BR_BAD_PATH;
+    }
+
+    widePathBuffer = malloc( sizeof( WCHAR ) * widePathBufferSize );
+
+    if ( MultiByteToWideChar( CP_UTF8, 0, path, -1, widePathBuffer, widePathBufferSize ) <= 0 )
+    {
+        free( widePathBuffer );
+        return BR_BAD_PATH;
+    }
+
+    deleted = DeleteFileW( widePathBuffer );
+
+    free( widePathBuffer );
+
+    return deleted ? BR_SUCCESS : BR_FILE_OPERATION_FAILED;
 }
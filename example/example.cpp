@@ -25,6 +25,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "bitablewrite.h"
 #include "bitableread.h"
+#include "bitablesort.h"
 #include <stdio.h>
 
 // All keys will in the simple value table will be less than this.
@@ -33,6 +34,21 @@ static const int SIMPLE_TABLE_UPPER = 1024 * 1024;
 // All keys in the large value table will be less than this.
 static const int LARGE_VALUE_UPPER  = 4096;
 
+// All keys in the bulk table will be less than this.
+static const int BULK_TABLE_UPPER   = 64 * 1024;
+
+// The number of keys appended at a time to the bulk table.
+static const int BULK_BATCH_SIZE    = 1000;
+
+// The number of times each key of the bulk table is added to the sorter (only the last is kept).
+static const int SORT_PASSES        = 4;
+
+// The memory budget of the sorter (the smallest allowed), small enough that it spills more runs than it can merge at once.
+static const size_t SORT_BUDGET     = 64 * 1024;
+
+// The most runs the sorter should spill with the budget above, each run should hold hundreds of pairs.
+static const int SORT_MAX_RUNS      = SORT_PASSES * BULK_TABLE_UPPER / 100;
+
 // Example key comparison function. 
 static int key_compare( const BitableValue* left, const BitableValue* right ) 
 { 
@@ -78,8 +94,19 @@ private:
 // Example of writing out a simple example bitable with small keys and values
 static bool write_simple_table( BitableWritable* writable )
 {
+    BitableWriteOptions options;
+
+    // Keys in this table are 32bit integers, so we use the built in key kind rather than a comparison function. 
+    // This is recorded in the table and lets readers use a search with the key comparison inlined.
+    bitable_write_default_options( &options );
+
+    options.pageSize      = 4096;
+    options.keyAlignment  = 4;
+    options.dataAlignment = 4;
+    options.keyKind       = BKK_INT32_LE;
+
     // create the table file
-    BitableResult result = bitable_write_create( writable, "example.btl", 4096, 4, 4 );
+    BitableResult result = bitable_write_create_with_options( writable, "example.btl", &options );
 
     if ( result != BR_SUCCESS )
     {
@@ -282,12 +309,65 @@ static void read_simple_lower( BitableReadable* readable )
     }
 }
 
+// Example of counting the keys in a range from the simple bitable, with a lower bound search for the start and an upper bound search for the end.
+static void read_simple_count( BitableReadable* readable )
+{
+    printf( "Counting key ranges...\n" );
+
+    // Ranges within a hole in the key space are empty, and ranges spanning a hole hold the key on either side of it.
+    for ( int32_t where = 1; where < SIMPLE_TABLE_UPPER - 3; where += 2 )
+    {
+        BitableCursor lower;
+        BitableCursor upper;
+        BitableValue  key;
+        int32_t       end = where + 2;
+        uint64_t      count;
+
+        key.data = &where;
+        key.size = sizeof( int32_t );
+
+        BitableResult result = bitable_find( &lower, readable, &key, BFO_LOWER );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_find( &upper, readable, &key, BFO_UPPER );
+        }
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_count_range( readable, &lower, &upper, &count );
+        }
+
+        if ( result != BR_SUCCESS || count != 0 )
+        {
+            printf( "Unexpected count in the hole at key %d - %d\n", where, result );
+            return;
+        }
+
+        key.data = &end;
+
+        result = bitable_find( &upper, readable, &key, BFO_UPPER );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_count_range( readable, &lower, &upper, &count );
+        }
+
+        if ( result != BR_SUCCESS || count != 1 )
+        {
+            printf( "Unexpected count from key %d to %d - %d\n", where, end, result );
+            return;
+        }
+    }
+}
+
 // Performs the reading examples for the simple example table
 static void read_simple_table( BitableReadable* readable )
 {
     printf( "Opening simple table for reading\n" );
 
-    BitableResult result = bitable_read_open( readable, "example.btl", BRO_NONE, key_compare );
+    // The simple table uses a built in key kind, so no comparison function is needed.
+    BitableResult result = bitable_read_open( readable, "example.btl", BRO_NONE, NULL );
 
     if ( result != BR_SUCCESS )
     {
@@ -299,6 +379,7 @@ static void read_simple_table( BitableReadable* readable )
     read_simple_exact( readable );
     read_simple_upper( readable );
     read_simple_lower( readable );
+    read_simple_count( readable );
 
     BitableStats stats;
 
@@ -541,6 +622,265 @@ static void read_large_value_table( BitableReadable* readable )
     bitable_free_paths( &paths );
 }
 
+// Example of appending a sorted array of keys in batches (or all at once, packing pages on multiple threads), 
+// to a table with a bloom filter sized when the table is closed.
+static bool write_bulk_table( BitableWritable* writable, bool parallel )
+{
+    printf( "Writing bulk table\n" );
+
+    BitableWriteOptions options;
+
+    bitable_write_default_options( &options );
+
+    options.keyKind         = BKK_INT32_LE;
+    options.bloomBitsPerKey = 10;
+
+    BitableResult result = bitable_write_create_with_options( writable, "example3.btl", &options );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed creating example3.btl - %d\n", result );
+        return false;
+    }
+
+    printf( parallel ? "Appending keys in parallel...\n" : "Appending keys in batches...\n" );
+
+    int32_t*      keyBuffer = new int32_t[ BULK_TABLE_UPPER ];
+    BitableValue* keys      = new BitableValue[ BULK_TABLE_UPPER ];
+
+    for ( int32_t where = 0; where < BULK_TABLE_UPPER; ++where )
+    {
+        keyBuffer[ where ] = where;
+
+        keys[ where ].data = keyBuffer + where;
+        keys[ where ].size = sizeof( int32_t );
+    }
+
+    // the keys double as the values.
+    if ( parallel )
+    {
+        result = bitable_append_parallel( writable, keys, keys, BULK_TABLE_UPPER, 0 );
+    }
+
+    for ( int32_t where = 0; where < BULK_TABLE_UPPER && !parallel && result == BR_SUCCESS; where += BULK_BATCH_SIZE )
+    {
+        int32_t count = BULK_TABLE_UPPER - where < BULK_BATCH_SIZE ? BULK_TABLE_UPPER - where : BULK_BATCH_SIZE;
+
+        result = bitable_append_batch( writable, keys + where, keys + where, count );
+    }
+
+    delete[] keys;
+    delete[] keyBuffer;
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed appending keys - %d\n", result );
+        return false;
+    }
+
+    result = bitable_write_close( writable, BCO_NONE );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed closing bulk table - %d\n", result );
+        return false;
+    }
+
+    return true;
+}
+
+// Example of writing the bulk table through a sorter, adding the keys out of order several times over with a memory budget small enough that the 
+// sorter spills runs and has to merge them in levels. Only the value added last for a key is kept, which is the key itself.
+static bool write_sorted_table( BitableWritable* writable )
+{
+    printf( "Writing sorted table\n" );
+
+    BitableSortOptions sortOptions;
+    BitableSorter*     sorter;
+
+    bitable_sort_default_options( &sortOptions );
+
+    sortOptions.keyKind      = BKK_INT32_LE;
+    sortOptions.memoryBudget = SORT_BUDGET / 4;
+
+    BitableResult result = bitable_sort_create( &sorter, "example3.scratch", &sortOptions );
+
+    if ( result != BR_MEMORY_BUDGET_INVALID )
+    {
+        printf( "Sorter should reject a memory budget below the minimum - %d\n", result );
+
+        if ( result == BR_SUCCESS )
+        {
+            bitable_sort_free( sorter );
+        }
+
+        return false;
+    }
+
+    sortOptions.memoryBudget = SORT_BUDGET;
+
+    result = bitable_sort_create( &sorter, "example3.scratch", &sortOptions );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed creating sorter - %d\n", result );
+        return false;
+    }
+
+    printf( "Adding keys out of order...\n" );
+
+    for ( int32_t pass = 0; pass < SORT_PASSES && result == BR_SUCCESS; ++pass )
+    {
+        for ( int32_t where = 0; where < BULK_TABLE_UPPER && result == BR_SUCCESS; ++where )
+        {
+            // 7919 is prime, so this visits every key once per pass.
+            int32_t      key   = (int32_t)( ( (int64_t)where * 7919 ) % BULK_TABLE_UPPER );
+            int32_t      value = pass == SORT_PASSES - 1 ? key : -1 - pass;
+            BitableValue keyValue;
+            BitableValue dataValue;
+
+            keyValue.data  = &key;
+            keyValue.size  = sizeof( int32_t );
+            dataValue.data = &value;
+            dataValue.size = sizeof( int32_t );
+
+            result = bitable_sort_add( sorter, &keyValue, &dataValue );
+        }
+    }
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed adding keys - %d\n", result );
+        bitable_sort_free( sorter );
+        return false;
+    }
+
+    // runs are numbered in the order they are spilled, so if this run exists, too many were spilled.
+    char  runPath[ 64 ];
+    FILE* runFile;
+
+    sprintf( runPath, "example3.scratch.run%04d", SORT_MAX_RUNS );
+
+    runFile = fopen( runPath, "rb" );
+
+    if ( runFile != NULL )
+    {
+        printf( "Sorter spilled more than %d runs\n", SORT_MAX_RUNS );
+        fclose( runFile );
+        bitable_sort_free( sorter );
+        return false;
+    }
+
+    BitableWriteOptions options;
+
+    bitable_write_default_options( &options );
+
+    options.keyKind         = BKK_INT32_LE;
+    options.bloomBitsPerKey = 10;
+
+    result = bitable_write_create_with_options( writable, "example3.btl", &options );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed creating example3.btl - %d\n", result );
+        bitable_sort_free( sorter );
+        return false;
+    }
+
+    printf( "Merging sorted runs...\n" );
+
+    result = bitable_sort_finish( sorter, writable );
+
+    bitable_sort_free( sorter );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed finishing sort - %d\n", result );
+        return false;
+    }
+
+    result = bitable_write_close( writable, BCO_NONE );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed closing sorted table - %d\n", result );
+        return false;
+    }
+
+    return true;
+}
+
+// Reads back the bulk table with exact searches (which check the bloom filter first), then deletes it.
+static bool read_bulk_table( BitableReadable* readable )
+{
+    printf( "Opening bulk table for reading\n" );
+
+    BitableResult result = bitable_read_open( readable, "example3.btl", BRO_NONE, NULL );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Failed to open bitable for reading - %d\n", result );
+        return false;
+    }
+
+    printf( "Doing exact key searches...\n" );
+
+    bool found = true;
+
+    for ( int32_t where = 0; where < BULK_TABLE_UPPER && found; ++where )
+    {
+        BitableCursor cursor;
+        BitableValue  key;
+        BitableValue  value;
+
+        key.data = &where;
+        key.size = sizeof( int32_t );
+
+        result = bitable_find( &cursor, readable, &key, BFO_EXACT );
+
+        if ( result == BR_SUCCESS )
+        {
+            result = bitable_key_value_pair( &cursor, readable, &key, &value );
+        }
+
+        if ( result != BR_SUCCESS || *(int32_t*)key.data != where || *(int32_t*)value.data != where )
+        {
+            printf( "Couldn't find key %d - %d\n", where, result );
+
+            found = false;
+        }
+    }
+
+    BitableStats stats;
+
+    bitable_readable_stats( readable, &stats );
+
+    result = bitable_read_close( readable );
+
+    if ( result != BR_SUCCESS )
+    {
+        printf( "Couldn't close readable bitable\n" );
+    }
+
+    BitablePaths paths;
+
+    printf( "Deleting bulk table files...\n" );
+
+    bitable_build_paths( &paths, "example3.btl" );
+
+    for ( uint32_t where = 0; where < stats.depth; ++where )
+    {
+        remove( paths.branchPaths[ where ] );
+    }
+
+    remove( paths.bloomPath );
+    remove( paths.leafPath );
+
+    bitable_free_paths( &paths );
+
+    return found && stats.itemCount == BULK_TABLE_UPPER;
+}
+
 // Entry point, runs through the examples in order.
 int main( int argc, char* argv[] )
 {
@@ -565,6 +905,21 @@ int main( int argc, char* argv[] )
 
     read_large_value_table( readable );
 
+    if ( !write_bulk_table( writable, false ) || !read_bulk_table( readable ) )
+    {
+        return 1;
+    }
+
+    if ( !write_bulk_table( writable, true ) || !read_bulk_table( readable ) )
+    {
+        return 1;
+    }
+
+    if ( !write_sorted_table( writable ) || !read_bulk_table( readable ) )
+    {
+        return 1;
+    }
+
     printf( "Done.\n" );
 
     return 0;
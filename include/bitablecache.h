@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file
+  * @brief Interface for a cache of open readable bitables, shared between users of the same table.
+  */
+#ifndef BITABLE_CACHE_H__
+#define BITABLE_CACHE_H__
+#pragma once
+
+#include "bitableread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A cache of open readable bitables keyed by path. Each table is opened (and its files mapped) once, and shared between everyone that acquires it.
+  * Tables that aren't in use are kept open until the cache goes over its budget, when the least recently used are closed. 
+  * Acquiring a closed table re-opens it. All cache functions are thread safe.
+  */
+typedef struct BitableTableCache BitableTableCache;
+
+/** A reference to a table acquired from the cache, which must be released with bitable_cache_release.
+  */
+typedef struct BitableCacheHandle BitableCacheHandle;
+
+/** Options used for creating a table cache. Initialise with bitable_cache_default_options before changing individual options.
+  */
+typedef struct BitableTableCacheOptions
+{
+
+    /** The options tables are opened with.
+      */
+    BitableReadOptions readOptions;
+
+    /** The maximum number of tables to keep open. Tables in use are never closed, so this can be exceeded while they are.
+      */
+    uint32_t maxOpenTables;
+
+    /** The maximum number of bytes of files to keep mapped into memory (across all the open tables). As with maxOpenTables, tables in use are never closed to meet this.
+      */
+    uint64_t maxMappedBytes;
+
+} BitableTableCacheOptions;
+
+/** Initialise table cache options with the defaults (up to 256 open tables, no limit on mapped bytes and default read options).
+  * @param [out] options The options to initialise. Should not be null.
+  */
+BITABLE_API void bitable_cache_default_options( BitableTableCacheOptions* options );
+
+/** Create a table cache.
+  * @param options The options for the cache. Should not be null.
+  * @return The created cache, or NULL if it could not be created.
+  */
+BITABLE_API BitableTableCache* bitable_cache_create( const BitableTableCacheOptions* options );
+
+/** Acquire a table from the cache, opening it if it isn't open already. The table may be used from any thread until the handle is released.
+  * Tables are keyed by the path string as given (paths aren't normalised, so different paths to the same file give different tables).
+  * Tables are opened without holding the cache's lock, so other tables can be acquired and released meanwhile; threads acquiring a table that is
+  * being opened wait for the open to finish.
+  * @param cache The cache to acquire the table from. Should not be null.
+  * @param path The path of the table (UTF8 encoding), as passed to bitable_read_open. Should not be null.
+  * @param comparison The comparison function for tables with BKK_CUSTOM keys (may be NULL otherwise). Only used when the table is opened, 
+  *        so every user of a path should pass the same function.
+  * @param [out] handle The handle for the acquired table. Should not be null.
+  * @return BR_SUCCESS if the table was acquired, BR_ALLOCATION_FAILED if the cache entry couldn't be allocated, otherwise the error from opening the table.
+  */
+BITABLE_API BitableResult bitable_cache_acquire( BitableTableCache* cache, const char* path, BitableComparisonFunction* comparison, BitableCacheHandle** handle );
+
+/** Get the readable table for an acquired handle.
+  * @param handle The handle from bitable_cache_acquire. Should not be null.
+  * @return The readable table, valid until the handle is released.
+  */
+BITABLE_API const BitableReadable* bitable_cache_table( const BitableCacheHandle* handle );
+
+/** Release a table acquired from the cache. When no one is using a table, it becomes a candidate for closing.
+  * @param cache The cache the table was acquired from. Should not be null.
+  * @param handle The handle from bitable_cache_acquire. Should not be null, and should not be used after it is released.
+  */
+BITABLE_API void bitable_cache_release( BitableTableCache* cache, BitableCacheHandle* handle );
+
+/** Free a table cache, closing all the tables in it. All handles should be released first (this is asserted in debug builds), as their tables are closed.
+  * @param cache The cache to free. Should not be null.
+  */
+BITABLE_API void bitable_cache_free( BitableTableCache* cache );
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif // -- BITABLE_CACHE_H__
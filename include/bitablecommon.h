@@ -139,7 +139,31 @@ typedef enum BitableResult
 
     /** A value passed in for key or value data alignment is too large (greater than BITABLE_MAX_ALIGNMENT) or not a power of two.
       */
-    BR_ALIGNMENT_INVALID        = 14
+    BR_ALIGNMENT_INVALID        = 14,
+
+    /** The key kind is not a valid BitableKeyKind, or the table uses custom keys and no comparison function was provided.
+      */
+    BR_KEY_KIND_INVALID         = 15,
+
+    /** A worker thread (or the synchronisation used with it) could not be created.
+      */
+    BR_THREAD_CREATE_FAILED     = 16,
+
+    /** An append was made while an item reserved with bitable_append_reserve was still waiting to be committed, or bitable_append_commit was called without one.
+      */
+    BR_APPEND_STATE_INVALID     = 17,
+
+    /** A value that has been passed in has a negative size, or is made of fragments that are larger than the maximum value size (2^31 - 1) together.
+      */
+    BR_VALUE_INVALID            = 18,
+
+    /** Memory needed for the operation could not be allocated.
+      */
+    BR_ALLOCATION_FAILED        = 19,
+
+    /** A memory budget that has been passed in is too small to be useful.
+      */
+    BR_MEMORY_BUDGET_INVALID    = 20
 
 } BitableResult;
 
@@ -162,6 +186,82 @@ typedef enum BitableReadOpenFlags
 
 } BitableReadOpenFlags;
 
+/** Flags controlling how a memory mapped bitable file is kept resident in memory. These are best effort; if the OS
+  * doesn't support an option (or refuses it, for example because of resource limits) the file is still opened and mapped normally.
+  */
+typedef enum BitableResidencyFlags
+{
+
+    /** No options, pages are faulted in on demand.
+      */
+    BRR_NONE = 0,
+
+    /** Pre-fault the whole mapping when the file is opened (MAP_POPULATE), so the first searches don't take page faults.
+      */
+    BRR_POPULATE = 1,
+
+    /** Lock the mapping in memory (mlock/VirtualLock), as long as it fits in the remaining lock budget.
+      */
+    BRR_LOCK = 2,
+
+    /** Ask for the mapping to be backed by transparent huge pages (MADV_HUGEPAGE), reducing TLB misses.
+      */
+    BRR_HUGE_PAGES = 4,
+
+    /** Copy the file into anonymous memory (aligned for, and advised to use, huge pages) and close the file mapping.
+      * Intended for small, hot files like the upper branch levels, where huge page backing of the file cache isn't available.
+      */
+    BRR_ANONYMOUS_COPY = 8
+
+} BitableResidencyFlags;
+
+/** The kind of keys stored in a bitable. The key kind is recorded in the table header when the table is written, 
+  * and readers use a search specialised for built in key kinds (with the comparison inlined) instead of calling a comparison function.
+  */
+typedef enum BitableKeyKind
+{
+    /** Keys are compared with a user provided comparison function.
+      */
+    BKK_CUSTOM    = 0,
+
+    /** Keys are compared in unsigned lexicographic byte order (like memcmp), with shorter keys first on a tie.
+      */
+    BKK_MEMCMP    = 1,
+
+    /** Keys are 4 byte little endian signed integers.
+      */
+    BKK_INT32_LE  = 2,
+
+    /** Keys are 4 byte little endian unsigned integers.
+      */
+    BKK_UINT32_LE = 3,
+
+    /** Keys are 8 byte little endian signed integers.
+      */
+    BKK_INT64_LE  = 4,
+
+    /** Keys are 8 byte little endian unsigned integers.
+      */
+    BKK_UINT64_LE = 5,
+
+    /** Keys are 4 byte big endian unsigned integers.
+      */
+    BKK_UINT32_BE = 6,
+
+    /** Keys are 8 byte big endian unsigned integers.
+      */
+    BKK_UINT64_BE = 7,
+
+    /** Keys are 8 byte little endian IEEE 754 doubles. Keys are ordered by value, with -0.0 ordered before 0.0. NaN keys are not supported.
+      */
+    BKK_FLOAT64   = 8,
+
+    /** The number of key kinds (not a valid key kind).
+      */
+    BKK_COUNT     = 9
+
+} BitableKeyKind;
+
 /** Represents a value used for keys/value data by bitable. Basically a pointer to a data buffer and a size.
   */
 typedef struct BitableValue
@@ -188,6 +288,10 @@ typedef struct BitablePaths
       */
     char* largeValuePath;
 
+    /** The path of the bloom filter file
+      */
+    char* bloomPath;
+
     /** The path of branch level files, up to the maximum branch level.
       */
     char* branchPaths[ BITABLE_MAX_BRANCH_LEVELS ];
@@ -227,6 +331,19 @@ typedef struct BitableStats
      */
     uint32_t pageSize;
 
+    /** The kind of keys stored in the table (a BitableKeyKind).
+     */
+    uint32_t keyKind;
+
+    /** The number of bytes the bloom filter takes up (0 if the table doesn't have a bloom filter).
+     */
+    uint64_t bloomFilterSize;
+
+    /** The number of bytes of files mapped into memory for the table (including copies made for residency options), counting each mapping once (the parts
+      * of a single file table share the table file's mapping). Always 0 for writable tables.
+     */
+    uint64_t mappedSize;
+
 } BitableStats;
 
 /** The type for a comparison function used for comparing two keys when searching a bitable.
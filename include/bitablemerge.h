@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file
+  * @brief Interface for a cursor merging the keys of multiple bitables in order, and for merging multiple bitables into a new one.
+  */
+#ifndef BITABLE_MERGE_H__
+#define BITABLE_MERGE_H__
+#pragma once
+
+#include "bitableread.h"
+#include "bitablewrite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A cursor over the merged key order of a set of readable bitables (for example, a set of tables written by successive ingest batches).
+  * Sources are ordered oldest to newest, and where more than one source has the same key, only the item from the newest source is visited.
+  * The sources are merged with a loser tree, so moving the cursor costs about log2( source count ) key comparisons.
+  * A merge cursor isn't thread safe, but separate merge cursors over the same tables can be used from different threads.
+  */
+typedef struct BitableMergeCursor BitableMergeCursor;
+
+/** Create a merge cursor over a set of tables. The tables should all have the same key kind (and the same comparison function for BKK_CUSTOM keys),
+  * and must stay open until the cursor is freed. The cursor isn't positioned until first, last or find is called.
+  * Duplicate keys within a single table are treated like duplicates across tables, only one of them is visited.
+  * @param [out] cursor The created cursor, to be freed with bitable_merge_free. Should not be null.
+  * @param tables The open tables to merge, from oldest to newest. Should not be null.
+  * @param tableCount The number of tables, at least 1.
+  * @return BR_SUCCESS if the cursor was created. BR_KEY_KIND_INVALID if the tables have different key kinds or there are no tables,
+  *         BR_ALLOCATION_FAILED if the cursor could not be allocated.
+  */
+BITABLE_API BitableResult bitable_merge_create( BitableMergeCursor** cursor, const BitableReadable* const* tables, uint32_t tableCount );
+
+/** Free a merge cursor.
+  * @param cursor The cursor to free. Should not be null.
+  */
+BITABLE_API void bitable_merge_free( BitableMergeCursor* cursor );
+
+/** Move the cursor to the first key across all the tables.
+  * @param cursor The cursor to position. Should not be null.
+  * @return BR_SUCCESS if the cursor is positioned, BR_END_OF_SEQUENCE if all the tables are empty.
+  */
+BITABLE_API BitableResult bitable_merge_first( BitableMergeCursor* cursor );
+
+/** Move the cursor to the last key across all the tables.
+  * @param cursor The cursor to position. Should not be null.
+  * @return BR_SUCCESS if the cursor is positioned, BR_END_OF_SEQUENCE if all the tables are empty.
+  */
+BITABLE_API BitableResult bitable_merge_last( BitableMergeCursor* cursor );
+
+/** Find a key across all the tables, with the same operations as bitable_find. BFO_EXACT checks the tables from newest to oldest 
+  * (using their bloom filters where they have them), so a missing key is rejected without positioning the cursor.
+  * @param cursor The cursor to position. Should not be null.
+  * @param searchKey The key to search for. Should not be null.
+  * @param operation The operation to use for searching.
+  * @return BR_SUCCESS if the cursor is positioned. BR_KEY_NOT_FOUND if the operation is BFO_EXACT and no table has the key. 
+  * BR_END_OF_SEQUENCE if the operation is an upper/lower bound and the bound is outside all the tables. BR_KEY_INVALID if the key is invalid for the key kind.
+  */
+BITABLE_API BitableResult bitable_merge_find( BitableMergeCursor* cursor, const BitableValue* searchKey, BitableFindOperation operation );
+
+/** Move the cursor to the next key across all the tables.
+  * @param cursor The cursor to move. Should not be null.
+  * @return BR_SUCCESS if the cursor moved, BR_END_OF_SEQUENCE if there are no more keys (or the cursor isn't positioned). 
+  * Once the cursor has moved off either end, it needs to be positioned again with first, last or find.
+  */
+BITABLE_API BitableResult bitable_merge_next( BitableMergeCursor* cursor );
+
+/** Move the cursor to the previous key across all the tables.
+  * @param cursor The cursor to move. Should not be null.
+  * @return BR_SUCCESS if the cursor moved, BR_END_OF_SEQUENCE if there are no more keys (or the cursor isn't positioned).
+  * Once the cursor has moved off either end, it needs to be positioned again with first, last or find.
+  */
+BITABLE_API BitableResult bitable_merge_previous( BitableMergeCursor* cursor );
+
+/** Get the key and value at the cursor, along with the source table they come from. 
+  * @param cursor The positioned cursor. Should not be null.
+  * @param [out] key The key at the cursor (may be null if not required).
+  * @param [out] value The value at the cursor (may be null if not required).
+  * @param [out] source The index of the table the item comes from, in the order passed to bitable_merge_create (may be null if not required).
+  * @return BR_SUCCESS if the item was retrieved, BR_INVALID_CURSOR_LOCATION if the cursor isn't positioned on an item.
+  */
+BITABLE_API BitableResult bitable_merge_key_value_pair( const BitableMergeCursor* cursor, BitableValue* key, BitableValue* value, uint32_t* source );
+
+/** Get the position of the cursor in its source table, for use with the regular read functions on that table.
+  * @param cursor The positioned cursor. Should not be null.
+  * @param [out] source The index of the table the item comes from, in the order passed to bitable_merge_create. Should not be null.
+  * @param [out] sourceCursor The position of the item in the source table. Should not be null.
+  * @return BR_SUCCESS if the position was retrieved, BR_INVALID_CURSOR_LOCATION if the cursor isn't positioned on an item.
+  */
+BITABLE_API BitableResult bitable_merge_position( const BitableMergeCursor* cursor, uint32_t* source, BitableCursor* sourceCursor );
+
+/** Options for merging tables into a new table with bitable_merge. Initialise with bitable_merge_default_options before changing individual options.
+  */
+typedef struct BitableMergeOptions
+{
+    /** The options for writing the merged table. The key kind is always taken from the tables being merged.
+      */
+    BitableWriteOptions writeOptions;
+
+    /** The options for completing the merged table (or each range partitioned table) when it is closed.
+      */
+    BitableCompletionOptions completionOptions;
+
+    /** The number of threads to merge with, including the calling thread (0 for the number of hardware threads).
+      */
+    uint32_t threadCount;
+
+    /** The number of key ranges to split the merge into (0 for 4 per thread). Ranges are written in parallel, more ranges balance better across threads.
+      * There may be fewer ranges than this for small tables.
+      */
+    uint32_t rangeCount;
+
+    /** Non-zero to leave the output as a set of range partitioned tables, one per key range, named with the output path followed by
+      * ".r" and the range number as 4 digits ("output.r0000", "output.r0001"...), instead of stitching them together into a single table.
+      */
+    int partitioned;
+
+} BitableMergeOptions;
+
+/** Populate merge options with the defaults (default write options, BCO_NONE completion, a thread per hardware thread, 4 ranges per thread and a single stitched output table).
+  * @param [out] options The options to populate. Should not be null.
+  */
+BITABLE_API void bitable_merge_default_options( BitableMergeOptions* options );
+
+/** Merge a set of tables into a new table (for example, compacting the tables written by successive ingest batches), with the same
+  * rules as a merge cursor: tables are ordered oldest to newest and only the newest item for each key is kept.
+  * The key space is split into ranges at keys spread evenly through the largest table, and the ranges are merged and written in parallel
+  * to temporary single file tables next to the output. Unless the output is partitioned, the temporary tables are then stitched together 
+  * into the output by copying their leaf pages whole (with bitable_append_pages), and deleted.
+  * The tables must stay open for the duration of the call. If the merge fails, any files written are deleted.
+  * @param tables The open tables to merge, from oldest to newest. Should not be null.
+  * @param tableCount The number of tables, at least 1.
+  * @param path The path (UTF8 encoding) to write the merged table to. Should not be null.
+  * @param options The options for the merge, initialised with bitable_merge_default_options. Should not be null.
+  * @param [out] partCount The number of tables written, 1 unless the output is partitioned (may be null if not required).
+  * @return BR_SUCCESS if the tables were merged. BR_KEY_KIND_INVALID if the tables have different key kinds or there are no tables.
+  * BR_THREAD_CREATE_FAILED if the synchronisation for the workers couldn't be created. BR_ALLOCATION_FAILED if the merge's bookkeeping couldn't be allocated. Otherwise the error from writing the output tables.
+  */
+BITABLE_API BitableResult bitable_merge( const BitableReadable* const* tables, uint32_t tableCount, const char* path, const BitableMergeOptions* options, uint32_t* partCount );
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif // -- BITABLE_MERGE_H__
@@ -77,6 +77,49 @@ typedef enum BitableFindOperation
 } BitableFindOperation;
 
 
+/** Options used for opening a bitable for reading. Initialise with bitable_read_default_options before changing individual options.
+  */
+typedef struct BitableReadOptions
+{
+    /** The flags to use for opening the bitable - note reading hints will be applied to leaf and large value files only.
+      */
+    BitableReadOpenFlags openFlags;
+
+    /** The number of branch levels from the top of the tree to copy into a contiguous, cache line aligned search array of key heads (0 for none).
+      * Searches go through the array with branch-free code before dropping into the memory mapped levels below it, avoiding touching a page per level at the top of the tree.
+      * Only used for tables with built in key kinds, or BKK_CUSTOM tables with key prefixes.
+      */
+    uint32_t cachedBranchLevels;
+
+    /** The maximum number of bytes to use for the cached branch levels. If the requested levels don't fit, levels are dropped from the bottom until they do.
+      */
+    uint64_t branchCacheBudget;
+
+    /** Residency flags (a combination of BitableResidencyFlags) for each branch level, indexed from the top of the tree (0 is the root level).
+      * The upper levels are small and touched by every search, so they are the best candidates for populating, locking or copying into huge pages.
+      */
+    uint32_t branchResidency[ BITABLE_MAX_BRANCH_LEVELS ];
+
+    /** Residency flags (a combination of BitableResidencyFlags) for the leaf file.
+      */
+    uint32_t leafResidency;
+
+    /** Residency flags (a combination of BitableResidencyFlags) for the large value store.
+      */
+    uint32_t largeValueResidency;
+
+    /** Residency flags (a combination of BitableResidencyFlags) for the bloom filter.
+      */
+    uint32_t bloomResidency;
+
+    /** The maximum number of bytes, across all the files of the table, that will be locked in memory for files opened with BRR_LOCK.
+      * Files are considered from the top of the tree down (branch levels, then the bloom filter, the leaves and the large value store),
+      * and a file that doesn't fit in the remaining budget is not locked.
+      */
+    uint64_t lockBudget;
+
+} BitableReadOptions;
+
 /** Allocate a zeroed readable bitable, to be used with bitable_read_open (can be re-used multiple times, when a table is closed).
   * @return The allocated readable bitable.
   */
@@ -92,11 +135,27 @@ BITABLE_API BitableReadable* bitable_read_allocate();
   * @param [out] table The previously allocated readable bitable to open into. Should not be null.
   * @param path The path to the bitable to open, in UTF8 encoding (even on Windows extended charactesr are supported). Should not be null.
   * @param openFlags The flags to use for opening the bitable - note reading hints will be applied to leaf and large value files only, 
-  * @param comparison A comparison function that will be used to compare keys for searching. This should match the sort order when the keys were appended. Should not be null.
-  * @return BR_SUCCESS if the table could be successfully opened for reading, an error code otherwise (BR_ALREADY_OPEN, BR_FILE_OPERATION_FAILED, BR_FILE_TOO_SMALL, BR_HEADER_CORRUPT, BR_FILE_OPEN_FAILED, BR_FILE_TOO_LARGE).
+  * @param comparison A comparison function that will be used to compare keys for searching. This should match the sort order when the keys were appended. 
+  * Only used for tables written with the BKK_CUSTOM key kind (tables with a built in key kind use a search specialised for the key kind), and may be null otherwise.
+  * @return BR_SUCCESS if the table could be successfully opened for reading, an error code otherwise (BR_ALREADY_OPEN, BR_FILE_OPERATION_FAILED, BR_FILE_TOO_SMALL, BR_HEADER_CORRUPT, BR_FILE_OPEN_FAILED, BR_FILE_TOO_LARGE, BR_KEY_KIND_INVALID).
   */
 BITABLE_API BitableResult bitable_read_open( BitableReadable* table, const char* path, BitableReadOpenFlags openFlags, BitableComparisonFunction* comparison );
 
+/** Populate read options with the defaults (no open flags, no cached branch levels, 4MiB branch cache budget).
+  * @param [out] options The options to populate. Should not be null.
+  */
+BITABLE_API void bitable_read_default_options( BitableReadOptions* options );
+
+/** Open a bitable from the file system for reading, using the passed in options. Otherwise the same as bitable_read_open.
+  * When branch levels are cached, the cache is built here (allocating memory and reading the cached levels).
+  * @param [out] table The previously allocated readable bitable to open into. Should not be null.
+  * @param path The path to the bitable to open, in UTF8 encoding. Should not be null.
+  * @param options The options to open the table with, initialised with bitable_read_default_options. Should not be null.
+  * @param comparison A comparison function that will be used to compare keys for searching, as for bitable_read_open.
+  * @return BR_SUCCESS if the table could be successfully opened for reading, an error code otherwise (as for bitable_read_open).
+  */
+BITABLE_API BitableResult bitable_read_open_with_options( BitableReadable* table, const char* path, const BitableReadOptions* options, BitableComparisonFunction* comparison );
+
 /** Close the file handles (etc) associated with a previously opened readable bitable. 
   * Note, this operation can be called on an already closed table (idempotence). 
   * This does not free the memory associated with the BitableReadable, so it can be re-used.
@@ -121,18 +180,60 @@ BITABLE_API void bitable_read_free( BitableReadable* table );
   */
 BITABLE_API BitableResult bitable_readable_stats( const BitableReadable* table, BitableStats* stats );
 
+/** Compare two keys in the order of a table, using the comparison for its key kind (or its comparison function for BKK_CUSTOM keys).
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param table The open readable bitable whose key order to use. Should not be null.
+  * @param left The left key. Should not be null, and for fixed width key kinds should be the size of the key kind.
+  * @param right The right key. Should not be null, and for fixed width key kinds should be the size of the key kind.
+  * @return Less than 0 if left is less than right, 0 if they are equal and greater than 0 otherwise.
+  */
+BITABLE_API int bitable_compare( const BitableReadable* table, const BitableValue* left, const BitableValue* right );
+
 /** Given a key and find operation, find a matching position in the bitable and populate the cursor with it.  
   * This method is thread-safe on an open table (but the table must be open for the duration of the call), as it does not modify the bitable.
   * BFO_EXACT searches will only find exact key matches, BFO_LOWER will find the lower inclusive bound of a range. BFO_UPPER will find the upper inclusive bound of a range search.
+  * If the table was written with a bloom filter, BFO_EXACT searches for most keys not in the table are rejected by the filter without searching the tree.
   * Note that this function does not allocate memory from the heap, but it may cause memory to be demand paged (memory mapped file).
   * @param [out] cursor The cursor that will be populated with the find position. Should not be null.
   * @param table The open readable bitable to find the key in. Should not be null.
   * @param searchKey The key to search for. Should not be null.
   * @param operation The operation to use for searching.
   * @return BR_SUCCESS if the operation is successful. BR_KEY_NOT_FOUND is the operation is BFO_EXACT and the key doesn't exist in the bitable. BR_END_OF_SEQUENCE if the operation is an upper/lower bound and the bound is outside the bitable range.
+  * BR_KEY_INVALID if the table has a fixed width key kind and the search key is a different size.
 */
 BITABLE_API BitableResult bitable_find( BitableCursor* cursor, const BitableReadable* table, const BitableValue* searchKey, BitableFindOperation operation );
 
+/** Perform a find operation for many keys at once, populating a cursor and a result for each key.
+  * Lookups are stepped through the tree in small groups, prefetching each lookup's next node before searching the nodes of the group,
+  * so memory stalls overlap instead of adding up. Results match calling bitable_find for each key individually.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call), as it does not modify the bitable.
+  * Note that this function does not allocate memory from the heap, but it may cause memory to be demand paged (memory mapped file).
+  * @param [out] cursors The cursors that will be populated with the find position for each key (count cursors). Should not be null.
+  * @param table The open readable bitable to find the keys in. Should not be null.
+  * @param searchKeys The keys to search for (count keys). Should not be null.
+  * @param [out] results The result of the find for each key (count results), as would be returned by bitable_find. Should not be null.
+  * @param count The number of keys to find.
+  * @param operation The operation to use for searching.
+  * @return BR_SUCCESS if every find operation succeeded, otherwise the first result from a find operation that didn't succeed.
+  */
+BITABLE_API BitableResult bitable_find_batch( BitableCursor* cursors, const BitableReadable* table, const BitableValue* searchKeys, BitableResult* results, size_t count, BitableFindOperation operation );
+
+/** Perform a find operation for many keys that are already sorted, populating a cursor and a result for each key.
+  * Instead of descending from the root for every key, the path through the branch levels is kept between keys 
+  * and the search only climbs as far as needed for the next key, so keys landing in the same leaf page are resolved together 
+  * and a sorted probe of the whole table is close to a single pass. Results match calling bitable_find for each key individually.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call), as it does not modify the bitable.
+  * Note that this function does not allocate memory from the heap, but it may cause memory to be demand paged (memory mapped file).
+  * @param [out] cursors The cursors that will be populated with the find position for each key (count cursors). Should not be null.
+  * @param table The open readable bitable to find the keys in. Should not be null.
+  * @param searchKeys The keys to search for (count keys), sorted in ascending order by the table's comparison. Duplicates are allowed. Should not be null.
+  * @param [out] results The result of the find for each key (count results), as would be returned by bitable_find. Should not be null.
+  * @param count The number of keys to find.
+  * @param operation The operation to use for searching.
+  * @return BR_SUCCESS if every find operation succeeded, otherwise the first result from a find operation that didn't succeed.
+  */
+BITABLE_API BitableResult bitable_find_sorted( BitableCursor* cursors, const BitableReadable* table, const BitableValue* searchKeys, BitableResult* results, size_t count, BitableFindOperation operation );
+
 /** Populate the cursor with the first position (beginning) of the bitable.
   * This method is thread-safe on an open table (but the table must be open for the duration of the call).
   * @param [out] cursor The cursor that will be populated with the first position. Should not be null.
@@ -193,6 +294,36 @@ BITABLE_API BitableResult bitable_value( const BitableCursor* cursor, const Bita
   */
 BITABLE_API BitableResult bitable_key_value_pair( const BitableCursor* cursor, const BitableReadable* table, BitableValue* key, BitableValue* value );
 
+/** Read a batch of consecutive key value pairs, starting at the cursor position (inclusive) and continuing across leaf pages, then move the cursor past the last pair read.
+  * Keys and values are read directly out of the table (zero copy), as with bitable_key_value_pair. This is much cheaper per item than bitable_next and bitable_key_value_pair for scans.
+  * Once the end of the table is reached, the cursor is left one past the last item, so further calls read nothing and return BR_END_OF_SEQUENCE.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param [in,out] cursor The cursor position to start reading from, moved to the position after the last pair read. Should not be null.
+  * @param table The open readable bitable to read from. Should not be null.
+  * @param [out] keys Array of at least maxCount keys to read out. May be null if keys aren't needed.
+  * @param [out] values Array of at least maxCount values to read out. May be null if values aren't needed.
+  * @param maxCount The maximum number of pairs to read.
+  * @param [out] count The number of pairs read. Should not be null.
+  * @return BR_SUCCESS if the pairs were read and there are more pairs after them. BR_END_OF_SEQUENCE if the end of the table was reached (count pairs were still read).
+  * BR_INVALID_CURSOR_LOCATION if the cursor position isn't valid.
+  */
+BITABLE_API BitableResult bitable_next_batch( BitableCursor* cursor, const BitableReadable* table, BitableValue* keys, BitableValue* values, uint32_t maxCount, uint32_t* count );
+
+/** Read a batch of consecutive key value pairs like bitable_next_batch, but stop at an end position (exclusive), such as a boundary from bitable_split_ranges.
+  * When the end position is reached, the cursor is left at the end position.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param [in,out] cursor The cursor position to start reading from, moved to the position after the last pair read. Should not be null.
+  * @param end The position to stop reading at, this item is not read. Should not be null.
+  * @param table The open readable bitable to read from. Should not be null.
+  * @param [out] keys Array of at least maxCount keys to read out. May be null if keys aren't needed.
+  * @param [out] values Array of at least maxCount values to read out. May be null if values aren't needed.
+  * @param maxCount The maximum number of pairs to read.
+  * @param [out] count The number of pairs read. Should not be null.
+  * @return BR_SUCCESS if the pairs were read and there are more pairs before the end position. BR_END_OF_SEQUENCE if the end position (or the end of the table) was reached (count pairs were still read).
+  * BR_INVALID_CURSOR_LOCATION if the cursor position isn't valid.
+  */
+BITABLE_API BitableResult bitable_next_batch_bounded( BitableCursor* cursor, const BitableCursor* end, const BitableReadable* table, BitableValue* keys, BitableValue* values, uint32_t maxCount, uint32_t* count );
+
 /** Read the indice (0 based) at a particular cursor position.
   * The indice number of key value pairs before the one at the cursor.
   * This method is thread-safe on an open table (but the table must be open for the duration of the call).
@@ -203,6 +334,43 @@ BITABLE_API BitableResult bitable_key_value_pair( const BitableCursor* cursor, c
   */
 BITABLE_API BitableResult bitable_indice( const BitableCursor* cursor, const BitableReadable* table, uint64_t* indice );
 
+/** Populate the cursor with the position of the item at an indice (0 based), the reverse of bitable_indice.
+  * Searches the initial indices of the leaf pages, so only a few pages are touched (tables written by older versions without leaf page indices walk the leaf pages instead).
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param [out] cursor The cursor that will be populated with the position. Should not be null.
+  * @param table The open readable bitable to seek in. Should not be null.
+  * @param indice The indice of the item to seek to.
+  * @return BR_SUCCESS if the operation is successful. BR_END_OF_SEQUENCE if the indice is beyond the end of the table.
+  */
+BITABLE_API BitableResult bitable_seek_indice( BitableCursor* cursor, const BitableReadable* table, uint64_t indice );
+
+/** Count the number of items between two cursors (inclusive), without scanning them.
+  * For example, the number of items matching a key range is the count between the BFO_LOWER find of the start key and BFO_UPPER find of the end key.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param table The open readable bitable to count in. Should not be null.
+  * @param lower The cursor at the start of the range (inclusive). Should not be null.
+  * @param upper The cursor at the end of the range (inclusive). Should not be null.
+  * @param [out] count The number of items in the range. Should not be null.
+  * @return BR_SUCCESS if the operation is successful. When upper is on the item just before lower (as the finds are for a key range with no keys in the table), 
+  *         the range is empty and count is 0. BR_INVALID_CURSOR_LOCATION if either cursor position isn't valid or upper is further before lower.
+  */
+BITABLE_API BitableResult bitable_count_range( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint64_t* count );
+
+/** Split the range of items between two cursors (inclusive) into a number of consecutive ranges with close to equal item counts, for scanning in parallel.
+  * Produces rangeCount + 1 boundary cursors, where range i is from boundaries[ i ] (inclusive) up to boundaries[ i + 1 ] (exclusive). The first boundary is lower and the last is the position after upper 
+  * (the start of the next leaf page, or one past the last item in the table, as left by bitable_next_batch). When there are fewer items than ranges, some ranges will be empty.
+  * Boundaries are found by searching the initial indices of the leaf pages, so only a few pages are touched per boundary. 
+  * For tables written by older versions without leaf page indices, ranges are split by leaf page instead.
+  * This method is thread-safe on an open table (but the table must be open for the duration of the call).
+  * @param table The open readable bitable to split the range of. Should not be null.
+  * @param lower The cursor at the start of the range (inclusive). Should not be null.
+  * @param upper The cursor at the end of the range (inclusive). Should not be null.
+  * @param rangeCount The number of ranges to split into. Should be greater than 0.
+  * @param [out] boundaries Array of rangeCount + 1 cursors to populate with the range boundaries. Should not be null.
+  * @return BR_SUCCESS if the operation is successful. BR_INVALID_CURSOR_LOCATION if either cursor position isn't valid or upper is before lower.
+  */
+BITABLE_API BitableResult bitable_split_ranges( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint32_t rangeCount, BitableCursor* boundaries );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file
+  * @brief Interface for scanning a bitable in parallel.
+  */
+#ifndef BITABLE_SCAN_H__
+#define BITABLE_SCAN_H__
+#pragma once
+
+#include "bitableread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Create the state for a scan worker, called on the calling thread before the scan starts.
+  * @param context The context from the scan callbacks.
+  * @param worker The index of the worker the state is for.
+  * @return The state for the worker (passed to the batch and reduce functions).
+  */
+typedef void* (BitableScanStateFunction)( void* context, uint32_t worker );
+
+/** Process a batch of consecutive key value pairs, called on a worker thread. Batches from a worker are in key order, but batches are spread across workers in no particular order.
+  * @param context The context from the scan callbacks.
+  * @param state The state of the worker processing the batch.
+  * @param keys The keys in the batch.
+  * @param values The values in the batch.
+  * @param count The number of key value pairs in the batch.
+  * @return 0 to continue the scan, non-zero to stop the scan early.
+  */
+typedef int (BitableScanBatchFunction)( void* context, void* state, const BitableValue* keys, const BitableValue* values, uint32_t count );
+
+/** Merge the state of a worker into the overall result, called on the calling thread after all workers have finished, in worker order.
+  * Also responsible for freeing the worker state if needed.
+  * @param context The context from the scan callbacks.
+  * @param state The state of the worker.
+  * @param worker The index of the worker.
+  */
+typedef void (BitableScanReduceFunction)( void* context, void* state, uint32_t worker );
+
+/** The callbacks used for a parallel scan.
+  */
+typedef struct BitableScanCallbacks
+{
+    /** User context passed to all the callbacks.
+      */
+    void* context;
+
+    /** Creates per worker state. May be null, in which case the worker state is null.
+      */
+    BitableScanStateFunction* createState;
+
+    /** Processes batches of key value pairs. Should not be null. Called concurrently from multiple threads, so it should only modify the worker state.
+      */
+    BitableScanBatchFunction* processBatch;
+
+    /** Merges worker state into the overall result. May be null.
+      */
+    BitableScanReduceFunction* reduce;
+
+} BitableScanCallbacks;
+
+/** Scan a range of a bitable in parallel, passing batches of key value pairs to a callback on a set of worker threads.
+  * The range is split into many chunks of close to equal item counts, each worker takes chunks from its own share of the range, 
+  * and workers that run out steal half of the remaining chunks from another worker, so slow chunks don't hold up the scan.
+  * The calling thread acts as one of the workers. When the scan completes, worker state is merged with the reduce callback.
+  * @param table The open readable bitable to scan. Should not be null.
+  * @param lower The cursor at the start of the range (inclusive). Should not be null.
+  * @param upper The cursor at the end of the range (inclusive). Should not be null.
+  * @param threadCount The number of workers to use (including the calling thread, up to 4096), 0 to use the number of hardware threads.
+  * @param callbacks The callbacks for the scan. Should not be null.
+  * @return BR_SUCCESS if the scan completed (or was stopped by the batch callback). BR_INVALID_CURSOR_LOCATION if either cursor position isn't valid or upper is before lower. 
+  * BR_THREAD_CREATE_FAILED if the worker threads couldn't be started. BR_ALLOCATION_FAILED if the scan's chunks and workers couldn't be allocated.
+  */
+BITABLE_API BitableResult bitable_parallel_scan( const BitableReadable* table, const BitableCursor* lower, const BitableCursor* upper, uint32_t threadCount, const BitableScanCallbacks* callbacks );
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif // -- BITABLE_SCAN_H__
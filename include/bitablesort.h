@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file
+  * @brief Interface for sorting key value pairs appended in any order into a bitable, spilling sorted runs to scratch files when they don't fit in memory.
+  */
+#ifndef BITABLE_SORT_H__
+#define BITABLE_SORT_H__
+#pragma once
+
+#include "bitablewrite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A sorter, that takes key value pairs in any order and writes them to a bitable in key order.
+  * Pairs are buffered in memory up to a memory budget, then the buffer is sorted (in parallel) and spilled to a run file next to the scratch path.
+  * When the sorter is finished, the runs and what is left in the buffer are merged with a loser tree and appended to the output table.
+  * Where the same key is added more than once, only the value added last is kept.
+  * A sorter isn't thread safe.
+  */
+typedef struct BitableSorter BitableSorter;
+
+/** Options for a sorter. Initialise with bitable_sort_default_options before changing individual options.
+  */
+typedef struct BitableSortOptions
+{
+    /** The kind of keys being sorted, which should match the key kind of the table the sorter is finished into.
+      */
+    BitableKeyKind keyKind;
+
+    /** The comparison function for BKK_CUSTOM keys (ignored for the built in key kinds).
+      */
+    BitableComparisonFunction* comparison;
+
+    /** The number of bytes of memory to buffer pairs in before sorting and spilling them as a run. This includes the pairs and the 
+      * space used to sort them, but not the write buffer for run files. Needs to be at least 64KiB.
+      */
+    size_t memoryBudget;
+
+    /** The number of threads to sort the buffer with, including the calling thread (0 for the number of hardware threads).
+      */
+    uint32_t threadCount;
+
+    /** The size of the write buffer for run files in bytes.
+      */
+    uint32_t writeBufferSize;
+
+} BitableSortOptions;
+
+/** Populate sort options with the defaults (BKK_CUSTOM keys with no comparison function, a 256MiB memory budget, a thread per hardware thread and 1MiB write buffers).
+  * @param [out] options The options to populate. Should not be null.
+  */
+BITABLE_API void bitable_sort_default_options( BitableSortOptions* options );
+
+/** Create a sorter.
+  * @param [out] sorter The created sorter, to be freed with bitable_sort_free. Should not be null.
+  * @param scratchPath The path (UTF8 encoding) run files are named after, with ".run" and the run number as 4 digits appended ("scratch.run0000", "scratch.run0001"...).
+  *        Should not be null.
+  * @param options The options for the sorter, initialised with bitable_sort_default_options. Should not be null.
+  * @return BR_SUCCESS if the sorter was created. BR_KEY_KIND_INVALID if the key kind is not valid, or is BKK_CUSTOM without a comparison function.
+  *         BR_MEMORY_BUDGET_INVALID if the memory budget is less than 64KiB. BR_ALLOCATION_FAILED if the sorter couldn't be allocated.
+  */
+BITABLE_API BitableResult bitable_sort_create( BitableSorter** sorter, const char* scratchPath, const BitableSortOptions* options );
+
+/** Free a sorter, deleting any run files it has written.
+  * @param sorter The sorter to free. Should not be null.
+  */
+BITABLE_API void bitable_sort_free( BitableSorter* sorter );
+
+/** Add a key value pair to a sorter, in any order. The key and value are copied. If the buffer reaches the memory budget, it is sorted and spilled as a run.
+  * @param sorter The sorter to add to. Should not be null.
+  * @param key The key. The key size needs to be less than BITABLE_MAX_KEY_SIZE (and the size of the key kind for fixed width key kinds). Should not be null.
+  * @param value The value. Should not be null.
+  * @return BR_SUCCESS if the pair was added. BR_KEY_INVALID if the key is not valid. BR_VALUE_INVALID if the value size is negative. 
+  *         BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if spilling a run fails. BR_ALLOCATION_FAILED if there isn't the memory to buffer the pair, even
+  *         after spilling the buffer early (in which case the pair isn't added).
+  */
+BITABLE_API BitableResult bitable_sort_add( BitableSorter* sorter, const BitableValue* key, const BitableValue* value );
+
+/** Finish sorting, appending all the pairs added to a table in key order, then delete the run files. The table should be created with the same key kind 
+  * (and comparison function) as the sorter and be empty, or only have keys that order before the sorted keys. The table isn't closed.
+  * If everything fit in memory, the buffer is appended straight to the table. After finishing (whether it succeeds or not), the sorter is empty and can be reused.
+  * @param sorter The sorter to finish. Should not be null.
+  * @param table A writable bitable created with bitable_write_create for the pairs to be appended to. Should not be null.
+  * @return BR_SUCCESS if the pairs were appended. BR_FILE_OPEN_FAILED or BR_FILE_OPERATION_FAILED if a run file couldn't be written or read back.
+  *         BR_ALLOCATION_FAILED if there isn't the memory to sort the buffer or merge the runs. Otherwise the error from appending to the table.
+  */
+BITABLE_API BitableResult bitable_sort_finish( BitableSorter* sorter, BitableWritable* table );
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif // -- BITABLE_SORT_H__
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include "bitablecommon.h"
+#include "bitableread.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -59,6 +60,103 @@ typedef enum BitableCompletionOptions
 
 } BitableCompletionOptions;
 
+/** Flags for optional features of the table format, used when creating a bitable for writing.
+  * The features used are recorded in the table header and picked up automatically by readers (except BWF_DIRECT_IO and BWF_MAPPED_OUTPUT, which only change how the table is written).
+  */
+typedef enum BitableWriteFlags
+{
+    /** No optional features.
+      */
+    BWF_NONE         = 0,
+
+    /** Store a fixed width, order preserving key prefix (the first 8 bytes of the key, big endian and zero padded) in the leaf and branch indices,
+      * so most search steps are settled by an integer comparison on the index, with the comparison function only called when prefixes tie.
+      * Only use this when the comparison function orders keys in unsigned lexicographic byte order (as memcmp does, with shorter keys first on a tie).
+      */
+    BWF_KEY_PREFIXES = 1,
+
+    /** Search the table with interpolation search, estimating the position of a key within each branch node and leaf page from the
+      * first and last keys in it, with a bounded fall back to binary search. Only likely to help when keys are close to evenly spread (timestamps,
+      * sequence numbers), and whether it beats the default binary search depends on the key set, so measure with your own data before enabling it.
+      * Only valid with the integer key kinds (BKK_INT32_LE through BKK_UINT64_BE).
+      */
+    BWF_INTERPOLATION = 2,
+
+    /** Store the whole table in a single file. The branch levels and large value store are written to their usual files while appending, 
+      * then concatenated (along with the bloom filter) onto the end of the leaf file when the table is closed, with their extents recorded in the header.
+      * Readers then need one open and one mapping per table, instead of one per level.
+      */
+    BWF_SINGLE_FILE = 4,
+
+    /** Write the leaf file and large value store with direct I/O (see BWFF_DIRECT), bypassing the page cache so building a large table doesn't evict
+      * the working set of readers. Needs a write buffer (writeBufferSize is rounded up to a multiple of 4096 bytes). The header and the unaligned tail of each
+      * file are written through the page cache when the table is closed. Doesn't change the table format. Falls back to normal writes where direct I/O isn't supported.
+      */
+    BWF_DIRECT_IO = 8,
+
+    /** Write the leaf file and large value store through memory mappings (see BWFF_MAPPED), grown in large chunks as the table is written.
+      * Leaf pages are packed directly in their final location in the file, instead of in a page buffer that is then copied out, and large values are
+      * copied straight into the mapped store. Takes precedence over BWF_DIRECT_IO and doesn't use the write buffer options. Doesn't change the table format. 
+      * Falls back to normal writes where memory mapped output isn't supported.
+      */
+    BWF_MAPPED_OUTPUT = 16
+
+} BitableWriteFlags;
+
+/** Options used for creating a bitable for writing. Initialise with bitable_write_default_options before changing individual options.
+  */
+typedef struct BitableWriteOptions
+{
+    /** The size of the page to use. Should be greater or equal to BITABLE_MIN_PAGE_SIZE and less than or equal to BITABLE_MAX_PAGE_SIZE. Should be a power of 2.
+      */
+    uint16_t pageSize;
+
+    /** The alignment that will be used for starting address of keys stored in the table. Needs to be greater than 0, less than BITABLE_MAX_ALIGNMENT and a power of 2. 
+      */
+    uint16_t keyAlignment;
+
+    /** The alignment that will be used for starting address of data value stored in the table. Needs to be greater than 0, less than BITABLE_MAX_ALIGNMENT and a power of 2.
+      */
+    uint16_t dataAlignment;
+
+    /** Optional format features to use, a combination of BitableWriteFlags.
+      */
+    uint32_t flags;
+
+    /** The kind of keys that will be appended (a BitableKeyKind). Recorded in the table so readers can use a search specialised for the key kind.
+      * Keys for fixed width key kinds must be exactly the size of the key kind.
+      */
+    BitableKeyKind keyKind;
+
+    /** The number of bloom filter bits to use per key (0 for no bloom filter). When non-zero, a blocked bloom filter of the keys is written
+      * alongside the table, allowing exact finds for keys not in the table to be rejected without searching the tree. 10 bits per key gives roughly a 1% false positive rate.
+      * Keys are hashed on their bytes, so this should only be used when keys that compare equal are byte-wise identical.
+      */
+    uint32_t bloomBitsPerKey;
+
+    /** The expected number of items that will be appended (0 if unknown). Only used to size the bloom filter. When known, the filter is built in place while appending, 
+      * otherwise key hashes are buffered and the filter is built when the table is closed.
+      */
+    uint64_t expectedItemCount;
+
+    /** The size in bytes of the write combining buffer used for each file of the table (0 to write each page as it is finished).
+      * Pages and large values are gathered in the buffer and written out together, saving a system call per page. 1-8MiB works well.
+      */
+    uint32_t writeBufferSize;
+
+    /** The number of write buffers that can be in flight at once for the leaf file and large value store (0 for synchronous writes). When non-zero, 
+      * full buffers are written asynchronously with io_uring where it's available, so packing pages overlaps with device writes, and writes are only waited on
+      * when every buffer is in flight or the table is closed. Falls back to synchronous writes where io_uring isn't available. Needs a write buffer.
+      */
+    uint32_t writeQueueDepth;
+
+    /** An estimate of the final size in bytes of the leaf file (0 if unknown), used to preallocate its space up front so the file system can
+      * allocate it in large extents. Space past the end of the table is released when it is closed. For single file tables, this is the whole table.
+      */
+    uint64_t expectedFileSize;
+
+} BitableWriteOptions;
+
 /** A bitable that can be written to.
   */
 typedef struct BitableWritable BitableWritable;
@@ -78,6 +176,21 @@ BITABLE_API BitableWritable* bitable_write_allocate();
   */
 BITABLE_API BitableResult bitable_write_create( BitableWritable* table, const char* path, uint16_t pageSize, uint16_t keyAlignment, uint16_t dataAlignment );
 
+/** Populate write options with the defaults (4096 byte pages, 8 byte key and data alignment, no optional format features, BKK_CUSTOM keys, no bloom filter, 
+  * a 1MiB write buffer per file with synchronous writes and no preallocation).
+  * @param [out] options The options to populate. Should not be null.
+  */
+BITABLE_API void bitable_write_default_options( BitableWriteOptions* options );
+
+/** Create an empty bitable for writing, using the passed in options.
+  * @param [out] table A writable bitable allocated with bitable_write_allocate that will be initialised with the parameters for the table. Should not be null.
+  * @param path The path (UTF8 encoding) to create the bitable. This should be the main leaf/data file name. Should not be null.
+  * @param options The options to create the table with, initialised with bitable_write_default_options. Should not be null.
+  * @return BR_SUCCESS if the table is successfully created. BR_ALREADY_OPEN if the table is already open, BR_PAGESIZE_INVALID if pageSize is not a valid value, BR_ALIGNMENT_INVALID if keyAlignment or dataAlignment are invalid. 
+  * BR_KEY_KIND_INVALID if the key kind is invalid (or BWF_INTERPOLATION is used without an integer key kind). BR_FILE_OPEN_FAILED, BR_BAD_PATH or BR_FILE_OPERATION_FAILED if a file operation means the file can not be created.
+  */
+BITABLE_API BitableResult bitable_write_create_with_options( BitableWritable* table, const char* path, const BitableWriteOptions* options );
+
 /** Append a key value pair to the bitable. 
   * Keys and pairs are always appended in key sorted order. 
   * Duplicate keys are not currently supported.
@@ -86,10 +199,96 @@ BITABLE_API BitableResult bitable_write_create( BitableWritable* table, const ch
   * @param table A writable bitable created with bitable_write_create for the key/value pair to be appended to. Should not be null.
   * @param key The key of the key value pair to append. The key size needs to be less than BITABLE_MAX_KEY_SIZE. Should not be null.
   * @param data The value data of the key value pair to append. Should not be null.
-  * @return BR_SUCCESS if the table is successfully created. BR_KEY_INVALID if the key is not valid. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  * @return BR_SUCCESS if the table is successfully created. BR_KEY_INVALID if the key is not valid (including not matching the size of a fixed width key kind). BR_VALUE_INVALID if the value size is negative. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
 */
 BITABLE_API BitableResult bitable_append( BitableWritable* table, const BitableValue* key, const BitableValue* data );
 
+/** Append a key value pair gathered from fragments (for example a header, payload and trailer), without concatenating them first.
+  * The fragments of the key, and of values no larger than BITABLE_MAX_KEY_SIZE, are each copied once into the leaf page. Larger values are written to the
+  * large value store straight from the fragments (with a single gathered write, where they don't fit in the write buffer). Otherwise like bitable_append.
+  * @param table A writable bitable created with bitable_write_create for the key/value pair to be appended to. Should not be null.
+  * @param keyFragments The fragments of the key, in order. The total key size needs to be less than BITABLE_MAX_KEY_SIZE. May be null if keyFragmentCount is 0.
+  * @param keyFragmentCount The number of key fragments.
+  * @param dataFragments The fragments of the value, in order. May be null if dataFragmentCount is 0.
+  * @param dataFragmentCount The number of value fragments.
+  * @return BR_SUCCESS if the pair was appended. BR_KEY_INVALID if the key is not valid. BR_VALUE_INVALID if the value fragments are too large together.
+  *         BR_APPEND_STATE_INVALID if there is an outstanding reservation. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. 
+  *         BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  */
+BITABLE_API BitableResult bitable_append_gather( BitableWritable* table, 
+                                                 const BitableValue* keyFragments, 
+                                                 uint32_t keyFragmentCount, 
+                                                 const BitableValue* dataFragments, 
+                                                 uint32_t dataFragmentCount );
+
+/** Append a batch of key value pairs, in key sorted order (continuing the order of anything already appended). Intended for bulk loads from sorted arrays.
+  * Rather than appending one pair at a time, the run of pairs that fit in the current leaf page is sized up front, copied in, and the page's indices 
+  * and counts updated once, with a branch entry added once per page. The resulting table is the same as appending the pairs one at a time with bitable_append.
+  * @param table A writable bitable created with bitable_write_create for the key/value pairs to be appended to. Should not be null.
+  * @param keys The keys of the pairs, in order. Each key size needs to be less than BITABLE_MAX_KEY_SIZE. Should not be null unless count is 0.
+  * @param data The values of the pairs, matching the keys. Should not be null unless count is 0.
+  * @param count The number of pairs.
+  * @return BR_SUCCESS if all the pairs were appended. BR_KEY_INVALID if a key is not valid, or BR_VALUE_INVALID if a value size is negative, in which case the pairs
+  *         before it are appended. BR_APPEND_STATE_INVALID if there is an outstanding reservation. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth.
+  *         BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  */
+BITABLE_API BitableResult bitable_append_batch( BitableWritable* table, const BitableValue* keys, const BitableValue* data, size_t count );
+
+/** Build a table from key value pairs already sorted in memory, packing the leaf pages on multiple threads. The table needs to be empty (nothing appended yet),
+  * but appends can carry on after the build. Page boundaries are worked out up front, then each round of pages is packed in parallel while the previous round
+  * is written out (along with its large values, branch entries and bloom filter keys), so file writes stay sequential and all the write modes work as usual.
+  * The rounds have a fixed maximum size, split between the threads, so the memory used doesn't grow with the thread count.
+  * The resulting table is the same as appending the pairs one at a time with bitable_append.
+  * @param table A writable bitable created with bitable_write_create, with nothing appended yet. Should not be null.
+  * @param keys The keys of the pairs, in order. Each key size needs to be less than BITABLE_MAX_KEY_SIZE. Should not be null unless count is 0.
+  * @param data The values of the pairs, matching the keys. Should not be null unless count is 0.
+  * @param count The number of pairs.
+  * @param threadCount The number of threads used to pack pages (including the calling thread), or 0 to use the number of hardware threads.
+  * @return BR_SUCCESS if all the pairs were appended. BR_KEY_INVALID if a key is not valid, or BR_VALUE_INVALID if a value size is negative, in which case nothing
+  *         is appended. BR_APPEND_STATE_INVALID if the table isn't empty or there is an outstanding reservation. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches
+  *         its maximum depth. BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails. BR_ALLOCATION_FAILED if the buffers for packing
+  *         pages can't be allocated even for a single thread, in which case nothing is appended.
+  */
+BITABLE_API BitableResult bitable_append_parallel( BitableWritable* table, const BitableValue* keys, const BitableValue* data, size_t count, uint32_t threadCount );
+
+/** Reserve space to append a key value pair in place, so the caller can serialize the key and value straight into the table instead of into their own memory first.
+  * The key (and values no larger than BITABLE_MAX_KEY_SIZE) are reserved in the current leaf page, and large values at the end of the large value store 
+  * (in its write buffer if they fit, otherwise in a staging buffer written out on commit). Once the key and value have been written, 
+  * the pair is appended with bitable_append_commit. Keys are in the same order as with bitable_append. 
+  * The reserved space is only valid until the commit, and there can only be one reservation at a time. A reservation that is never committed is dropped when the table is closed.
+  * @param table A writable bitable created with bitable_write_create for the key/value pair to be appended to. Should not be null.
+  * @param keySize The size of the key in bytes. Needs to be less than BITABLE_MAX_KEY_SIZE (and match the size of a fixed width key kind).
+  * @param dataSize The size of the value in bytes.
+  * @param [out] keyDestination Set to where the key should be written (aligned to the key alignment). Should not be null.
+  * @param [out] dataDestination Set to where the value should be written (aligned to the value alignment for values stored in the leaf page, large values may not be aligned). Should not be null.
+  * @return BR_SUCCESS if the space was reserved. BR_KEY_INVALID if the key size is not valid. BR_VALUE_INVALID if the value size is negative. BR_APPEND_STATE_INVALID if there is already a reservation. 
+  *         BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  *         BR_ALLOCATION_FAILED if the staging buffer for a large value (or the buffer for the bloom filter's key hashes) can't be allocated.
+  */
+BITABLE_API BitableResult bitable_append_reserve( BitableWritable* table, int32_t keySize, int32_t dataSize, void** keyDestination, void** dataDestination );
+
+/** Append the key value pair written to the space reserved by bitable_append_reserve.
+  * @param table The writable bitable the space was reserved in. Should not be null.
+  * @return BR_SUCCESS if the pair was appended. BR_APPEND_STATE_INVALID if there is no reservation. BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. 
+  *         BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  */
+BITABLE_API BitableResult bitable_append_commit( BitableWritable* table );
+
+/** Append a run of leaf pages from an open readable table, copying them whole rather than appending their items one at a time.
+  * The pages are started on a new leaf page, and their keys must all come after the keys already in this table (and stay in order). 
+  * Large values are copied into this table's large value store and the bloom filter (if any) is updated with the keys.
+  * Appending can carry on after the pages with bitable_append, filling the last copied page. 
+  * Used to stitch together tables written separately for consecutive key ranges, for example by bitable_merge.
+  * @param table A writable bitable created with bitable_write_create to append the pages to. Should not be null.
+  * @param source The open readable table to copy pages from. Should not be null.
+  * @param firstPage The first leaf page to copy.
+  * @param pageCount The number of leaf pages to copy (use the leafPages from bitable_readable_stats for the whole table).
+  * @return BR_SUCCESS if the pages were appended. BR_PAGESIZE_INVALID, BR_ALIGNMENT_INVALID or BR_KEY_KIND_INVALID if the page size, alignments, key kind or
+  * use of key prefixes of the tables don't match. BR_INVALID_CURSOR_LOCATION if the pages are outside the source table. 
+  * BR_MAXIMUM_TABLE_TREE_DEPTH if the tree reaches its maximum depth. BR_FILE_OPERATION_FAILED or BR_FILE_OPEN_FAILED if a file operation fails.
+  */
+BITABLE_API BitableResult bitable_append_pages( BitableWritable* table, const BitableReadable* source, uint64_t firstPage, uint64_t pageCount );
+
 /** Get the statistics associated with a particular bitable (including the number of items, depth, page size, key and value alignments etc).
   * @param table The open readable bitable to get the stats from. Should not be null.
   * @param [out] stats The stats from the table. Should not be null.
@@ -70,6 +70,46 @@ typedef struct BitableMemoryMappedFile
  */
 BITABLE_API BitableResult bitable_mmf_open( BitableMemoryMappedFile* memoryMappedFile, const char* path, BitableReadOpenFlags openFlags );
 
+/** Opens a read-only memory mapped file with residency controls (pre-faulting, locking, huge pages or an anonymous copy).
+ *  Will map the entire file. Residency options are best effort, failing to apply one does not fail the open.
+ * @param [out] memoryMappedFile This will be populated with the memory mapped file details and should be passed to close when done. Does not null check.
+ * @param path This is the path of the file that will be mapped into memory. This is expected to be in a UTF8 encoding. Does not null check.
+ * @param openFlags This is the options for opening the memory mapped file.
+ * @param residencyFlags A combination of BitableResidencyFlags to apply to the mapping.
+ * @param [in,out] lockBudget The number of bytes that may still be locked in memory. If BRR_LOCK is set and the mapping fits, it is locked and
+ *        the budget reduced by the size of the mapping. May be NULL if BRR_LOCK is not set.
+ * @return A return code indicating the success of the operation, or a value indicating the kind of error that occured otherwise.
+ */
+BITABLE_API BitableResult bitable_mmf_open_resident( BitableMemoryMappedFile* memoryMappedFile,
+                                                     const char* path,
+                                                     BitableReadOpenFlags openFlags,
+                                                     uint32_t residencyFlags,
+                                                     uint64_t* lockBudget );
+
+/** Copies memory (usually part of another memory mapped file) into read-only anonymous memory, that can be used like a memory mapped file.
+ *  Where supported, copies of at least a huge page are aligned to huge pages and advised to use transparent huge pages.
+ * @param [out] copy This will be populated with the details of the copy and should be passed to close when done. Does not null check.
+ * @param address The start of the memory to copy. Does not null check.
+ * @param size The number of bytes to copy.
+ * @return BR_SUCCESS if the copy was made, BR_FILE_OPERATION_FAILED if the memory for it could not be allocated.
+ */
+BITABLE_API BitableResult bitable_mmf_copy( BitableMemoryMappedFile* copy, const void* address, size_t size );
+
+/** Applies the BRR_POPULATE and BRR_HUGE_PAGES residency options to a range of an open mapping. This is best effort.
+ * @param address The start of the range (rounded down to the start of the OS page). Does not null check.
+ * @param size The size of the range in bytes.
+ * @param residencyFlags A combination of BitableResidencyFlags, other flags are ignored.
+ */
+BITABLE_API void bitable_mmf_advise_range( const void* address, size_t size, uint32_t residencyFlags );
+
+/** Locks a range of an open mapping in memory, if it fits in the remaining lock budget. This is best effort.
+ * @param address The start of the range.
+ * @param size The size of the range in bytes.
+ * @param [in,out] lockBudget The number of bytes that may still be locked in memory, reduced by the size of the range if it is locked. Does not null check.
+ * @return Non-zero if the range was locked, zero otherwise.
+ */
+BITABLE_API int bitable_mmf_lock_range( const void* address, size_t size, uint64_t* lockBudget );
+
 /** Closes a read-only memory mapped file that has been opened by bitable_mmf_open 
 *
 * @param memoryMappedFile This will be populated with the memory mapped file details and should be passed to close when done. Does not null check.
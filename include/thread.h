@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** @file
+  * @brief Worker thread, mutex, condition variable and atomic support.
+  */
+#ifndef THREAD_H__
+#define THREAD_H__
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "bitablecommon.h"
+
+/** OS specific structure for a thread.
+  */
+typedef struct BitableThread BitableThread;
+
+/** OS specific structure for a mutex.
+  */
+typedef struct BitableMutex BitableMutex;
+
+/** OS specific structure for a condition variable.
+  */
+typedef struct BitableCondition BitableCondition;
+
+/** An integer shared between threads, that is only read and written with bitable_atomic_load and bitable_atomic_store so there is no data race.
+  */
+typedef struct BitableAtomic
+{
+    /** The value (not to be accessed directly).
+      */
+    volatile int32_t value;
+
+} BitableAtomic;
+
+/** The function a thread runs.
+  * @param context The context passed when the thread was created.
+  */
+typedef void (BitableThreadFunction)( void* context );
+
+/** Create and start a thread.
+  * @param [out] thread The created thread - should be joined with bitable_thread_join if this function is successful. No null check performed.
+  * @param function The function for the thread to run. Does not null check.
+  * @param context The context to pass to the function.
+  * @return BR_SUCCESS if the thread was started, BR_THREAD_CREATE_FAILED otherwise.
+  */
+BITABLE_API BitableResult bitable_thread_create( BitableThread** thread, BitableThreadFunction* function, void* context );
+
+/** Wait for a thread to finish, then free it.
+  * @param thread The thread to join. Does not null check.
+  */
+BITABLE_API void bitable_thread_join( BitableThread* thread );
+
+/** Get the number of hardware threads available.
+  * @return The number of hardware threads (at least 1).
+  */
+BITABLE_API uint32_t bitable_hardware_threads();
+
+/** Create a mutex.
+  * @param [out] mutex The created mutex - should be destroyed with bitable_mutex_destroy if this function is successful. No null check performed.
+  * @return BR_SUCCESS if the mutex was created, BR_THREAD_CREATE_FAILED otherwise.
+  */
+BITABLE_API BitableResult bitable_mutex_create( BitableMutex** mutex );
+
+/** Lock a mutex, waiting until it is available. Not recursive.
+  * @param mutex The mutex to lock. Does not null check.
+  */
+BITABLE_API void bitable_mutex_lock( BitableMutex* mutex );
+
+/** Unlock a mutex locked by the calling thread.
+  * @param mutex The mutex to unlock. Does not null check.
+  */
+BITABLE_API void bitable_mutex_unlock( BitableMutex* mutex );
+
+/** Destroy a mutex created with bitable_mutex_create. The mutex should not be locked.
+  * @param mutex The mutex to destroy. Does not null check.
+  */
+BITABLE_API void bitable_mutex_destroy( BitableMutex* mutex );
+
+/** Create a condition variable.
+  * @param [out] condition The created condition variable - should be destroyed with bitable_condition_destroy if this function is successful. No null check performed.
+  * @return BR_SUCCESS if the condition variable was created, BR_THREAD_CREATE_FAILED otherwise.
+  */
+BITABLE_API BitableResult bitable_condition_create( BitableCondition** condition );
+
+/** Wait on a condition variable, unlocking the mutex while waiting and locking it again before returning. Wakeups can be spurious, so the
+  * condition being waited for should be checked again in a loop.
+  * @param condition The condition variable to wait on. Does not null check.
+  * @param mutex The mutex protecting the condition, locked by the calling thread. Does not null check.
+  */
+BITABLE_API void bitable_condition_wait( BitableCondition* condition, BitableMutex* mutex );
+
+/** Wake all the threads waiting on a condition variable.
+  * @param condition The condition variable to signal. Does not null check.
+  */
+BITABLE_API void bitable_condition_broadcast( BitableCondition* condition );
+
+/** Destroy a condition variable created with bitable_condition_create. No threads should be waiting on it.
+  * @param condition The condition variable to destroy. Does not null check.
+  */
+BITABLE_API void bitable_condition_destroy( BitableCondition* condition );
+
+/** Read an atomic integer, seeing any writes made by a thread before it stored the value read.
+  * @param atomic The atomic to read. Does not null check.
+  * @return The value of the atomic.
+  */
+BITABLE_API int32_t bitable_atomic_load( const BitableAtomic* atomic );
+
+/** Write an atomic integer, so the writes made by the calling thread before it are seen by a thread that loads the value.
+  * @param atomic The atomic to write. Does not null check.
+  * @param value The value to store.
+  */
+BITABLE_API void bitable_atomic_store( BitableAtomic* atomic, int32_t value );
+
+#ifdef __cplusplus
+}
+#endif 
+
+#endif // -- THREAD_H__
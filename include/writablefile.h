@@ -40,6 +40,48 @@ extern "C" {
   */
 typedef struct BitableWritableFile BitableWritableFile;
 
+/** Flags for creating writable files.
+  */
+typedef enum BitableWritableFileFlags
+{
+    /** No options.
+      */
+    BWFF_NONE   = 0,
+
+    /** Write the file with direct I/O (O_DIRECT), bypassing the page cache, so building a large table doesn't evict the data other processes are using.
+      * Writes are copied through aligned buffers (the buffer size is rounded up to a multiple of 4096 bytes) and written in whole blocks. Once a write
+      * can't be kept aligned (an unaligned seek, or the tail of the file when it's flushed) the rest of the file goes through the page cache instead.
+      * This is a hint; where direct I/O isn't supported (other platforms, or file systems like tmpfs) the file is written normally.
+      */
+    BWFF_DIRECT = 1,
+
+    /** Write the file through a shared memory mapping, growing the file (and remapping it) in large chunks as it is written, and trimming it to the end of 
+      * the data when it is closed. Writes become copies into the mapping without a system call, and bitable_wf_reserve hands out space in the file itself,
+      * so data can be packed in its final location. The buffer options and BWFF_DIRECT are ignored. This is a hint; where memory mapped output isn't 
+      * supported (Windows) the file is written normally.
+      */
+    BWFF_MAPPED = 2
+
+} BitableWritableFileFlags;
+
+/** Options for creating a writable file.
+  */
+typedef struct BitableWritableFileOptions
+{
+    /** The size of the write combining buffer (or of each buffer, for asynchronous writes) in bytes, 0 for no buffering.
+      */
+    uint32_t bufferSize;
+
+    /** The maximum number of buffers in flight at once for asynchronous writes, 0 for synchronous writes.
+      */
+    uint32_t queueDepth;
+
+    /** A combination of BitableWritableFileFlags.
+      */
+    uint32_t flags;
+
+} BitableWritableFileOptions;
+
 /** Create a file for writing, allocating the handle information
   * @param [out] file Allocated open file handling for writing - should be closed with bitable_wf_close if this open function is successful. No null check performed.
   * @param path The file path to open, should be in UTF8 encoding. Does not null check.
@@ -47,6 +89,53 @@ typedef struct BitableWritableFile BitableWritableFile;
   */
 BITABLE_API BitableResult bitable_wf_create( BitableWritableFile** file, const char* path );
 
+/** Create a file for writing with a write combining buffer, allocating the handle information. Writes smaller than the buffer are gathered
+  * in it and written out together, so writing a page at a time doesn't cost a system call per page. Larger writes go straight out
+  * (along with anything buffered). The buffer is flushed before seeking, syncing and closing, or with bitable_wf_flush.
+  * @param [out] file Allocated open file handling for writing - should be closed with bitable_wf_close if this open function is successful. No null check performed.
+  * @param path The file path to open, should be in UTF8 encoding. Does not null check.
+  * @param bufferSize The size of the write combining buffer in bytes (0 for no buffering, like bitable_wf_create).
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_create_buffered( BitableWritableFile** file, const char* path, uint32_t bufferSize );
+
+/** Create a file for writing asynchronously, allocating the handle information. Writes are gathered in a ring of buffers, and each buffer is submitted 
+  * through io_uring as it fills, so the caller carries on filling the next buffer while the device writes. Completions are reaped as buffers are needed, and
+  * only waited on when every buffer is in flight, or when the file is seeked, synced, flushed or closed (so errors may only be returned then).
+  * Where io_uring isn't available (other platforms, older kernels, or sandboxes that block it), this falls back to bitable_wf_create_buffered.
+  * @param [out] file Allocated open file handling for writing - should be closed with bitable_wf_close if this open function is successful. No null check performed.
+  * @param path The file path to open, should be in UTF8 encoding. Does not null check.
+  * @param bufferSize The size of each buffer in bytes (0 for no buffering, like bitable_wf_create).
+  * @param queueDepth The maximum number of buffers in flight at once (0 for synchronous writes, like bitable_wf_create_buffered).
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_create_async( BitableWritableFile** file, const char* path, uint32_t bufferSize, uint32_t queueDepth );
+
+/** Create a file for writing with the given buffering, asynchronous write and direct I/O options, allocating the handle information. 
+  * bitable_wf_create, bitable_wf_create_buffered and bitable_wf_create_async are shorthands for this.
+  * @param [out] file Allocated open file handling for writing - should be closed with bitable_wf_close if this open function is successful. No null check performed.
+  * @param path The file path to open, should be in UTF8 encoding. Does not null check.
+  * @param options The options to create the file with. Does not null check.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_create_with_options( BitableWritableFile** file, const char* path, const BitableWritableFileOptions* options );
+
+/** Preallocate space for a file from an estimate of its final size, without changing the size of the file, so the file system
+  * can allocate it in large extents up front. Any space past the end of the data is released when the file is closed. 
+  * This is best effort, and does nothing where the OS doesn't support it.
+  * @param file The file to preallocate space for. Does not null check.
+  * @param size The number of bytes to preallocate, from the start of the file.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_preallocate( BitableWritableFile* file, uint64_t size );
+
+/** Check whether a file is actually written through a memory mapping, as BWFF_MAPPED is only a hint. Only then can bitable_wf_reserve hand out space 
+  * of any size in the file itself.
+  * @param file The file to check. Does not null check.
+  * @return Non-zero if the file is memory mapped, zero otherwise.
+  */
+BITABLE_API int bitable_wf_is_mapped( const BitableWritableFile* file );
+
 /** Seek to a position in a previously opened file relative the beginning.
   * @param file The file to seek in. Does not null check.
   * @param position The position to seek to.
@@ -62,18 +151,57 @@ BITABLE_API BitableResult bitable_wf_seek( BitableWritableFile* file, int64_t po
   */
 BITABLE_API BitableResult bitable_wf_write( BitableWritableFile* file, const void* data, uint32_t size );
 
+/** Write data gathered from several fragments to the current file point for a file, as if the fragments were written one after the other.
+  * Where the gathered data won't fit in the write combining buffer, it is written along with any buffered data in a single system call (writev) without copying.
+  * @param file The file to write to. Does not null check.
+  * @param fragments The fragments of data to write, in order. Does not null check.
+  * @param fragmentCount The number of fragments.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_write_gather( BitableWritableFile* file, const BitableValue* fragments, uint32_t fragmentCount );
+
+/** Reserve space to write data in place at the current file point, instead of writing it from another buffer. For memory mapped files the space is in the
+  * mapping of the file itself, otherwise it is in the write combining buffer (so the reservation can't be larger than the buffer). Nothing is written
+  * until the data is committed with bitable_wf_commit, and the space is only valid until the next operation on the file.
+  * @param file The file to reserve space in. Does not null check.
+  * @param size The number of bytes to reserve.
+  * @param [out] data Set to the start of the reserved space. Does not null check.
+  * @return BR_SUCCESS if the space was reserved, BR_FILE_OPERATION_FAILED if the file has no buffer large enough (or a memory mapped file couldn't be grown),
+  *         or another error from writing out buffered data.
+  */
+BITABLE_API BitableResult bitable_wf_reserve( BitableWritableFile* file, uint32_t size, void** data );
+
+/** Commit data written to space reserved with bitable_wf_reserve, moving the current file point past it.
+  * @param file The file the space was reserved in. Does not null check.
+  * @param size The number of bytes written to the reserved space, no more than were reserved.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_commit( BitableWritableFile* file, uint32_t size );
+
+/** Write out anything held in the write combining buffer of a file, and wait for any asynchronous writes to complete.
+  * @param file The file to flush. Does not null check.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_flush( BitableWritableFile* file );
+
 /** Sync a file to disk, including its metadata.
   * @param file The file to sync. Does not null check.
   * @return A return code indicating either success, or the reason for failure.
   */
 BITABLE_API BitableResult bitable_wf_sync( BitableWritableFile* file );
 
-/** Close a previously opened file.
+/** Close a previously opened file, flushing the write combining buffer.
   * @param file The file to close. Does not null check.
-  * @return A return code indicating either success, or the reason for failure.
+  * @return A return code indicating either success, or the reason for failure (including failing to write out buffered data). The file is closed either way.
   */
 BITABLE_API BitableResult bitable_wf_close( BitableWritableFile* file );
 
+/** Delete a file (that should not be open).
+  * @param path The file path to delete, should be in UTF8 encoding. Does not null check.
+  * @return A return code indicating either success, or the reason for failure.
+  */
+BITABLE_API BitableResult bitable_wf_delete( const char* path );
+
 #ifdef __cplusplus
 }
 #endif 
@@ -1,3 +1,54 @@
+-- Output directories for each platform and configuration, shared by all the projects.
+function target_directories()
+	configuration { "x64", "DebugLib" }
+		targetdir "bin/64/debug_lib"
+
+	configuration { "x64", "ReleaseLib" }
+		targetdir "bin/64/release_lib"
+
+	configuration { "x64", "DebugDLL" }
+		targetdir "bin/64/debug_dll"
+
+	configuration { "x64", "ReleaseDLL" }
+		targetdir "bin/64/release_dll"
+		
+	configuration { "x32", "DebugLib" }
+		targetdir "bin/32/debug_lib"
+
+	configuration { "x32", "ReleaseLib" }
+		targetdir "bin/32/release_lib"
+
+	configuration { "x32", "DebugDLL" }
+		targetdir "bin/32/debug_dll"
+
+	configuration { "x32", "ReleaseDLL" }
+		targetdir "bin/32/release_dll"
+end
+
+-- Configuration shared by the console applications linking the bitable library.
+function console_app_configurations()
+	configuration "Debug*"
+		flags { "Symbols" }
+		
+	configuration "Release*"
+		flags { "OptimizeSpeed" }
+
+	configuration "linux"
+		links { "pthread" }
+
+	configuration "*DLL"
+		defines { "BITABLE_DLL" }
+		if os.is( "linux" ) then
+			if _ACTION == "gmake" then
+				linkoptions { "-Wl,-rpath,'$$ORIGIN'" } 
+			elseif _ACTION == "codeblocks" then
+				linkoptions { "-Wl,-R\\\\$$$ORIGIN" }
+			end
+		end
+
+	target_directories()
+end
+
 solution "Bitable"
 	configurations { "DebugLib", "ReleaseLib", "DebugDLL", "ReleaseDLL" }
 	platforms      { "x32", "x64" }
@@ -30,30 +81,9 @@ solution "Bitable"
 		configuration "linux"
 			excludes { "bitable/*.win32.c"}
 			buildoptions { "-fvisibility=hidden" }
+			links { "pthread" }
 			
-		configuration { "x64", "DebugLib" }
-			targetdir "bin/64/debug_lib"
-
-		configuration { "x64", "ReleaseLib" }
-			targetdir "bin/64/release_lib"
-
-		configuration { "x64", "DebugDLL" }
-			targetdir "bin/64/debug_dll"
-
-		configuration { "x64", "ReleaseDLL" }
-			targetdir "bin/64/release_dll"
-			
-		configuration { "x32", "DebugLib" }
-			targetdir "bin/32/debug_lib"
-
-		configuration { "x32", "ReleaseLib" }
-			targetdir "bin/32/release_lib"
-
-		configuration { "x32", "DebugDLL" }
-			targetdir "bin/32/debug_dll"
-
-		configuration { "x32", "ReleaseDLL" }
-			targetdir "bin/32/release_dll"
+		target_directories()
 
 	project "example"
 		language "C++"
@@ -61,44 +91,12 @@ solution "Bitable"
 		files { "example/*.cpp", "example/*.c", "example/*.h" }
 		links { "bitable" }
 
-		configuration "Debug*"
-			flags { "Symbols" }
-			
-		configuration "Release*"
-			flags { "OptimizeSpeed" }
-
-		configuration "*DLL"
-			defines { "BITABLE_DLL" }
-			if os.is( "linux" ) then
-				if _ACTION == "gmake" then
-					linkoptions { "-Wl,-rpath,'$$ORIGIN'" } 
-				elseif _ACTION == "codeblocks" then
-					linkoptions { "-Wl,-R\\\\$$$ORIGIN" }
-				end
-			end
-	
-
-		configuration { "x64", "DebugLib" }
-			targetdir "bin/64/debug_lib"
-
-		configuration { "x64", "ReleaseLib" }
-			targetdir "bin/64/release_lib"
-
-		configuration { "x64", "DebugDLL" }
-			targetdir "bin/64/debug_dll"
+		console_app_configurations()
 
-		configuration { "x64", "ReleaseDLL" }
-			targetdir "bin/64/release_dll"
-			
-		configuration { "x32", "DebugLib" }
-			targetdir "bin/32/debug_lib"
-
-		configuration { "x32", "ReleaseLib" }
-			targetdir "bin/32/release_lib"
-
-		configuration { "x32", "DebugDLL" }
-			targetdir "bin/32/debug_dll"
+	project "bitablemerge"
+		language "C"
+		kind "ConsoleApp"
+		files { "tools/bitablemerge.c" }
+		links { "bitable" }
 
-		configuration { "x32", "ReleaseDLL" }
-			targetdir "bin/32/release_dll"
-		
\ No newline at end of file
+		console_app_configurations()
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2015, Conor Stokes
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Command line tool to merge (compact) a set of bitables into a new table, keeping the newest item for each key.
+// Only tables with built in key kinds can be merged, as tables with BKK_CUSTOM keys need their comparison function.
+
+#define _CRT_SECURE_NO_WARNINGS 1
+
+#include "bitablemerge.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void print_usage()
+{
+    printf( "usage: bitablemerge [options] output input... (inputs from oldest to newest)\n" );
+    printf( "  -t threads   number of threads to merge with (default: hardware threads)\n" );
+    printf( "  -r ranges    number of key ranges to split the merge into (default: 4 per thread)\n" );
+    printf( "  -b bits      bloom filter bits per key for the output (default: none)\n" );
+    printf( "  -k           store key prefixes in the output\n" );
+    printf( "  -s           write the output as a single file\n" );
+    printf( "  -p           leave the output partitioned by key range (output.r0000, output.r0001...)\n" );
+    printf( "  -d           complete the output durably\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+    BitableMergeOptions options;
+    BitableReadable**   tables;
+    BitableStats        stats;
+    BitableResult       result;
+    const char*         output;
+    uint32_t            tableCount;
+    uint32_t            partCount;
+    uint32_t            opened;
+    int                 where = 1;
+
+    bitable_merge_default_options( &options );
+
+    for ( ; where < argc && argv[ where ][ 0 ] == '-'; ++where )
+    {
+        const char* option   = argv[ where ];
+        int         hasValue = strcmp( option, "-t" ) == 0 || strcmp( option, "-r" ) == 0 || strcmp( option, "-b" ) == 0;
+
+        if ( hasValue && where + 1 >= argc )
+        {
+            print_usage();
+            return 1;
+        }
+
+        if ( strcmp( option, "-t" ) == 0 )
+        {
+            options.threadCount = (uint32_t)strtoul( argv[ ++where ], NULL, 10 );
+        }
+        else if ( strcmp( option, "-r" ) == 0 )
+        {
+            options.rangeCount = (uint32_t)strtoul( argv[ ++where ], NULL, 10 );
+        }
+        else if ( strcmp( option, "-b" ) == 0 )
+        {
+            options.writeOptions.bloomBitsPerKey = (uint32_t)strtoul( argv[ ++where ], NULL, 10 );
+        }
+        else if ( strcmp( option, "-k" ) == 0 )
+        {
+            options.writeOptions.flags |= BWF_KEY_PREFIXES;
+        }
+        else if ( strcmp( option, "-s" ) == 0 )
+        {
+            options.writeOptions.flags |= BWF_SINGLE_FILE;
+        }
+        else if ( strcmp( option, "-p" ) == 0 )
+        {
+            options.partitioned = 1;
+        }
+        else if ( strcmp( option, "-d" ) == 0 )
+        {
+            options.completionOptions = BCO_DURABLE;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if ( argc - where < 2 )
+    {
+        print_usage();
+        return 1;
+    }
+
+    output     = argv[ where++ ];
+    tableCount = (uint32_t)( argc - where );
+    tables     = calloc( tableCount, sizeof( BitableReadable* ) );
+    result     = BR_SUCCESS;
+
+    for ( opened = 0; opened < tableCount && result == BR_SUCCESS; ++opened )
+    {
+        tables[ opened ] = bitable_read_allocate();
+
+        result = bitable_read_open( tables[ opened ], argv[ where + opened ], BRO_SEQUENTIAL, NULL );
+
+        if ( result != BR_SUCCESS )
+        {
+            printf( "Failed to open %s (error %d)\n", argv[ where + opened ], (int)result );
+        }
+    }
+
+    if ( result == BR_SUCCESS )
+    {
+        // the output uses the page size and alignments of the first input.
+        bitable_readable_stats( tables[ 0 ], &stats );
+
+        options.writeOptions.pageSize      = (uint16_t)stats.pageSize;
+        options.writeOptions.keyAlignment  = (uint16_t)stats.keyAlignment;
+        options.writeOptions.dataAlignment = (uint16_t)stats.valueAlignment;
+
+        result = bitable_merge( (const BitableReadable* const*)tables, tableCount, output, &options, &partCount );
+
+        if ( result == BR_SUCCESS )
+        {
+            printf( "Merged %u tables into %u output table(s)\n", tableCount, partCount );
+        }
+        else
+        {
+            printf( "Merge failed (error %d)\n", (int)result );
+        }
+    }
+
+    for ( where = 0; where < (int)opened; ++where )
+    {
+        bitable_read_free( tables[ where ] );
+    }
+
+    free( tables );
+
+    return result == BR_SUCCESS ? 0 : 1;
+}